@@ -587,6 +587,8 @@ eel_strdup_printf_with_custom (EelPrintfHandler *handlers,
 
 G_LOCK_DEFINE_STATIC (unique_ref_strs);
 static GHashTable *unique_ref_strs = NULL;
+/* Protected by the unique_ref_strs lock too */
+static EelRefStrStats unique_ref_strs_stats;
 
 static eel_ref_str
 eel_ref_str_new_internal (const char *string, int start_count)
@@ -629,12 +631,17 @@ eel_ref_str_get_unique (const char *string)
 			g_hash_table_new (g_str_hash, g_str_equal);
 	}
 
+	unique_ref_strs_stats.n_lookups++;
+
 	res = g_hash_table_lookup (unique_ref_strs, string);
 	if (res != NULL) {
 		eel_ref_str_ref (res);
+		unique_ref_strs_stats.n_shared++;
 	} else {
 		res = eel_ref_str_new_internal (string, 0x80000001);
 		g_hash_table_insert (unique_ref_strs, res, res);
+		unique_ref_strs_stats.n_strings++;
+		unique_ref_strs_stats.n_bytes += sizeof (gint) + strlen (res) + 1;
 	}
 	
 	G_UNLOCK (unique_ref_strs);
@@ -673,6 +680,8 @@ eel_ref_str_unref (eel_ref_str str)
 		/* Need to recheck after taking lock to avoid races with _get_unique() */
 		if (g_atomic_int_add (count, -1) == 0x80000001) {
 			g_hash_table_remove (unique_ref_strs, (char *)str);
+			unique_ref_strs_stats.n_strings--;
+			unique_ref_strs_stats.n_bytes -= sizeof (gint) + strlen (str) + 1;
 			g_free ((char *)count);
 		} 
 		G_UNLOCK (unique_ref_strs);
@@ -682,6 +691,14 @@ eel_ref_str_unref (eel_ref_str str)
 	}
 }
 
+void
+eel_ref_str_get_unique_stats (EelRefStrStats *stats)
+{
+	G_LOCK (unique_ref_strs);
+	*stats = unique_ref_strs_stats;
+	G_UNLOCK (unique_ref_strs);
+}
+
 
 #if !defined (EEL_OMIT_SELF_CHECK)
 
@@ -758,6 +775,9 @@ verify_custom (const char *orig, const char *format, ...)
 void
 eel_self_check_string (void)
 {
+	eel_ref_str unique1, unique2;
+	EelRefStrStats before, after;
+
 	EEL_CHECK_STRING_RESULT (eel_str_double_underscores (NULL), NULL);
 	EEL_CHECK_STRING_RESULT (eel_str_double_underscores (""), "");
 	EEL_CHECK_STRING_RESULT (eel_str_double_underscores ("_"), "__");
@@ -832,6 +852,18 @@ eel_self_check_string (void)
 	verify_custom ("c1-42- bar c2-foo-","%N %s %Y", 42, "bar" ,"foo");
 	verify_custom ("c1-42- bar c2-foo-","%3$N %2$s %1$Y","foo", "bar", 42);
 
+	eel_ref_str_get_unique_stats (&before);
+	unique1 = eel_ref_str_get_unique ("eel self check unique string");
+	unique2 = eel_ref_str_get_unique ("eel self check unique string");
+	eel_ref_str_get_unique_stats (&after);
+	EEL_CHECK_BOOLEAN_RESULT (unique1 == unique2, TRUE);
+	EEL_CHECK_INTEGER_RESULT (after.n_strings - before.n_strings, 1);
+	EEL_CHECK_INTEGER_RESULT (after.n_lookups - before.n_lookups, 2);
+	EEL_CHECK_INTEGER_RESULT (after.n_shared - before.n_shared, 1);
+	eel_ref_str_unref (unique1);
+	eel_ref_str_unref (unique2);
+	eel_ref_str_get_unique_stats (&after);
+	EEL_CHECK_INTEGER_RESULT (after.n_strings, before.n_strings);
 }
 
 #endif /* !EEL_OMIT_SELF_CHECK */
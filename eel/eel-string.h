@@ -69,6 +69,16 @@ void        eel_ref_str_unref      (eel_ref_str  str);
 
 #define eel_ref_str_peek(__str) ((const char *)(__str))
 
+/* Statistics of the strings interned by eel_ref_str_get_unique() */
+typedef struct {
+	guint   n_strings; /* Distinct strings in the table */
+	gsize   n_bytes;   /* Bytes used by their text */
+	guint64 n_lookups; /* Calls to eel_ref_str_get_unique() */
+	guint64 n_shared;  /* Lookups that found the string in the table */
+} EelRefStrStats;
+
+void        eel_ref_str_get_unique_stats (EelRefStrStats *stats);
+
 
 typedef struct {
   char character;
@@ -60,6 +60,11 @@
 /* Initial unpositioned icon value */
 #define ICON_UNPOSITIONED_VALUE -1
 
+/* Number of pages around the visible area whose thumbnails are made
+ * ahead of the rest of the view.
+ */
+#define THUMBNAIL_PREFETCH_PAGES 1
+
 /* Timeout for making the icon currently selected for keyboard operation visible.
  * If this is 0, you can get into trouble with extra scrolling after holding
  * down the arrow key for awhile when there are many items.
@@ -1129,10 +1134,34 @@ sort_icons (NautilusCanvasContainer *container,
 	      GList                **icons)
 {
 	NautilusCanvasContainerClass *klass;
+	NautilusCanvasIcon *icon;
+	NautilusCanvasIconData **data;
+	GList *l;
+	guint i, n_icons;
 
 	klass = NAUTILUS_CANVAS_CONTAINER_GET_CLASS (container);
 	g_assert (klass->compare_icons != NULL);
 
+	if (klass->sort_icon_data != NULL) {
+		n_icons = g_list_length (*icons);
+		data = g_new (NautilusCanvasIconData *, n_icons);
+		for (l = *icons, i = 0; l != NULL; l = l->next, i++) {
+			icon = l->data;
+			data[i] = icon->data;
+		}
+
+		if (klass->sort_icon_data (container, data, n_icons)) {
+			/* Put the icons in the new order into the same list */
+			for (l = *icons, i = 0; l != NULL; l = l->next, i++) {
+				l->data = g_hash_table_lookup (container->details->icon_set, data[i]);
+			}
+			g_free (data);
+			return;
+		}
+
+		g_free (data);
+	}
+
 	*icons = g_list_sort_with_data (*icons, compare_icons, container);
 }
 
@@ -5877,16 +5906,29 @@ nautilus_canvas_container_prioritize_thumbnailing (NautilusCanvasContainer *cont
 	klass->prioritize_thumbnailing (container, icon->data);
 }
 
+static void
+nautilus_canvas_container_deprioritize_thumbnailing (NautilusCanvasContainer *container,
+						     NautilusCanvasIcon *icon)
+{
+	NautilusCanvasContainerClass *klass;
+
+	klass = NAUTILUS_CANVAS_CONTAINER_GET_CLASS (container);
+	if (klass->deprioritize_thumbnailing != NULL) {
+		klass->deprioritize_thumbnailing (container, icon->data);
+	}
+}
+
 static void
 nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *container)
 {
 	GtkAdjustment *vadj, *hadj;
 	double min_y, max_y;
 	double min_x, max_x;
+	double near_min, near_max;
 	double x0, y0, x1, y1;
 	GList *node;
 	NautilusCanvasIcon *icon;
-	gboolean visible;
+	gboolean visible, near_viewport;
 	GtkAllocation allocation;
 
 	hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container));
@@ -5903,9 +5945,24 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 			min_x, min_y, &min_x, &min_y);
 	eel_canvas_c2w (EEL_CANVAS (container),
 			max_x, max_y, &max_x, &max_y);
+
+	/* Icons within THUMBNAIL_PREFETCH_PAGES pages of the visible area
+	 * get their thumbnails made right after the visible ones, so they
+	 * are usually ready by the time the user scrolls to them.
+	 */
+	if (nautilus_canvas_container_is_layout_vertical (container)) {
+		near_min = min_x - (max_x - min_x) * THUMBNAIL_PREFETCH_PAGES;
+		near_max = max_x + (max_x - min_x) * THUMBNAIL_PREFETCH_PAGES;
+	} else {
+		near_min = min_y - (max_y - min_y) * THUMBNAIL_PREFETCH_PAGES;
+		near_max = max_y + (max_y - min_y) * THUMBNAIL_PREFETCH_PAGES;
+	}
 	
 	/* Do the iteration in reverse to get the render-order from top to
-	 * bottom for the prioritized thumbnails.
+	 * bottom for the prioritized thumbnails. Icons in the prefetch
+	 * margin are prioritized first, so the visible ones end up in front
+	 * of them, and icons that scrolled out of the margin are sent to the
+	 * back of the thumbnail queue.
 	 */
 	for (node = g_list_last (container->details->icons); node != NULL; node = node->prev) {
 		icon = node->data;
@@ -5925,17 +5982,39 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 
 			if (nautilus_canvas_container_is_layout_vertical (container)) {
 				visible = x1 >= min_x && x0 <= max_x;
+				near_viewport = x1 >= near_min && x0 <= near_max;
 			} else {
 				visible = y1 >= min_y && y0 <= max_y;
+				near_viewport = y1 >= near_min && y0 <= near_max;
 			}
 
+			icon->is_visible = visible;
+
 			if (visible) {
 				nautilus_canvas_item_set_is_visible (icon->item, TRUE);
-				nautilus_canvas_container_prioritize_thumbnailing (container,
-										   icon);
 			} else {
 				nautilus_canvas_item_set_is_visible (icon->item, FALSE);
+				if (near_viewport) {
+					nautilus_canvas_container_prioritize_thumbnailing (container,
+											   icon);
+				} else if (icon->is_near_viewport) {
+					nautilus_canvas_container_deprioritize_thumbnailing (container,
+											     icon);
+				}
 			}
+
+			icon->is_near_viewport = near_viewport;
+		} else {
+			icon->is_visible = FALSE;
+		}
+	}
+
+	for (node = g_list_last (container->details->icons); node != NULL; node = node->prev) {
+		icon = node->data;
+
+		if (icon->is_visible) {
+			nautilus_canvas_container_prioritize_thumbnailing (container,
+									   icon);
 		}
 	}
 }
@@ -156,6 +156,11 @@ typedef struct {
 	int          (* compare_icons_by_name)    (NautilusCanvasContainer *container,
 						     NautilusCanvasIconData *canvas_a,
 						     NautilusCanvasIconData *canvas_b);
+	/* Optional: sorts data in the compare_icons order without
+	 * calling it for each pair; returns FALSE if it can't */
+	gboolean     (* sort_icon_data)           (NautilusCanvasContainer *container,
+						     NautilusCanvasIconData **data,
+						     guint n_data);
 	void         (* freeze_updates)           (NautilusCanvasContainer *container);
 	void         (* unfreeze_updates)         (NautilusCanvasContainer *container);
 	void         (* start_monitor_top_left)   (NautilusCanvasContainer *container,
@@ -167,6 +172,8 @@ typedef struct {
 						   gconstpointer client);
 	void         (* prioritize_thumbnailing)  (NautilusCanvasContainer *container,
 						   NautilusCanvasIconData *data);
+	void         (* deprioritize_thumbnailing) (NautilusCanvasContainer *container,
+						    NautilusCanvasIconData *data);
 
 	/* Queries on icons for subclass/client.
 	 * These must be implemented => These are signals !
@@ -62,6 +62,10 @@ typedef struct {
 	/* Whether this item is visible in the view. */
 	eel_boolean_bit is_visible : 1;
 
+	/* Whether this item is visible or within the thumbnail prefetch
+	 * margin around the visible area. */
+	eel_boolean_bit is_near_viewport : 1;
+
 	/* Whether a monitor was set on this icon. */
 	eel_boolean_bit is_monitored : 1;
 
@@ -40,6 +40,7 @@ static GDebugKey keys[] = {
   { "Application", NAUTILUS_DEBUG_APPLICATION },
   { "Bookmarks", NAUTILUS_DEBUG_BOOKMARKS },
   { "DBus", NAUTILUS_DEBUG_DBUS },
+  { "DeepCount", NAUTILUS_DEBUG_DEEP_COUNT },
   { "DirectoryView", NAUTILUS_DEBUG_DIRECTORY_VIEW },
   { "File", NAUTILUS_DEBUG_FILE },
   { "CanvasContainer", NAUTILUS_DEBUG_CANVAS_CONTAINER },
@@ -51,6 +52,7 @@ static GDebugKey keys[] = {
   { "Search", NAUTILUS_DEBUG_SEARCH },
   { "SearchHit", NAUTILUS_DEBUG_SEARCH_HIT },
   { "Smclient", NAUTILUS_DEBUG_SMCLIENT },
+  { "Thumbnails", NAUTILUS_DEBUG_THUMBNAILS },
   { "Window", NAUTILUS_DEBUG_WINDOW },
   { "Undo", NAUTILUS_DEBUG_UNDO },
   { 0, }
@@ -0,0 +1,463 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-deep-count-cache.c: Persistent cache of directory deep counts.
+ 
+   Copyright (C) 2014 Endless Mobile, Inc.
+  
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+  
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+  
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include <string.h>
+#include <eel/eel-debug.h>
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_DEEP_COUNT
+#include "nautilus-debug.h"
+
+#define CACHE_FILE_NAME "deep-counts"
+
+/* device, inode, show hidden files, mtime, directory count, file count,
+ * size, time the entry was recorded, path */
+#define CACHE_ENTRY_FORMAT "(tttbuuxxs)"
+#define CACHE_FORMAT "a" CACHE_ENTRY_FORMAT
+
+/* Entries older than this are not trusted anymore, since changes made
+ * by other programs while nobody was monitoring the tree, files growing
+ * in place among them, are not seen otherwise. */
+#define CACHE_MAX_AGE_USEC (G_GINT64_CONSTANT (1) * 60 * 60 * G_USEC_PER_SEC)
+
+#define CACHE_MAX_ENTRIES 100000
+
+#define CACHE_SAVE_DELAY_SECS 10
+
+typedef struct {
+	guint64 device;
+	guint64 inode;
+	gboolean show_hidden_files;
+	guint64 mtime;
+	NautilusDeepCounts counts;
+	gint64 stamp;
+	char *path;
+} CacheEntry;
+
+/* Lock cache_mutex when accessing the fields below */
+static GMutex cache_mutex;
+static gboolean cache_loaded = FALSE;
+static gboolean cache_dirty = FALSE;
+/* The set of entries, by device, inode and show hidden files */
+static GHashTable *cache_entries = NULL;
+/* Path -> list of entries, used for invalidation */
+static GHashTable *cache_paths = NULL;
+static guint64 cache_hits = 0;
+static guint64 cache_misses = 0;
+static guint64 cache_invalidations = 0;
+
+static guint save_timeout_id = 0;
+
+/* Held for a whole save, so that an older snapshot never lands last */
+static GMutex save_mutex;
+
+static guint
+cache_entry_hash (gconstpointer data)
+{
+	const CacheEntry *entry = data;
+
+	return (guint) (entry->inode ^ (entry->inode >> 32)) ^
+		((guint) entry->device * 31) ^
+		(guint) entry->show_hidden_files;
+}
+
+static gboolean
+cache_entry_equal (gconstpointer a,
+		   gconstpointer b)
+{
+	const CacheEntry *entry_a = a;
+	const CacheEntry *entry_b = b;
+
+	return entry_a->inode == entry_b->inode &&
+		entry_a->device == entry_b->device &&
+		entry_a->show_hidden_files == entry_b->show_hidden_files;
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_free (entry->path);
+	g_slice_free (CacheEntry, entry);
+}
+
+static char *
+get_cache_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "nautilus", CACHE_FILE_NAME, NULL);
+}
+
+/* Lock cache_mutex when calling this. */
+static void
+remove_entry (CacheEntry *entry)
+{
+	GList *list;
+
+	list = g_hash_table_lookup (cache_paths, entry->path);
+	list = g_list_remove (list, entry);
+	if (list == NULL) {
+		g_hash_table_remove (cache_paths, entry->path);
+	} else {
+		g_hash_table_insert (cache_paths, g_strdup (entry->path), list);
+	}
+
+	g_hash_table_remove (cache_entries, entry);
+	cache_dirty = TRUE;
+}
+
+/* Lock cache_mutex when calling this. Takes ownership of entry. */
+static void
+add_entry (CacheEntry *entry)
+{
+	CacheEntry *old_entry;
+	GHashTableIter iter;
+	GList *list;
+
+	old_entry = g_hash_table_lookup (cache_entries, entry);
+	if (old_entry != NULL) {
+		remove_entry (old_entry);
+	}
+
+	/* Make room by dropping an arbitrary entry */
+	if (g_hash_table_size (cache_entries) >= CACHE_MAX_ENTRIES) {
+		g_hash_table_iter_init (&iter, cache_entries);
+		if (g_hash_table_iter_next (&iter, (gpointer *) &old_entry, NULL)) {
+			remove_entry (old_entry);
+		}
+	}
+
+	g_hash_table_add (cache_entries, entry);
+
+	list = g_hash_table_lookup (cache_paths, entry->path);
+	g_hash_table_insert (cache_paths, g_strdup (entry->path),
+			     g_list_prepend (list, entry));
+	cache_dirty = TRUE;
+}
+
+static void
+free_cache (void)
+{
+	GHashTableIter iter;
+	GList *list;
+
+	g_hash_table_iter_init (&iter, cache_paths);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+		g_list_free (list);
+	}
+	g_hash_table_destroy (cache_paths);
+	cache_paths = NULL;
+	g_hash_table_destroy (cache_entries);
+	cache_entries = NULL;
+	cache_loaded = FALSE;
+}
+
+static void
+save_cache (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	CacheEntry *entry;
+	GVariant *variant;
+	char *filename, *dirname;
+	GError *error;
+
+	g_mutex_lock (&save_mutex);
+	g_mutex_lock (&cache_mutex);
+
+	if (!cache_loaded || !cache_dirty) {
+		g_mutex_unlock (&cache_mutex);
+		g_mutex_unlock (&save_mutex);
+		return;
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (CACHE_FORMAT));
+	g_hash_table_iter_init (&iter, cache_entries);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL)) {
+		g_variant_builder_add (&builder, CACHE_ENTRY_FORMAT,
+				       entry->device,
+				       entry->inode,
+				       entry->mtime,
+				       entry->show_hidden_files,
+				       entry->counts.directory_count,
+				       entry->counts.file_count,
+				       (gint64) entry->counts.size,
+				       entry->stamp,
+				       entry->path);
+	}
+	cache_dirty = FALSE;
+
+	DEBUG ("Saving %u deep counts, %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+	       " misses, %" G_GUINT64_FORMAT " invalidations",
+	       g_hash_table_size (cache_entries),
+	       cache_hits, cache_misses, cache_invalidations);
+
+	g_mutex_unlock (&cache_mutex);
+
+	variant = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+	filename = get_cache_filename ();
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	error = NULL;
+	if (!g_file_set_contents (filename,
+				  g_variant_get_data (variant),
+				  g_variant_get_size (variant),
+				  &error)) {
+		g_warning ("Unable to save the deep count cache: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (variant);
+
+	g_mutex_unlock (&save_mutex);
+}
+
+static gpointer
+save_thread_func (gpointer user_data)
+{
+	save_cache ();
+
+	return NULL;
+}
+
+static void
+shutdown_cache (void)
+{
+	if (save_timeout_id != 0) {
+		g_source_remove (save_timeout_id);
+		save_timeout_id = 0;
+	}
+
+	save_cache ();
+
+	g_mutex_lock (&cache_mutex);
+	free_cache ();
+	g_mutex_unlock (&cache_mutex);
+}
+
+/* Lock cache_mutex when calling this. */
+static void
+ensure_cache_loaded (void)
+{
+	char *filename, *contents, *path;
+	gsize length;
+	GVariant *variant;
+	GVariantIter iter;
+	CacheEntry *entry;
+	gint64 size;
+
+	if (cache_loaded) {
+		return;
+	}
+
+	cache_loaded = TRUE;
+	cache_entries = g_hash_table_new_full (cache_entry_hash, cache_entry_equal,
+					       (GDestroyNotify) cache_entry_free, NULL);
+	/* The lists are replaced in place, so they are freed by hand */
+	cache_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, NULL);
+
+	filename = get_cache_filename ();
+	if (g_file_get_contents (filename, &contents, &length, NULL)) {
+		variant = g_variant_new_from_data (G_VARIANT_TYPE (CACHE_FORMAT),
+						   contents, length, FALSE,
+						   g_free, contents);
+		g_variant_ref_sink (variant);
+
+		g_variant_iter_init (&iter, variant);
+		entry = g_slice_new0 (CacheEntry);
+		while (g_variant_iter_next (&iter, CACHE_ENTRY_FORMAT,
+					    &entry->device,
+					    &entry->inode,
+					    &entry->mtime,
+					    &entry->show_hidden_files,
+					    &entry->counts.directory_count,
+					    &entry->counts.file_count,
+					    &size,
+					    &entry->stamp,
+					    &path)) {
+			entry->counts.size = size;
+			entry->path = path;
+			add_entry (entry);
+			entry = g_slice_new0 (CacheEntry);
+		}
+		g_slice_free (CacheEntry, entry);
+
+		g_variant_unref (variant);
+	}
+	g_free (filename);
+
+	cache_dirty = FALSE;
+
+	DEBUG ("Loaded %u deep counts", g_hash_table_size (cache_entries));
+}
+
+gboolean
+nautilus_deep_count_cache_lookup (guint64 device,
+				  guint64 inode,
+				  guint64 mtime,
+				  gboolean show_hidden_files,
+				  NautilusDeepCounts *counts)
+{
+	CacheEntry key, *entry;
+	gboolean found;
+
+	g_return_val_if_fail (counts != NULL, FALSE);
+
+	if (inode == 0) {
+		return FALSE;
+	}
+
+	key.device = device;
+	key.inode = inode;
+	key.show_hidden_files = show_hidden_files;
+
+	g_mutex_lock (&cache_mutex);
+
+	ensure_cache_loaded ();
+
+	found = FALSE;
+	entry = g_hash_table_lookup (cache_entries, &key);
+	if (entry != NULL) {
+		if (entry->mtime == mtime &&
+		    g_get_real_time () - entry->stamp < CACHE_MAX_AGE_USEC) {
+			*counts = entry->counts;
+			found = TRUE;
+		} else {
+			remove_entry (entry);
+		}
+	}
+
+	if (found) {
+		cache_hits++;
+	} else {
+		cache_misses++;
+	}
+
+	g_mutex_unlock (&cache_mutex);
+
+	return found;
+}
+
+void
+nautilus_deep_count_cache_insert (guint64 device,
+				  guint64 inode,
+				  guint64 mtime,
+				  gboolean show_hidden_files,
+				  const char *path,
+				  const NautilusDeepCounts *counts)
+{
+	CacheEntry *entry;
+
+	g_return_if_fail (path != NULL);
+	g_return_if_fail (counts != NULL);
+
+	if (inode == 0) {
+		return;
+	}
+
+	entry = g_slice_new0 (CacheEntry);
+	entry->device = device;
+	entry->inode = inode;
+	entry->show_hidden_files = show_hidden_files;
+	entry->mtime = mtime;
+	entry->counts = *counts;
+	entry->stamp = g_get_real_time ();
+	entry->path = g_strdup (path);
+
+	g_mutex_lock (&cache_mutex);
+	ensure_cache_loaded ();
+	add_entry (entry);
+	g_mutex_unlock (&cache_mutex);
+}
+
+void
+nautilus_deep_count_cache_invalidate (GFile *location)
+{
+	char *path, *slash;
+	GList *list;
+
+	path = g_file_get_path (location);
+	if (path == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&cache_mutex);
+
+	if (cache_loaded && g_hash_table_size (cache_paths) > 0) {
+		/* Walk up to the root, dropping the counts of every
+		 * directory on the way. */
+		do {
+			while ((list = g_hash_table_lookup (cache_paths, path)) != NULL) {
+				remove_entry (list->data);
+				cache_invalidations++;
+			}
+
+			slash = strrchr (path, '/');
+			if (slash == path) {
+				slash[1] = '\0';
+			} else if (slash != NULL) {
+				*slash = '\0';
+			}
+		} while (slash != NULL && strcmp (path, "/") != 0);
+
+		while ((list = g_hash_table_lookup (cache_paths, "/")) != NULL) {
+			remove_entry (list->data);
+			cache_invalidations++;
+		}
+	}
+
+	g_mutex_unlock (&cache_mutex);
+
+	g_free (path);
+}
+
+static gboolean
+save_timeout_cb (gpointer user_data)
+{
+	save_timeout_id = 0;
+
+	/* Writing the cache takes a while with many entries */
+	g_thread_unref (g_thread_new ("nautilus-deep-count-save", save_thread_func, NULL));
+
+	return FALSE;
+}
+
+void
+nautilus_deep_count_cache_schedule_save (void)
+{
+	static gboolean shutdown_registered = FALSE;
+
+	if (!shutdown_registered) {
+		eel_debug_call_at_shutdown (shutdown_cache);
+		shutdown_registered = TRUE;
+	}
+
+	if (save_timeout_id == 0) {
+		save_timeout_id = g_timeout_add_seconds (CACHE_SAVE_DELAY_SECS,
+							 save_timeout_cb, NULL);
+	}
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-deep-count-cache.h: Persistent cache of directory deep counts.
+ 
+   Copyright (C) 2014 Endless Mobile, Inc.
+  
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+  
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+  
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef NAUTILUS_DEEP_COUNT_CACHE_H
+#define NAUTILUS_DEEP_COUNT_CACHE_H
+
+#include <gio/gio.h>
+
+/* Remembers the deep counts of local directories across sessions, so
+ * that subtrees that did not change don't have to be walked again.
+ * Entries are keyed by the device and inode of the directory and are
+ * only valid for the modification time they were recorded with. Changes
+ * deeper in the tree don't touch that time, so the directory monitors
+ * and the file change notifications of Nautilus's own operations also
+ * drop the entries of every ancestor of a changed file, and entries
+ * expire after a while in any case.
+ *
+ * The lookup and insert functions can be called from any thread.
+ */
+
+typedef struct {
+	guint directory_count;
+	guint file_count;
+	goffset size;
+} NautilusDeepCounts;
+
+gboolean nautilus_deep_count_cache_lookup        (guint64                   device,
+						  guint64                   inode,
+						  guint64                   mtime,
+						  gboolean                  show_hidden_files,
+						  NautilusDeepCounts       *counts);
+void     nautilus_deep_count_cache_insert        (guint64                   device,
+						  guint64                   inode,
+						  guint64                   mtime,
+						  gboolean                  show_hidden_files,
+						  const char               *path,
+						  const NautilusDeepCounts *counts);
+
+/* Forgets the counts of location and of all the directories above it. */
+void     nautilus_deep_count_cache_invalidate    (GFile                    *location);
+
+/* Writes the cache to disk a little later. Call from the main thread. */
+void     nautilus_deep_count_cache_schedule_save (void);
+
+#endif /* NAUTILUS_DEEP_COUNT_CACHE_H */
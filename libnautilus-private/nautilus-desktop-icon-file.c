@@ -166,6 +166,7 @@ update_info_from_link (NautilusDesktopIconFile *icon_file)
 	NautilusDesktopLink *link;
 	char *display_name;
 	GMount *mount;
+	NautilusFileExtraDetails *extra;
 	
 	file = NAUTILUS_FILE (icon_file);
 	
@@ -207,8 +208,9 @@ update_info_from_link (NautilusDesktopIconFile *icon_file)
 		g_object_unref (file->details->icon);
 	}
 	file->details->icon = nautilus_desktop_link_get_icon (link);
-	g_free (file->details->activation_uri);
-	file->details->activation_uri = nautilus_desktop_link_get_activation_uri (link);
+	extra = nautilus_file_ensure_extra_details (file);
+	g_free (extra->activation_uri);
+	extra->activation_uri = nautilus_desktop_link_get_activation_uri (link);
 	file->details->got_link_info = TRUE;
 	file->details->link_info_is_up_to_date = TRUE;
 
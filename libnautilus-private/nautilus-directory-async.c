@@ -25,6 +25,7 @@
 #include <config.h>
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-private.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
@@ -33,11 +34,14 @@
 #include "nautilus-global-preferences.h"
 #include "nautilus-link.h"
 #include "nautilus-profile.h"
+#include "nautilus-thumbnail-cache.h"
+#include "nautilus-thumbnails.h"
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -128,14 +132,23 @@ struct DirectoryCountState {
 	int file_count;
 };
 
+typedef struct DeepCountNode DeepCountNode;
+
 struct DeepCountState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
-	GFileEnumerator *enumerator;
-	GFile *deep_count_location;
-	GList *deep_count_subdirectories;
-	GArray *seen_deep_count_inodes;
 	char *fs_id;
+	gboolean show_hidden_files;
+	/* Whether subtree totals can be looked up in and added to the
+	 * deep count cache, i.e. whether the tree is local */
+	gboolean use_cache;
+	guint progress_id;
+
+	/* Lock when accessing the fields below */
+	GMutex lock;
+	GHashTable *seen_deep_count_inodes;
+	NautilusDeepCounts counts;
+	guint unreadable_count;
 };
 
 
@@ -180,8 +193,6 @@ static GHashTable *async_jobs;
 #endif
 
 /* Forward declarations for functions that need them. */
-static void     deep_count_load                               (DeepCountState         *state,
-							       GFile                  *location);
 static gboolean request_is_satisfied                          (NautilusDirectory      *directory,
 							       NautilusFile           *file,
 							       Request                 request);
@@ -491,6 +502,11 @@ deep_count_cancel (NautilusDirectory *directory)
 		
 		g_cancellable_cancel (directory->details->deep_count_in_progress->cancellable);
 
+		if (directory->details->deep_count_in_progress->progress_id != 0) {
+			g_source_remove (directory->details->deep_count_in_progress->progress_id);
+			directory->details->deep_count_in_progress->progress_id = 0;
+		}
+
 		directory->details->deep_count_file->details->deep_counts_status = NAUTILUS_REQUEST_NOT_STARTED;
 
 		directory->details->deep_count_in_progress->directory = NULL;
@@ -832,7 +848,7 @@ show_hidden_files_changed_callback (gpointer callback_data)
 }
 
 static gboolean
-should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+get_show_hidden_files (void)
 {
 	static gboolean show_hidden_files_changed_callback_installed = FALSE;
 
@@ -849,7 +865,13 @@ should_skip_file (NautilusDirectory *directory, GFileInfo *info)
 		show_hidden_files_changed_callback (NULL);
 	}
 
-	if (!show_hidden_files &&
+	return show_hidden_files;
+}
+
+static gboolean
+should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+{
+	if (!get_show_hidden_files () &&
 	    (g_file_info_get_is_hidden (info) ||
 	     g_file_info_get_is_backup (info))) {
 		return TRUE;
@@ -869,6 +891,7 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	GFileInfo *file_info;
 	const char *mimetype, *name;
 	DirectoryLoadState *dir_load_state;
+	NautilusFileFolderDetails *folder;
 
 	directory = NAUTILUS_DIRECTORY (callback_data);
 
@@ -984,8 +1007,9 @@ dequeue_pending_idle_callback (gpointer callback_data)
 
 			file->details->got_mime_list = TRUE;
 			file->details->mime_list_is_up_to_date = TRUE;
-			g_list_free_full (file->details->mime_list, g_free);
-			file->details->mime_list = istr_set_get_as_list
+			folder = nautilus_file_ensure_folder_details (file);
+			g_list_free_full (folder->mime_list, g_free);
+			folder->mime_list = istr_set_get_as_list
 				(dir_load_state->load_mime_list_hash);
 
 			nautilus_file_changed (file);
@@ -993,6 +1017,8 @@ dequeue_pending_idle_callback (gpointer callback_data)
 		
 		nautilus_directory_async_state_changed (directory);
 
+		nautilus_file_dump_memory_usage ();
+
 		directory->details->directory_loaded_sent_notification = TRUE;
 	}
 
@@ -1133,6 +1159,16 @@ nautilus_directory_monitor_remove_internal (NautilusDirectory *directory,
 		directory->details->monitor = NULL;
 	}
 
+	/* Nobody is looking at this directory anymore, so don't keep
+	 * the thumbnail workers busy with it. */
+	if (directory->details->monitor_list == NULL) {
+		char *uri;
+
+		uri = nautilus_directory_get_uri (directory);
+		nautilus_thumbnail_remove_directory_from_queue (uri);
+		g_free (uri);
+	}
+
 	/* XXX - do we need to remove anything from the work queue? */
 
 	nautilus_directory_async_state_changed (directory);
@@ -2527,252 +2563,441 @@ directory_count_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
+/* Deep counts walk the tree on a thread pool shared by all directories,
+ * one task per subdirectory, so a big tree keeps every thread busy. Each
+ * directory is a DeepCountNode that adds its totals to its parent once
+ * all of its subdirectories are done, which gives the totals of every
+ * subtree for the deep count cache. The totals of the whole count are
+ * kept in the DeepCountState and published to the NautilusFile from the
+ * main thread.
+ */
+#define DEEP_COUNT_MAX_THREADS 16
+
+/* How often partial totals are published while counting, in milliseconds */
+#define DEEP_COUNT_PROGRESS_INTERVAL_MSEC 200
+
+#define DEEP_COUNT_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	G_FILE_ATTRIBUTE_ID_FILESYSTEM "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+	G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+	G_FILE_ATTRIBUTE_UNIX_INODE "," \
+	G_FILE_ATTRIBUTE_UNIX_NLINK
+
+struct DeepCountNode {
+	DeepCountState *state;
+	DeepCountNode *parent;
+	GFile *location;
+
+	/* Identity of the directory in the deep count cache */
+	guint64 device;
+	guint64 inode;
+	guint64 mtime;
+
+	/* This directory plus its subdirectories that are not done yet.
+	 * Use atomic operations. */
+	volatile gint n_pending;
+
+	/* Totals of the subtree. Lock state->lock when accessing these. */
+	NautilusDeepCounts counts;
+	guint unreadable_count;
+	/* Whether the totals depend on files seen elsewhere in the tree */
+	gboolean has_hard_links;
+};
+
+static GThreadPool *deep_count_pool = NULL;
+
+/* Lock state->lock when calling this. */
 static inline gboolean
 seen_inode (DeepCountState *state,
-	    GFileInfo *info)
+	    guint64 inode)
 {
-	guint64 inode, inode2;
-	guint i;
-
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	return inode != 0 &&
+		g_hash_table_contains (state->seen_deep_count_inodes, &inode);
+}
 
+/* Lock state->lock when calling this. */
+static inline void
+mark_inode_as_seen (DeepCountState *state,
+		    guint64 inode)
+{
 	if (inode != 0) {
-		for (i = 0; i < state->seen_deep_count_inodes->len; i++) {
-			inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-			if (inode == inode2) {
-				return TRUE;
-			}
-		}
+		g_hash_table_add (state->seen_deep_count_inodes,
+				  g_memdup (&inode, sizeof (guint64)));
 	}
+}
 
-	return FALSE;
+static guint64
+get_info_mtime_usec (GFileInfo *info)
+{
+	return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-		    GFileInfo *info)
+static DeepCountNode *
+deep_count_node_new (DeepCountState *state,
+		     DeepCountNode *parent,
+		     GFile *location,
+		     GFileInfo *info)
 {
-	guint64 inode;
+	DeepCountNode *node;
 
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-	if (inode != 0) {
-		g_array_append_val (state->seen_deep_count_inodes, inode);
-	}
+	node = g_slice_new0 (DeepCountNode);
+	node->state = state;
+	node->parent = parent;
+	node->location = g_object_ref (location);
+	node->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+	node->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	node->mtime = get_info_mtime_usec (info);
+	node->n_pending = 1;
+
+	return node;
+}
+
+static void
+deep_count_node_free (DeepCountNode *node)
+{
+	g_object_unref (node->location);
+	g_slice_free (DeepCountNode, node);
 }
 
+/* Called from a deep count thread for each child of a directory. Adds the
+ * child to the local totals of that directory, and queues it if it is a
+ * directory that needs to be counted too.
+ */
 static void
 deep_count_one (DeepCountState *state,
-		GFileInfo *info)
+		DeepCountNode *node,
+		GFileInfo *info,
+		NautilusDeepCounts *counts,
+		gboolean *has_hard_links)
 {
-	NautilusFile *file;
+	DeepCountNode *child;
 	GFile *subdir;
 	gboolean is_seen_inode;
 	const char *fs_id;
+	guint64 inode;
+	guint32 n_links;
+	NautilusDeepCounts cached_counts;
 
-	if (should_skip_file (NULL, info)) {
+	if (!state->show_hidden_files &&
+	    (g_file_info_get_is_hidden (info) ||
+	     g_file_info_get_is_backup (info))) {
 		return;
 	}
 
-	is_seen_inode = seen_inode (state, info);
-	if (!is_seen_inode) {
-		mark_inode_as_seen (state, info);
-	}
-
-	file = state->directory->details->deep_count_file;
-
 	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 		/* Count the directory. */
-		file->details->deep_directory_count += 1;
+		counts->directory_count += 1;
 
 		/* Record the fact that we have to descend into this directory. */
 		fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-		if (g_strcmp0 (fs_id, state->fs_id) == 0) {
+		if (g_strcmp0 (fs_id, state->fs_id) != 0) {
 			/* only if it is on the same filesystem */
-			subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-			state->deep_count_subdirectories = g_list_prepend
-				(state->deep_count_subdirectories, subdir);
+		} else if (state->use_cache &&
+			   nautilus_deep_count_cache_lookup (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+							     g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE),
+							     get_info_mtime_usec (info),
+							     state->show_hidden_files,
+							     &cached_counts)) {
+			/* Unchanged since it was last counted */
+			counts->directory_count += cached_counts.directory_count;
+			counts->file_count += cached_counts.file_count;
+			counts->size += cached_counts.size;
+		} else {
+			subdir = g_file_get_child (node->location, g_file_info_get_name (info));
+			child = deep_count_node_new (state, node, subdir, info);
+			g_object_unref (subdir);
+
+			g_atomic_int_inc (&node->n_pending);
+			g_thread_pool_push (deep_count_pool, child, NULL);
 		}
 	} else {
 		/* Even non-regular files count as files. */
-		file->details->deep_file_count += 1;
+		counts->file_count += 1;
+	}
+
+	if (!g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
+		return;
+	}
+
+	/* Only files with several links can be seen twice, so the others
+	 * don't need to go through the shared inode table. */
+	n_links = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK);
+	if (n_links == 1 ||
+	    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		is_seen_inode = FALSE;
+	} else {
+		*has_hard_links = TRUE;
+		inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+
+		g_mutex_lock (&state->lock);
+		is_seen_inode = seen_inode (state, inode);
+		if (!is_seen_inode) {
+			mark_inode_as_seen (state, inode);
+		}
+		g_mutex_unlock (&state->lock);
 	}
 
 	/* Count the size. */
-	if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
-		file->details->deep_size += g_file_info_get_size (info);
+	if (!is_seen_inode) {
+		counts->size += g_file_info_get_size (info);
 	}
 }
 
+static gboolean deep_count_done (gpointer user_data);
+
+/* Marks one more pending directory of node as done, and when that was
+ * the last one, hands the totals of node up to its parent. */
 static void
-deep_count_state_free (DeepCountState *state)
+deep_count_node_finish (DeepCountState *state,
+			DeepCountNode *node)
+{
+	DeepCountNode *parent;
+	char *path;
+
+	while (node != NULL && g_atomic_int_dec_and_test (&node->n_pending)) {
+		parent = node->parent;
+
+		g_mutex_lock (&state->lock);
+		if (parent != NULL) {
+			parent->counts.directory_count += node->counts.directory_count;
+			parent->counts.file_count += node->counts.file_count;
+			parent->counts.size += node->counts.size;
+			parent->unreadable_count += node->unreadable_count;
+			parent->has_hard_links |= node->has_hard_links;
+		}
+		g_mutex_unlock (&state->lock);
+
+		/* Counts that skipped unreadable directories, or that depend
+		 * on which hard link was seen first, are not worth keeping. */
+		if (state->use_cache &&
+		    node->unreadable_count == 0 &&
+		    !node->has_hard_links &&
+		    !g_cancellable_is_cancelled (state->cancellable)) {
+			path = g_file_get_path (node->location);
+			if (path != NULL) {
+				nautilus_deep_count_cache_insert (node->device,
+								  node->inode,
+								  node->mtime,
+								  state->show_hidden_files,
+								  path,
+								  &node->counts);
+				g_free (path);
+			}
+		}
+
+		deep_count_node_free (node);
+
+		if (parent == NULL) {
+			g_idle_add (deep_count_done, state);
+		}
+
+		node = parent;
+	}
+}
+
+static void
+deep_count_thread_func (gpointer data,
+			gpointer user_data)
 {
-	if (state->enumerator) {
-		if (!g_file_enumerator_is_closed (state->enumerator)) {
-			g_file_enumerator_close_async (state->enumerator,
-						       0, NULL, NULL, NULL);
+	DeepCountNode *node;
+	DeepCountState *state;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	NautilusDeepCounts counts;
+	gboolean has_hard_links;
+	GError *error;
+
+	node = data;
+	state = node->state;
+
+	memset (&counts, 0, sizeof (counts));
+	has_hard_links = FALSE;
+
+	enumerator = NULL;
+	if (!g_cancellable_is_cancelled (state->cancellable)) {
+		enumerator = g_file_enumerate_children (node->location,
+							DEEP_COUNT_ATTRIBUTES,
+							G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+							state->cancellable,
+							NULL);
+
+		if (enumerator == NULL) {
+			g_mutex_lock (&state->lock);
+			node->unreadable_count += 1;
+			state->unreadable_count += 1;
+			g_mutex_unlock (&state->lock);
 		}
-		g_object_unref (state->enumerator);
 	}
-	g_object_unref (state->cancellable);
-	if (state->deep_count_location) {
-		g_object_unref (state->deep_count_location);
+
+	if (enumerator != NULL) {
+		error = NULL;
+		while ((info = g_file_enumerator_next_file (enumerator, state->cancellable, &error)) != NULL) {
+			deep_count_one (state, node, info, &counts, &has_hard_links);
+			g_object_unref (info);
+		}
+
+		g_file_enumerator_close (enumerator, NULL, NULL);
+		g_object_unref (enumerator);
+
+		g_mutex_lock (&state->lock);
+		/* A folder that could only be read in part counts as
+		 * unreadable, so that its partial counts are not cached */
+		if (error != NULL &&
+		    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			node->unreadable_count += 1;
+			state->unreadable_count += 1;
+		}
+		node->counts.directory_count += counts.directory_count;
+		node->counts.file_count += counts.file_count;
+		node->counts.size += counts.size;
+		node->has_hard_links |= has_hard_links;
+		state->counts.directory_count += counts.directory_count;
+		state->counts.file_count += counts.file_count;
+		state->counts.size += counts.size;
+		g_mutex_unlock (&state->lock);
+
+		g_clear_error (&error);
 	}
-	g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-	g_array_free (state->seen_deep_count_inodes, TRUE);
+
+	deep_count_node_finish (state, node);
+}
+
+static void
+deep_count_state_free (DeepCountState *state)
+{
+	g_assert (state->progress_id == 0);
+
+	g_object_unref (state->cancellable);
+	g_hash_table_destroy (state->seen_deep_count_inodes);
+	g_mutex_clear (&state->lock);
 	g_free (state->fs_id);
 	g_free (state);
 }
 
 static void
-deep_count_next_dir (DeepCountState *state)
+deep_count_publish (DeepCountState *state,
+		    NautilusFile *file)
 {
-	GFile *location;
+	NautilusFileFolderDetails *folder;
+
+	folder = nautilus_file_ensure_folder_details (file);
+
+	g_mutex_lock (&state->lock);
+	folder->deep_directory_count = state->counts.directory_count;
+	folder->deep_file_count = state->counts.file_count;
+	folder->deep_unreadable_count = state->unreadable_count;
+	folder->deep_size = state->counts.size;
+	g_mutex_unlock (&state->lock);
+}
+
+static gboolean
+deep_count_progress (gpointer user_data)
+{
+	DeepCountState *state;
 	NautilusFile *file;
-	NautilusDirectory *directory;
-	gboolean done;
 
-	directory = state->directory;
-	
-	g_object_unref (state->deep_count_location);
-	state->deep_count_location = NULL;
+	state = user_data;
 
-	done = FALSE;
-	file = directory->details->deep_count_file;
-	
-	if (state->deep_count_subdirectories != NULL) {
-		/* Work on a new directory. */
-		location = state->deep_count_subdirectories->data;
-		state->deep_count_subdirectories = g_list_remove
-			(state->deep_count_subdirectories, location);
-		deep_count_load (state, location);
-		g_object_unref (location);
-	} else {
-		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
-		directory->details->deep_count_file = NULL;
-		directory->details->deep_count_in_progress = NULL;
-		deep_count_state_free (state);
-		done = TRUE;
-	}
-	
-	nautilus_file_updated_deep_count_in_progress (file);
+	g_assert (state->directory != NULL);
 
-	if (done) {
-		nautilus_file_changed (file);
-		async_job_end (directory, "deep count");
-		nautilus_directory_async_state_changed (directory);
+	file = state->directory->details->deep_count_file;
+	if (file != NULL) {
+		deep_count_publish (state, file);
+		nautilus_file_updated_deep_count_in_progress (file);
 	}
+
+	return TRUE;
 }
 
-static void
-deep_count_more_files_callback (GObject *source_object,
-				GAsyncResult *res,
-				gpointer user_data)
+/* Called in the main loop once the last directory has been counted. */
+static gboolean
+deep_count_done (gpointer user_data)
 {
 	DeepCountState *state;
 	NautilusDirectory *directory;
-	GList *files, *l;
-	GFileInfo *info;
+	NautilusFile *file;
 
 	state = user_data;
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
 		deep_count_state_free (state);
-		return;
+		return FALSE;
 	}
 
 	directory = nautilus_directory_ref (state->directory);
-	
-	g_assert (directory->details->deep_count_in_progress != NULL);
+
 	g_assert (directory->details->deep_count_in_progress == state);
 
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, NULL);
+	if (state->progress_id != 0) {
+		g_source_remove (state->progress_id);
+		state->progress_id = 0;
+	}
 
-	for (l = files; l != NULL; l = l->next)	{
-		info = l->data;
-		deep_count_one (state, info);
-		g_object_unref (info);
+	if (state->use_cache) {
+		nautilus_deep_count_cache_schedule_save ();
 	}
-	
-	if (files == NULL) {
-		g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-		g_object_unref (state->enumerator);
-		state->enumerator = NULL;
-		
-		deep_count_next_dir (state);
-	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+
+	file = directory->details->deep_count_file;
+	directory->details->deep_count_file = NULL;
+	directory->details->deep_count_in_progress = NULL;
+
+	if (file != NULL) {
+		deep_count_publish (state, file);
+		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
+		nautilus_file_updated_deep_count_in_progress (file);
+		nautilus_file_changed (file);
 	}
 
-	g_list_free (files);
+	deep_count_state_free (state);
+
+	async_job_end (directory, "deep count");
+	nautilus_directory_async_state_changed (directory);
 
 	nautilus_directory_unref (directory);
+
+	return FALSE;
 }
 
 static void
-deep_count_callback (GObject *source_object,
-		     GAsyncResult *res,
-		     gpointer user_data)
+deep_count_load (DeepCountState *state,
+		 GFile *location,
+		 GFileInfo *info)
 {
-	DeepCountState *state;
-	GFileEnumerator *enumerator;
-	NautilusFile *file;
+	DeepCountNode *root;
 
-	state = user_data;
-
-	if (state->directory == NULL) {
-		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+#ifdef DEBUG_LOAD_DIRECTORY		
+	g_message ("load_directory called to get deep file count for %p", location);
+#endif	
+	/* An unchanged tree can be answered right away */
+	if (state->use_cache &&
+	    nautilus_deep_count_cache_lookup (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+					      g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE),
+					      get_info_mtime_usec (info),
+					      state->show_hidden_files,
+					      &state->counts)) {
+		g_idle_add (deep_count_done, state);
 		return;
 	}
 
-	file = state->directory->details->deep_count_file;
-
-	enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),	res, NULL);
-	
-	if (enumerator == NULL) {
-		file->details->deep_unreadable_count += 1;
-		
-		deep_count_next_dir (state);
-	} else {
-		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+	if (deep_count_pool == NULL) {
+		deep_count_pool = g_thread_pool_new (deep_count_thread_func, NULL,
+						     CLAMP (g_get_num_processors (), 2, DEEP_COUNT_MAX_THREADS),
+						     FALSE, NULL);
 	}
-}
 
+	state->progress_id = g_timeout_add (DEEP_COUNT_PROGRESS_INTERVAL_MSEC,
+					    deep_count_progress, state);
 
-static void
-deep_count_load (DeepCountState *state, GFile *location)
-{
-	state->deep_count_location = g_object_ref (location);
-
-#ifdef DEBUG_LOAD_DIRECTORY		
-	g_message ("load_directory called to get deep file count for %p", location);
-#endif	
-	g_file_enumerate_children_async (state->deep_count_location,
-					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
-					 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-					 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
-					 G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-					 G_FILE_ATTRIBUTE_UNIX_INODE,
-					 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, /* flags */
-					 G_PRIORITY_LOW, /* prio */
-					 state->cancellable,
-					 deep_count_callback,
-					 state);
+	root = deep_count_node_new (state, NULL, location, info);
+	g_thread_pool_push (deep_count_pool, root, NULL);
 }
 
 static void
@@ -2811,9 +3036,18 @@ deep_count_got_info (GObject *source_object,
 	if (info != NULL) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
 		state->fs_id = g_strdup (id);
-		g_object_unref (info);
+	} else {
+		info = g_file_info_new ();
+	}
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deep_count_state_free (state);
+	} else {
+		deep_count_load (state, file, info);
 	}
-	deep_count_load (state, file);
+
+	g_object_unref (info);
 }
 
 static void
@@ -2823,6 +3057,7 @@ deep_count_start (NautilusDirectory *directory,
 {
 	GFile *location;
 	DeepCountState *state;
+	NautilusFileFolderDetails *folder;
 	
 	if (directory->details->deep_count_in_progress != NULL) {
 		*doing_io = TRUE;
@@ -2849,23 +3084,32 @@ deep_count_start (NautilusDirectory *directory,
 
 	/* Start counting. */
 	file->details->deep_counts_status = NAUTILUS_REQUEST_IN_PROGRESS;
-	file->details->deep_directory_count = 0;
-	file->details->deep_file_count = 0;
-	file->details->deep_unreadable_count = 0;
-	file->details->deep_size = 0;
+	folder = nautilus_file_ensure_folder_details (file);
+	folder->deep_directory_count = 0;
+	folder->deep_file_count = 0;
+	folder->deep_unreadable_count = 0;
+	folder->deep_size = 0;
 	directory->details->deep_count_file = file;
 
 	state = g_new0 (DeepCountState, 1);
 	state->directory = directory;
 	state->cancellable = g_cancellable_new ();
-	state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+	state->show_hidden_files = get_show_hidden_files ();
+	g_mutex_init (&state->lock);
+	state->seen_deep_count_inodes = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+							       g_free, NULL);
 	state->fs_id = NULL;
 
 	directory->details->deep_count_in_progress = state;
 	
 	location = nautilus_file_get_location (file);
+	state->use_cache = g_file_is_native (location);
 	g_file_query_info_async (location,
-				 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				 G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				 G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+				 G_FILE_ATTRIBUTE_UNIX_INODE,
 				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 				 G_PRIORITY_DEFAULT,
 				 NULL,
@@ -2918,6 +3162,7 @@ mime_list_done (MimeListState *state, gboolean success)
 {
 	NautilusFile *file;
 	NautilusDirectory *directory;
+	NautilusFileFolderDetails *folder;
 
 	directory = state->directory;
 	g_assert (directory != NULL);
@@ -2925,13 +3170,14 @@ mime_list_done (MimeListState *state, gboolean success)
 	file = state->mime_list_file;
 	
 	file->details->mime_list_is_up_to_date = TRUE;
-	g_list_free_full (file->details->mime_list, g_free);
+	folder = nautilus_file_ensure_folder_details (file);
+	g_list_free_full (folder->mime_list, g_free);
 	if (success) {
 		file->details->mime_list_failed = TRUE;
-		file->details->mime_list = NULL;
+		folder->mime_list = NULL;
 	} else {
 		file->details->got_mime_list = TRUE;
-		file->details->mime_list = istr_set_get_as_list	(state->mime_list_hash);
+		folder->mime_list = istr_set_get_as_list	(state->mime_list_hash);
 	}
 	directory->details->mime_list_in_progress = NULL;
 
@@ -3090,7 +3336,10 @@ mime_list_start (NautilusDirectory *directory,
 	*doing_io = TRUE;
 
 	if (!nautilus_file_is_directory (file)) {
-		g_list_free (file->details->mime_list);
+		if (file->details->folder != NULL) {
+			g_list_free_full (file->details->folder->mime_list, g_free);
+			file->details->folder->mime_list = NULL;
+		}
 		file->details->mime_list_failed = FALSE;
 		file->details->got_mime_list = FALSE;
 		file->details->mime_list_is_up_to_date = TRUE;
@@ -3172,6 +3421,7 @@ top_left_read_callback (GObject *source_object,
 	TopLeftTextReadState *state;
 	NautilusDirectory *directory;
 	NautilusFileDetails *file_details;
+	NautilusFileExtraDetails *extra;
 	gsize file_size;
 	char *file_contents;
 
@@ -3188,18 +3438,19 @@ top_left_read_callback (GObject *source_object,
 	file_details = state->file->details;
 
 	file_details->top_left_text_is_up_to_date = TRUE;
-	g_free (file_details->top_left_text);
+	extra = nautilus_file_ensure_extra_details (state->file);
+	g_free (extra->top_left_text);
 
 	if (g_file_load_partial_contents_finish (G_FILE (source_object),
 						 res,
 						 &file_contents, &file_size,
 						 NULL, NULL)) {
-		file_details->top_left_text = nautilus_extract_top_left_text (file_contents, state->large, file_size);
+		extra->top_left_text = nautilus_extract_top_left_text (file_contents, state->large, file_size);
 		file_details->got_top_left_text = TRUE;
 		file_details->got_large_top_left_text = state->large;
 		g_free (file_contents);
 	} else {
-		file_details->top_left_text = NULL;
+		extra->top_left_text = NULL;
 		file_details->got_top_left_text = FALSE;
 		file_details->got_large_top_left_text = FALSE;
 	}
@@ -3279,8 +3530,10 @@ top_left_start (NautilusDirectory *directory,
 	*doing_io = TRUE;
 
 	if (!nautilus_file_contains_text (file)) {
-		g_free (file->details->top_left_text);
-		file->details->top_left_text = NULL;
+		if (file->details->extra != NULL) {
+			g_free (file->details->extra->top_left_text);
+			file->details->extra->top_left_text = NULL;
+		}
 		file->details->got_top_left_text = FALSE;
 		file->details->got_large_top_left_text = FALSE;
 		file->details->top_left_text_is_up_to_date = TRUE;
@@ -3481,6 +3734,7 @@ link_info_done (NautilusDirectory *directory,
 		gboolean is_foreign)
 {
 	gboolean is_trusted;
+	NautilusFileExtraDetails *extra;
 	
 	file->details->link_info_is_up_to_date = TRUE;
 
@@ -3493,16 +3747,19 @@ link_info_done (NautilusDirectory *directory,
 	}
 	
 	file->details->got_link_info = TRUE;
-	g_clear_object (&file->details->custom_icon);
+	if (file->details->extra != NULL) {
+		g_clear_object (&file->details->extra->custom_icon);
+	}
 
 	if (uri) {
-		g_free (file->details->activation_uri);
-		file->details->activation_uri = NULL;
+		extra = nautilus_file_ensure_extra_details (file);
+		g_free (extra->activation_uri);
+		extra->activation_uri = NULL;
 		file->details->got_custom_activation_uri = TRUE;
-		file->details->activation_uri = g_strdup (uri);
+		extra->activation_uri = g_strdup (uri);
 	}
 	if (is_trusted && (icon != NULL)) {
-		file->details->custom_icon = g_object_ref (icon);
+		nautilus_file_ensure_extra_details (file)->custom_icon = g_object_ref (icon);
 	}
 	file->details->is_launcher = is_launcher;
 	file->details->is_foreign_link = is_foreign;
@@ -3675,14 +3932,41 @@ link_info_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
+extern int cached_thumbnail_size;
+
+/* cf. nautilus_file_get_icon() */
+static int
+get_max_thumbnail_size (void)
+{
+	return NAUTILUS_ICON_SIZE_LARGEST * cached_thumbnail_size / NAUTILUS_ICON_SIZE_STANDARD;
+}
+
+/* The modification time of the file the thumbnail was made from, or 0
+ * if the thumbnail doesn't say */
+static time_t
+get_thumbnail_mtime (NautilusFile *file,
+		     GdkPixbuf *pixbuf,
+		     gboolean tried_original)
+{
+	const char *thumb_mtime_str;
+
+	if (tried_original) {
+		return file->details->mtime;
+	}
+
+	thumb_mtime_str = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+
+	return thumb_mtime_str != NULL ? atol (thumb_mtime_str) : 0;
+}
+
 static void
 thumbnail_done (NautilusDirectory *directory,
 		NautilusFile *file,
 		GdkPixbuf *pixbuf,
 		gboolean tried_original)
 {
-	const char *thumb_mtime_str;
-	time_t thumb_mtime = 0;
+	time_t thumb_mtime;
+	char *uri;
 	
 	file->details->thumbnail_is_up_to_date = TRUE;
 	file->details->thumbnail_tried_original  = tried_original;
@@ -3691,19 +3975,20 @@ thumbnail_done (NautilusDirectory *directory,
 		file->details->thumbnail = NULL;
 	}
 	if (pixbuf) {
-		if (tried_original) {
-			thumb_mtime = file->details->mtime;
-		} else {
-			thumb_mtime_str = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
-			if (thumb_mtime_str) {
-				thumb_mtime = atol (thumb_mtime_str);
-			}
-		}
+		thumb_mtime = get_thumbnail_mtime (file, pixbuf, tried_original);
 		
 		if (thumb_mtime == 0 ||
 		    thumb_mtime == file->details->mtime) {
 			file->details->thumbnail = g_object_ref (pixbuf);
 			file->details->thumbnail_mtime = thumb_mtime;
+
+			uri = nautilus_file_get_uri (file);
+			nautilus_thumbnail_cache_insert (uri,
+							 file->details->mtime,
+							 get_max_thumbnail_size (),
+							 tried_original,
+							 pixbuf);
+			g_free (uri);
 		} else {
 			g_free (file->details->thumbnail_path);
 			file->details->thumbnail_path = NULL;
@@ -3763,8 +4048,6 @@ thumbnail_state_free (ThumbnailState *state)
 	g_free (state);
 }
 
-extern int cached_thumbnail_size;
-
 /* scale very large images down to the max. size we need */
 static void
 thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
@@ -3777,8 +4060,7 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 
 	aspect_ratio = ((double) width) / height;
 
-	/* cf. nautilus_file_get_icon() */
-	max_thumbnail_size = NAUTILUS_ICON_SIZE_LARGEST * cached_thumbnail_size / NAUTILUS_ICON_SIZE_STANDARD;
+	max_thumbnail_size = get_max_thumbnail_size ();
 	if (MAX (width, height) > max_thumbnail_size) {
 		if (width > height) {
 			width = max_thumbnail_size;
@@ -3894,6 +4176,8 @@ thumbnail_start (NautilusDirectory *directory,
 {
 	GFile *location;
 	ThumbnailState *state;
+	GdkPixbuf *pixbuf;
+	char *uri;
 
 	if (directory->details->thumbnail_state != NULL) {
 		*doing_io = TRUE;
@@ -3905,6 +4189,36 @@ thumbnail_start (NautilusDirectory *directory,
 		       REQUEST_THUMBNAIL)) {
 		return;
 	}
+
+	/* Files that were already shown, in this or another window, can
+	 * skip loading and decoding the thumbnail again. */
+	uri = nautilus_file_get_uri (file);
+	pixbuf = nautilus_thumbnail_cache_lookup (uri,
+						  file->details->mtime,
+						  get_max_thumbnail_size (),
+						  file->details->thumbnail_wants_original);
+	g_free (uri);
+	if (pixbuf != NULL) {
+		/* Cached thumbnails match the current modification time, and
+		 * are already in the cache */
+		file->details->thumbnail_is_up_to_date = TRUE;
+		file->details->thumbnail_tried_original = file->details->thumbnail_wants_original;
+		if (file->details->thumbnail != NULL) {
+			g_object_unref (file->details->thumbnail);
+		}
+		file->details->thumbnail = pixbuf;
+		file->details->thumbnail_mtime = get_thumbnail_mtime (file, pixbuf,
+								      file->details->thumbnail_wants_original);
+
+		nautilus_directory_ref (directory);
+		nautilus_file_ref (file);
+		nautilus_directory_async_state_changed (directory);
+		nautilus_file_changed (file);
+		nautilus_file_unref (file);
+		nautilus_directory_unref (directory);
+		return;
+	}
+
 	*doing_io = TRUE;
 
 	if (!async_job_start (directory, "thumbnail")) {
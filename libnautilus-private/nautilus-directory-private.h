@@ -71,6 +71,8 @@ struct NautilusDirectoryDetails
 {
 	/* The location. */
 	GFile *location;
+	/* Its URI, interned, which keys the files in the file table */
+	eel_ref_str uri;
 
 	/* The file objects. */
 	NautilusFile *as_file;
@@ -26,8 +26,10 @@
 #include "nautilus-directory-private.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
+#include "nautilus-file-table.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-search-directory.h"
 #include "nautilus-global-preferences.h"
@@ -230,6 +232,7 @@ nautilus_directory_finalize (GObject *object)
 	if (directory->details->location) {
 		g_object_unref (directory->details->location);
 	}
+	eel_ref_str_unref (directory->details->uri);
 
 	g_assert (directory->details->file_list == NULL);
 	g_hash_table_destroy (directory->details->file_hash);
@@ -644,6 +647,8 @@ add_to_hash_table (NautilusDirectory *directory, NautilusFile *file, GList *node
 	g_assert (g_hash_table_lookup (directory->details->file_hash,
 				       name) == NULL);
 	g_hash_table_insert (directory->details->file_hash, (char *) name, node);
+
+	nautilus_file_table_insert (directory->details->uri, file);
 }
 
 static GList *
@@ -661,6 +666,10 @@ extract_from_hash_table (NautilusDirectory *directory, NautilusFile *file)
 	node = g_hash_table_lookup (directory->details->file_hash, name);
 	g_hash_table_remove (directory->details->file_hash, name);
 
+	if (node != NULL) {
+		nautilus_file_table_remove (directory->details->uri, file);
+	}
+
 	return node;
 }
 
@@ -995,6 +1004,8 @@ nautilus_directory_notify_files_added (GList *files)
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
 
+		nautilus_deep_count_cache_invalidate (location);
+
 		/* See if the directory is already known. */
 		directory = get_parent_directory_if_exists (location);
 		if (directory == NULL) {
@@ -1112,6 +1123,8 @@ nautilus_directory_notify_files_changed (GList *files)
 	for (node = files; node != NULL; node = node->next) {
 		location = node->data;
 
+		nautilus_deep_count_cache_invalidate (location);
+
 		/* Find the file. */
 		file = nautilus_file_get_existing (location);
 		if (file != NULL) {
@@ -1164,6 +1177,8 @@ nautilus_directory_notify_files_removed (GList *files)
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
 
+		nautilus_deep_count_cache_invalidate (location);
+
 		/* Update file count for parent directory if anyone might care. */
 		directory = get_parent_directory_if_exists (location);
 		if (directory != NULL) {
@@ -1206,11 +1221,28 @@ static void
 set_directory_location (NautilusDirectory *directory,
 			GFile *location)
 {
+	GList *node;
+	char *uri;
+
+	/* The files are keyed by the directory URI in the file table */
+	for (node = directory->details->file_list; node != NULL; node = node->next) {
+		nautilus_file_table_remove (directory->details->uri, node->data);
+	}
+
 	if (directory->details->location) {
 		g_object_unref (directory->details->location);
 	}
 	directory->details->location = g_object_ref (location);
 
+	eel_ref_str_unref (directory->details->uri);
+	uri = g_file_get_uri (location);
+	directory->details->uri = eel_ref_str_get_unique (uri);
+	g_free (uri);
+
+	for (node = directory->details->file_list; node != NULL; node = node->next) {
+		nautilus_file_table_insert (directory->details->uri, node->data);
+	}
+
 	g_object_notify_by_pspec (G_OBJECT (directory), properties[PROP_LOCATION]);
 }
 
@@ -1378,6 +1410,9 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
 		from_location = pair->from;
 		to_location = pair->to;
 
+		nautilus_deep_count_cache_invalidate (from_location);
+		nautilus_deep_count_cache_invalidate (to_location);
+
 		/* Handle overwriting a file. */
 		file = nautilus_file_get_existing (to_location);
 		if (file != NULL) {
@@ -25,6 +25,9 @@
 
 #include "nautilus-directory-notify.h"
 
+#define DEBUG_FLAG NAUTILUS_DEBUG_FILE
+#include "nautilus-debug.h"
+
 typedef enum {
 	CHANGE_FILE_INITIAL,
 	CHANGE_FILE_ADDED,
@@ -41,11 +44,19 @@ typedef struct {
 	GFile *to;
 	GdkPoint point;
 	int screen;
+	/* Link in the queue, for file changes that can be coalesced */
+	GList *link;
 } NautilusFileChange;
 
 typedef struct {
-	GList *head;
-	GList *tail;
+	/* Newest change at the head */
+	GQueue changes;
+	/* The last queued added/changed/removed/moved change for each
+	 * location, used to coalesce changes before they are consumed.
+	 */
+	GHashTable *pending;
+	guint64 n_raw_changes;
+	guint64 n_coalesced_changes;
 	GMutex mutex;
 } NautilusFileChangesQueue;
 
@@ -55,6 +66,8 @@ nautilus_file_changes_queue_new (void)
 	NautilusFileChangesQueue *result;
 
 	result = g_new0 (NautilusFileChangesQueue, 1);
+	g_queue_init (&result->changes);
+	result->pending = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
 	g_mutex_init (&result->mutex);
 
 	return result;
@@ -72,16 +85,139 @@ nautilus_file_changes_queue_get (void)
 	return file_changes_queue;
 }
 
+static void
+file_change_free (NautilusFileChange *change)
+{
+	g_clear_object (&change->from);
+	g_clear_object (&change->to);
+	g_free (change);
+}
+
+/* Returns the location a change is tracked under in queue->pending */
+static GFile *
+file_change_get_pending_key (NautilusFileChange *change)
+{
+	switch (change->kind) {
+	case CHANGE_FILE_ADDED:
+	case CHANGE_FILE_CHANGED:
+	case CHANGE_FILE_REMOVED:
+		return change->from;
+	case CHANGE_FILE_MOVED:
+		return change->to;
+	default:
+		return NULL;
+	}
+}
+
+static void
+drop_pending_change (NautilusFileChangesQueue *queue,
+		     NautilusFileChange *change)
+{
+	g_hash_table_remove (queue->pending, file_change_get_pending_key (change));
+	g_queue_delete_link (&queue->changes, change->link);
+	file_change_free (change);
+}
+
+/* Merges new_item into the change already queued for the same location,
+ * when the result is the same as delivering both. Returns TRUE if
+ * new_item was consumed. Lock the queue mutex when calling this.
+ */
+static gboolean
+coalesce_change (NautilusFileChangesQueue *queue,
+		 NautilusFileChange *new_item)
+{
+	NautilusFileChange *pending;
+
+	pending = g_hash_table_lookup (queue->pending, new_item->from);
+	if (pending == NULL) {
+		return FALSE;
+	}
+
+	switch (new_item->kind) {
+	case CHANGE_FILE_ADDED:
+		/* Repeated creation */
+		if (pending->kind == CHANGE_FILE_ADDED) {
+			file_change_free (new_item);
+			return TRUE;
+		}
+		break;
+
+	case CHANGE_FILE_CHANGED:
+		/* The file info is read again anyway for an added file,
+		 * and once is enough for repeated changes. */
+		if (pending->kind == CHANGE_FILE_ADDED ||
+		    pending->kind == CHANGE_FILE_CHANGED) {
+			file_change_free (new_item);
+			return TRUE;
+		}
+		break;
+
+	case CHANGE_FILE_REMOVED:
+		if (pending->kind == CHANGE_FILE_REMOVED) {
+			file_change_free (new_item);
+			return TRUE;
+		}
+		/* Nobody needs to hear about a file that is already gone
+		 * being created or changed. The removal is still queued,
+		 * in case the file existed before. */
+		if (pending->kind == CHANGE_FILE_ADDED ||
+		    pending->kind == CHANGE_FILE_CHANGED) {
+			drop_pending_change (queue, pending);
+			queue->n_coalesced_changes++;
+		}
+		break;
+
+	case CHANGE_FILE_MOVED:
+		/* Collapse a -> b, b -> c into a -> c, unless something
+		 * else already happened to c. */
+		if (pending->kind == CHANGE_FILE_MOVED &&
+		    !g_file_equal (pending->from, new_item->to) &&
+		    g_hash_table_lookup (queue->pending, new_item->to) == NULL) {
+			g_hash_table_remove (queue->pending, pending->to);
+			g_object_unref (pending->to);
+			pending->to = g_object_ref (new_item->to);
+			g_hash_table_insert (queue->pending, pending->to, pending);
+			file_change_free (new_item);
+			return TRUE;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return FALSE;
+}
+
 static void
 nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue, 
 	NautilusFileChange *new_item)
 {
+	GFile *key;
+
 	/* enqueue the new queue item while locking down the list */
 	g_mutex_lock (&queue->mutex);
 
-	queue->head = g_list_prepend (queue->head, new_item);
-	if (queue->tail == NULL)
-		queue->tail = queue->head;
+	queue->n_raw_changes++;
+
+	if (coalesce_change (queue, new_item)) {
+		queue->n_coalesced_changes++;
+	} else {
+		g_queue_push_head (&queue->changes, new_item);
+		new_item->link = g_queue_peek_head_link (&queue->changes);
+
+		/* Nothing is at the source of a move anymore, later changes
+		 * there must not be merged into what was queued before it */
+		if (new_item->kind == CHANGE_FILE_MOVED) {
+			g_hash_table_remove (queue->pending, new_item->from);
+		}
+
+		key = file_change_get_pending_key (new_item);
+		if (key != NULL) {
+			/* Replace the key too, the older change may be freed first */
+			g_hash_table_replace (queue->pending, key, new_item);
+		}
+	}
 
 	g_mutex_unlock (&queue->mutex);
 }
@@ -137,7 +273,7 @@ nautilus_file_changes_queue_file_moved (GFile *from,
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_new0 (NautilusFileChange, 1);
 	new_item->kind = CHANGE_FILE_MOVED;
 	new_item->from = g_object_ref (from);
 	new_item->to = g_object_ref (to);
@@ -154,7 +290,7 @@ nautilus_file_changes_queue_schedule_position_set (GFile *location,
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_new0 (NautilusFileChange, 1);
 	new_item->kind = CHANGE_POSITION_SET;
 	new_item->from = g_object_ref (location);
 	new_item->point = point;
@@ -170,7 +306,7 @@ nautilus_file_changes_queue_schedule_position_remove (GFile *location)
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_new0 (NautilusFileChange, 1);
 	new_item->kind = CHANGE_POSITION_REMOVE;
 	new_item->from = g_object_ref (location);
 	nautilus_file_changes_queue_add_common (queue, new_item);
@@ -179,23 +315,23 @@ nautilus_file_changes_queue_schedule_position_remove (GFile *location)
 static NautilusFileChange *
 nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
 {
-	GList *new_tail;
 	NautilusFileChange *result;
+	GFile *key;
 
 	g_assert (queue != NULL);
 	
 	/* dequeue the tail item while locking down the list */
 	g_mutex_lock (&queue->mutex);
 
-	if (queue->tail == NULL) {
-		result = NULL;
-	} else {
-		new_tail = queue->tail->prev;
-		result = queue->tail->data;
-		queue->head = g_list_remove_link (queue->head,
-						  queue->tail);
-		g_list_free_1 (queue->tail);
-		queue->tail = new_tail;
+	result = g_queue_pop_tail (&queue->changes);
+	if (result != NULL) {
+		result->link = NULL;
+
+		key = file_change_get_pending_key (result);
+		if (key != NULL &&
+		    g_hash_table_lookup (queue->pending, key) == result) {
+			g_hash_table_remove (queue->pending, key);
+		}
 	}
 
 	g_mutex_unlock (&queue->mutex);
@@ -203,6 +339,24 @@ nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
 	return result;
 }
 
+void
+nautilus_file_changes_queue_get_stats (guint64 *n_raw_changes,
+				       guint64 *n_coalesced_changes)
+{
+	NautilusFileChangesQueue *queue;
+
+	queue = nautilus_file_changes_queue_get ();
+
+	g_mutex_lock (&queue->mutex);
+	if (n_raw_changes != NULL) {
+		*n_raw_changes = queue->n_raw_changes;
+	}
+	if (n_coalesced_changes != NULL) {
+		*n_coalesced_changes = queue->n_coalesced_changes;
+	}
+	g_mutex_unlock (&queue->mutex);
+}
+
 enum {
 	CONSUME_CHANGES_MAX_CHUNK = 20
 };
@@ -254,6 +408,7 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 	guint chunk_count;
 	NautilusFileChangesQueue *queue;
 	gboolean flush_needed;
+	guint64 n_raw_changes, n_coalesced_changes;
 	
 
 	additions = NULL;
@@ -344,6 +499,9 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 
 		if (change == NULL) {
 			/* we are done */
+			nautilus_file_changes_queue_get_stats (&n_raw_changes, &n_coalesced_changes);
+			DEBUG ("%" G_GUINT64_FORMAT " changes queued, %" G_GUINT64_FORMAT " coalesced",
+			       n_raw_changes, n_coalesced_changes);
 			return;
 		}
 		
@@ -38,5 +38,10 @@ void nautilus_file_changes_queue_schedule_position_remove        (GFile      *lo
 
 void nautilus_file_changes_consume_changes                       (gboolean    consume_all);
 
+/* Number of changes queued so far, and how many of them were merged into
+ * an earlier change of the same file before being consumed. */
+void nautilus_file_changes_queue_get_stats                       (guint64    *n_raw_changes,
+								  guint64    *n_coalesced_changes);
+
 
 #endif /* NAUTILUS_FILE_CHANGES_QUEUE_H */
@@ -26,6 +26,9 @@
             Pavel Cisler <pavel@eazel.com> 
  */
 
+/* for copy_file_range() */
+#define _GNU_SOURCE
+
 #include <config.h>
 #include <string.h>
 #include <stdio.h>
@@ -33,8 +36,19 @@
 #include <locale.h>
 #include <math.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <stdlib.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include "nautilus-file-operations.h"
 
@@ -42,6 +56,7 @@
 #include "nautilus-lib-self-check-functions.h"
 
 #include "nautilus-progress-info.h"
+#include "nautilus-progress-info-manager.h"
 
 #include <eel/eel-glib-extensions.h>
 #include <eel/eel-gtk-extensions.h>
@@ -76,8 +91,6 @@ typedef struct {
 	int inhibit_cookie;
 	NautilusProgressInfo *progress;
 	GCancellable *cancellable;
-	GHashTable *skip_files;
-	GHashTable *skip_readdir_error;
 	NautilusFileUndoInfo *undo_info;
 	gboolean skip_all_error;
 	gboolean skip_all_conflict;
@@ -86,12 +99,20 @@ typedef struct {
 	gboolean delete_all;
 } CommonJob;
 
+typedef struct {
+	GThreadPool *pool;
+	GAsyncQueue *results;
+	int in_flight;
+	int max_in_flight;
+} ConcurrentCopy;
+
 typedef struct {
 	CommonJob common;
 	gboolean is_move;
 	GList *files;
 	GFile *destination;
 	GFile *desktop_location;
+	ConcurrentCopy *concurrent;
 	GFile *fake_display_source;
 	GdkPoint *icon_positions;
 	int n_icon_positions;
@@ -160,11 +181,13 @@ typedef enum {
 	OP_KIND_TRASH
 } OpKind;
 
+typedef struct _SourceScan SourceScan;
+
 typedef struct {
 	int num_files;
 	goffset num_bytes;
-	int num_files_since_progress;
 	OpKind op;
+	SourceScan *scan;
 } SourceInfo;
 
 typedef struct {
@@ -180,6 +203,25 @@ typedef struct {
 
 #define MAXIMUM_DISPLAYED_FILE_NAME_LENGTH 50
 
+/* Local copies are done in the kernel, with a progress update after each chunk */
+#define LOCAL_COPY_CHUNK_SIZE (32 * 1024 * 1024)
+
+/* Threads deleting local folders for each job, in addition to the job thread */
+#define NATIVE_DELETE_THREADS 4
+
+/* Deeper folders are left to the GIO code path, to bound the number of open fds */
+#define NATIVE_DELETE_MAX_DEPTH 128
+
+/* Threads counting the sources of an operation */
+#define SOURCE_SCAN_THREADS 4
+
+/* The free space is checked again each time the sources
+ * counted so far have grown by this much */
+#define FREE_SPACE_CHECK_INTERVAL (64 * 1024 * 1024)
+
+/* Files up to this size are copied by the concurrent copy threads */
+#define CONCURRENT_COPY_MAX_SIZE (1024 * 1024)
+
 #define IS_IO_ERROR(__error, KIND) (((__error)->domain == G_IO_ERROR && (__error)->code == G_IO_ERROR_ ## KIND))
 
 #define SKIP _("_Skip")
@@ -209,10 +251,12 @@ is_all_button_text (const char *button_text)
 	       !strcmp (button_text, MERGE_ALL);
 }
 
-static void scan_sources (GList *files,
-			  SourceInfo *source_info,
-			  CommonJob *job,
-			  OpKind kind);
+static void scan_sources_start (GList *files,
+				SourceInfo *source_info,
+				CommonJob *job,
+				OpKind kind);
+static void scan_sources_finish (SourceInfo *source_info);
+static gboolean source_info_sync (SourceInfo *source_info);
 
 
 static gboolean empty_trash_job (GIOSchedulerJob *io_job,
@@ -940,6 +984,38 @@ init_common (gsize job_size,
 	return common;
 }
 
+/* Runs the job in a thread once the device of device_file
+ * is free, see nautilus_progress_info_manager_queue_job() */
+static void
+schedule_job (CommonJob *common,
+	      GFile *device_file,
+	      GIOSchedulerJobFunc job_func)
+{
+	NautilusProgressInfoManager *manager;
+
+	manager = nautilus_progress_info_manager_new ();
+	nautilus_progress_info_manager_queue_job (manager, common->progress,
+						  device_file, job_func, common);
+	g_object_unref (manager);
+}
+
+/* Like schedule_job(), but doesn't wait when source_file is on the
+ * same device as target_dir, since the move is then only a rename */
+static void
+schedule_move_job (CommonJob *common,
+		   GFile *source_file,
+		   GFile *target_dir,
+		   GIOSchedulerJobFunc job_func)
+{
+	NautilusProgressInfoManager *manager;
+
+	manager = nautilus_progress_info_manager_new ();
+	nautilus_progress_info_manager_queue_move_job (manager, common->progress,
+						       source_file, target_dir,
+						       job_func, common);
+	g_object_unref (manager);
+}
+
 static void
 finalize_common (CommonJob *common)
 {
@@ -958,13 +1034,6 @@ finalize_common (CommonJob *common)
 					      (gpointer *) &common->parent_window);
 	}
 
-	if (common->skip_files) {
-		g_hash_table_destroy (common->skip_files);
-	}
-	if (common->skip_readdir_error) {
-		g_hash_table_destroy (common->skip_readdir_error);
-	}
-
 	if (common->undo_info != NULL) {
 		nautilus_file_undo_manager_set_action (common->undo_info);
 		g_object_unref (common->undo_info);
@@ -975,50 +1044,6 @@ finalize_common (CommonJob *common)
 	g_free (common);
 }
 
-static void
-skip_file (CommonJob *common,
-	   GFile *file)
-{
-	if (common->skip_files == NULL) {
-		common->skip_files =
-			g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
-	}
-
-	g_hash_table_insert (common->skip_files, g_object_ref (file), file);
-}
-
-static void
-skip_readdir_error (CommonJob *common,
-		    GFile *dir)
-{
-	if (common->skip_readdir_error == NULL) {
-		common->skip_readdir_error =
-			g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
-	}
-
-	g_hash_table_insert (common->skip_readdir_error, g_object_ref (dir), dir);
-}
-
-static gboolean
-should_skip_file (CommonJob *common,
-		  GFile *file)
-{
-	if (common->skip_files != NULL) {
-		return g_hash_table_lookup (common->skip_files, file) != NULL;
-	}
-	return FALSE;
-}
-
-static gboolean
-should_skip_readdir_error (CommonJob *common,
-			   GFile *dir)
-{
-	if (common->skip_readdir_error != NULL) {
-		return g_hash_table_lookup (common->skip_readdir_error, dir) != NULL;
-	}
-	return FALSE;
-}
-
 static gboolean
 can_delete_without_confirm (GFile *file)
 {
@@ -1290,6 +1315,18 @@ job_aborted (CommonJob *job)
 	return g_cancellable_is_cancelled (job->cancellable);
 }
 
+/* Called whenever progress is reported, so that a
+ * job paused by the user stops at the next file */
+static void
+wait_while_user_paused (CommonJob *job)
+{
+	if (nautilus_progress_info_get_is_user_paused (job->progress)) {
+		g_timer_stop (job->time);
+		nautilus_progress_info_wait_while_user_paused (job->progress);
+		g_timer_continue (job->time);
+	}
+}
+
 /* Since this happens on a thread we can't use the global prefs object */
 static gboolean
 should_confirm_trash (void)
@@ -1418,6 +1455,9 @@ report_delete_progress (CommonJob *job,
 	int remaining_time;
 	gint64 now;
 	char *files_left_s;
+	gboolean counted;
+
+	wait_while_user_paused (job);
 
 	now = g_get_monotonic_time ();
 	if (transfer_info->last_report_time != 0 &&
@@ -1425,6 +1465,8 @@ report_delete_progress (CommonJob *job,
 		return;
 	}
 	transfer_info->last_report_time = now;
+
+	counted = source_info_sync (source_info);
 	
 	files_left = source_info->num_files - transfer_info->num_files;
 
@@ -1466,8 +1508,13 @@ report_delete_progress (CommonJob *job,
 
 	g_free (files_left_s);
 
-	if (source_info->num_files != 0) {
-		nautilus_progress_info_set_progress (job->progress, transfer_info->num_files, source_info->num_files);
+	/* The deletion can get ahead of the count, don't go past the end */
+	if (!counted && transfer_info->num_files >= source_info->num_files) {
+		nautilus_progress_info_pulse_progress (job->progress);
+	} else if (source_info->num_files != 0) {
+		nautilus_progress_info_set_progress (job->progress,
+						     MIN (transfer_info->num_files, source_info->num_files),
+						     source_info->num_files);
 	}
 }
 
@@ -1477,6 +1524,376 @@ static void delete_file (CommonJob *job, GFile *file,
 			 TransferInfo *transfer_info,
 			 gboolean toplevel);
 
+/* Local folders are deleted with openat()/unlinkat() instead of one
+ * GFile and GFileInfo per entry. The job thread walks the tree depth
+ * first, and hands whole subfolders to a few threads of its own
+ * whenever one of them is idle. The threads wait while the job is
+ * paused, which leaves the other jobs alone. Nothing in here asks the user anything: anything that
+ * can't be deleted (a folder that can't be read, a file that can't be
+ * removed, a whole subfolder a thread gave up on) goes through
+ * delete_file() on the job thread, which retries it and shows the usual
+ * dialogs.
+ *
+ * The emptied folders are removed with g_file_delete(), so that the
+ * metadata stored for them and for everything that was in them goes
+ * too. Only removed folders are sent to the change queue; the files in
+ * them are gone with them.
+ */
+typedef enum {
+	NATIVE_DELETE_DONE,
+	NATIVE_DELETE_SKIPPED,
+	NATIVE_DELETE_FAILED
+} NativeDeleteResult;
+
+typedef struct {
+	CommonJob *job;
+	SourceInfo *source_info;
+	TransferInfo *transfer_info;
+	GThreadPool *pool;	/* created when the first subfolder is handed out */
+	GAsyncQueue *results;
+	int in_flight;
+	int deleted;	/* atomic, by the threads */
+} NativeDelete;
+
+typedef struct {
+	NativeDelete *delete;
+	char *path;
+	int *dir_pending;
+	gboolean *skipped_file;
+	int error;
+} NativeDeleteItem;
+
+static gboolean
+dirent_is_dir (int dir_fd,
+	       struct dirent *ent)
+{
+	struct stat statbuf;
+
+	if (ent->d_type != DT_UNKNOWN) {
+		return ent->d_type == DT_DIR;
+	}
+
+	return fstatat (dir_fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+		S_ISDIR (statbuf.st_mode);
+}
+
+/* Removes the empty folder at path, and queues the change. Can be
+ * called from any thread.
+ *
+ * This goes by path, while native_delete_tree() opens the folders
+ * relative to their parent's fd. g_file_delete() is what drops the
+ * metadata of the folder and of what was in it, and GIO has no way to
+ * delete relative to an fd. If a folder above is renamed meanwhile,
+ * this fails, and the job thread retries the folder through
+ * delete_file(), which reports the error. */
+static gboolean
+native_delete_remove_dir (const char *path)
+{
+	GFile *file;
+	gboolean removed;
+
+	file = g_file_new_for_path (path);
+	removed = g_file_delete (file, NULL, NULL);
+	if (removed) {
+		nautilus_file_changes_queue_file_removed (file);
+	}
+	g_object_unref (file);
+
+	return removed;
+}
+
+/* Deletes the tree at path, which is name in parent_fd, on a delete
+ * thread; returns an errno value */
+static int
+native_delete_tree (NativeDelete *delete,
+		    int parent_fd,
+		    const char *name,
+		    const char *path,
+		    int depth)
+{
+	DIR *dir;
+	struct dirent *ent;
+	char *child;
+	int fd;
+	int res;
+
+	if (depth > NATIVE_DELETE_MAX_DEPTH) {
+		return ENAMETOOLONG;
+	}
+
+	nautilus_progress_info_wait_while_user_paused (delete->job->progress);
+
+	fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		return errno;
+	}
+	dir = fdopendir (fd);
+	if (dir == NULL) {
+		res = errno;
+		close (fd);
+		return res;
+	}
+
+	res = 0;
+	while (res == 0 && (ent = readdir (dir)) != NULL) {
+		if (strcmp (ent->d_name, ".") == 0 ||
+		    strcmp (ent->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (job_aborted (delete->job)) {
+			res = ECANCELED;
+		} else if (dirent_is_dir (fd, ent)) {
+			child = g_build_filename (path, ent->d_name, NULL);
+			res = native_delete_tree (delete, fd, ent->d_name, child, depth + 1);
+			g_free (child);
+		} else if (unlinkat (fd, ent->d_name, 0) != 0) {
+			res = errno;
+		} else {
+			g_atomic_int_inc (&delete->deleted);
+		}
+	}
+	closedir (dir);
+
+	if (res == 0) {
+		if (!native_delete_remove_dir (path)) {
+			/* The job thread gets the details when it tries again */
+			res = EIO;
+		} else {
+			g_atomic_int_inc (&delete->deleted);
+		}
+	}
+
+	return res;
+}
+
+static void
+native_delete_thread_func (gpointer data,
+			   gpointer user_data)
+{
+	NativeDeleteItem *item;
+
+	item = data;
+	item->error = native_delete_tree (item->delete, AT_FDCWD, item->path, item->path, 0);
+
+	g_async_queue_push (item->delete->results, item);
+}
+
+/* Deletes what the fast path couldn't, with dialogs */
+static void
+native_delete_fallback (NativeDelete *delete,
+			const char *path,
+			gboolean *skipped_file)
+{
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	delete_file (delete->job, file, skipped_file,
+		     delete->source_info, delete->transfer_info,
+		     FALSE);
+	g_object_unref (file);
+}
+
+static void
+native_delete_report (NativeDelete *delete)
+{
+	int deleted;
+
+	deleted = g_atomic_int_get (&delete->deleted);
+	if (deleted != 0) {
+		g_atomic_int_add (&delete->deleted, -deleted);
+		delete->transfer_info->num_files += deleted;
+	}
+
+	report_delete_progress (delete->job, delete->source_info, delete->transfer_info);
+}
+
+static void
+native_delete_handle_result (NativeDelete *delete,
+			     NativeDeleteItem *item)
+{
+	delete->in_flight--;
+	(*item->dir_pending)--;
+
+	if (item->error != 0 &&
+	    item->error != ECANCELED &&
+	    !job_aborted (delete->job)) {
+		native_delete_fallback (delete, item->path, item->skipped_file);
+	}
+
+	g_free (item->path);
+	g_slice_free (NativeDeleteItem, item);
+}
+
+static void
+native_delete_push (NativeDelete *delete,
+		    char *path,
+		    int *dir_pending,
+		    gboolean *skipped_file)
+{
+	NativeDeleteItem *item;
+
+	item = g_slice_new0 (NativeDeleteItem);
+	item->delete = delete;
+	item->path = path;
+	item->dir_pending = dir_pending;
+	item->skipped_file = skipped_file;
+
+	if (delete->pool == NULL) {
+		delete->pool = g_thread_pool_new (native_delete_thread_func, NULL,
+						  NATIVE_DELETE_THREADS, FALSE, NULL);
+	}
+
+	delete->in_flight++;
+	(*dir_pending)++;
+	g_thread_pool_push (delete->pool, item, NULL);
+}
+
+static void
+native_delete_poll (NativeDelete *delete)
+{
+	NativeDeleteItem *item;
+
+	while ((item = g_async_queue_try_pop (delete->results)) != NULL) {
+		native_delete_handle_result (delete, item);
+	}
+	native_delete_report (delete);
+}
+
+static NativeDeleteResult
+native_delete_walk (NativeDelete *delete,
+		    const char *path,
+		    int depth)
+{
+	DIR *dir;
+	struct dirent *ent;
+	NativeDeleteItem *item;
+	NativeDeleteResult res;
+	char *child;
+	int fd;
+	int pending;
+	gboolean local_skipped_file;
+
+	if (depth > NATIVE_DELETE_MAX_DEPTH) {
+		return NATIVE_DELETE_FAILED;
+	}
+
+	fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		return NATIVE_DELETE_FAILED;
+	}
+	dir = fdopendir (fd);
+	if (dir == NULL) {
+		close (fd);
+		return NATIVE_DELETE_FAILED;
+	}
+
+	pending = 0;
+	local_skipped_file = FALSE;
+
+	while (!job_aborted (delete->job) &&
+	       (ent = readdir (dir)) != NULL) {
+		if (strcmp (ent->d_name, ".") == 0 ||
+		    strcmp (ent->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (dirent_is_dir (fd, ent)) {
+			child = g_build_filename (path, ent->d_name, NULL);
+			if (delete->in_flight < NATIVE_DELETE_THREADS) {
+				native_delete_push (delete, child, &pending, &local_skipped_file);
+			} else {
+				res = native_delete_walk (delete, child, depth + 1);
+				if (res == NATIVE_DELETE_FAILED) {
+					native_delete_fallback (delete, child, &local_skipped_file);
+				} else if (res == NATIVE_DELETE_SKIPPED) {
+					local_skipped_file = TRUE;
+				}
+				g_free (child);
+			}
+		} else if (unlinkat (fd, ent->d_name, 0) == 0) {
+			delete->transfer_info->num_files++;
+		} else {
+			child = g_build_filename (path, ent->d_name, NULL);
+			native_delete_fallback (delete, child, &local_skipped_file);
+			g_free (child);
+		}
+
+		native_delete_poll (delete);
+	}
+	closedir (dir);
+
+	/* The folder can only go once the threads are done with it */
+	while (pending > 0) {
+		item = g_async_queue_timeout_pop (delete->results, 100 * 1000);
+		if (item != NULL) {
+			native_delete_handle_result (delete, item);
+		}
+		native_delete_report (delete);
+	}
+
+	if (job_aborted (delete->job) || local_skipped_file) {
+		return NATIVE_DELETE_SKIPPED;
+	}
+
+	if (!native_delete_remove_dir (path)) {
+		return NATIVE_DELETE_FAILED;
+	}
+	delete->transfer_info->num_files++;
+
+	return NATIVE_DELETE_DONE;
+}
+
+/* Returns FALSE if dir should be deleted the GIO way instead */
+static gboolean
+delete_dir_native (CommonJob *job,
+		   GFile *dir,
+		   gboolean *skipped_file,
+		   SourceInfo *source_info,
+		   TransferInfo *transfer_info)
+{
+	NativeDelete delete;
+	NativeDeleteResult res;
+	char *path;
+
+	path = g_file_get_path (dir);
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	delete.job = job;
+	delete.source_info = source_info;
+	delete.transfer_info = transfer_info;
+	delete.pool = NULL;
+	delete.results = g_async_queue_new ();
+	delete.in_flight = 0;
+	delete.deleted = 0;
+
+	res = native_delete_walk (&delete, path, 0);
+
+	g_assert (delete.in_flight == 0);
+	if (delete.pool != NULL) {
+		g_thread_pool_free (delete.pool, FALSE, TRUE);
+	}
+	g_async_queue_unref (delete.results);
+	g_free (path);
+
+	switch (res) {
+		case NATIVE_DELETE_DONE:
+			report_delete_progress (job, source_info, transfer_info);
+			return TRUE;
+		case NATIVE_DELETE_SKIPPED:
+			if (!job_aborted (job)) {
+				*skipped_file = TRUE;
+			}
+			return TRUE;
+		case NATIVE_DELETE_FAILED:
+		default:
+			/* Let the GIO code report it */
+			return FALSE;
+	}
+}
+
 static void
 delete_dir (CommonJob *job, GFile *dir,
 	    gboolean *skipped_file,
@@ -1490,12 +1907,14 @@ delete_dir (CommonJob *job, GFile *dir,
 	GFileEnumerator *enumerator;
 	char *primary, *secondary, *details;
 	int response;
-	gboolean skip_error;
 	gboolean local_skipped_file;
 
+	if (delete_dir_native (job, dir, skipped_file, source_info, transfer_info)) {
+		return;
+	}
+
 	local_skipped_file = FALSE;
-	
-	skip_error = should_skip_readdir_error (job, dir);
+
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (dir,
@@ -1507,7 +1926,7 @@ delete_dir (CommonJob *job, GFile *dir,
 		error = NULL;
 		
 		while (!job_aborted (job) &&
-		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error)) != NULL) {
+		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL) {
 			file = g_file_get_child (dir,
 						 g_file_info_get_name (info));
 			delete_file (job, file, &local_skipped_file, source_info, transfer_info, FALSE);
@@ -1642,11 +2061,6 @@ delete_file (CommonJob *job, GFile *file,
 	char *primary, *secondary, *details;
 	int response;
 
-	if (should_skip_file (job, file)) {
-		*skipped_file = TRUE;
-		return;
-	}
-	
 	error = NULL;
 	if (g_file_delete (file, job->cancellable, &error)) {
 		nautilus_file_changes_queue_file_removed (file);
@@ -1711,13 +2125,10 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 		return;
 	}
 
-	scan_sources (files,
-		      &source_info,
-		      job,
-		      OP_KIND_DELETE);
-	if (job_aborted (job)) {
-		return;
-	}
+	scan_sources_start (files,
+			    &source_info,
+			    job,
+			    OP_KIND_DELETE);
 
 	g_timer_start (job->time);
 	
@@ -1738,6 +2149,8 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 			(*files_skipped)++;
 		}
 	}
+
+	scan_sources_finish (&source_info);
 }
 
 static void
@@ -1748,6 +2161,8 @@ report_trash_progress (CommonJob *job,
 	int files_left;
 	char *s;
 
+	wait_while_user_paused (job);
+
 	files_left = total_files - files_trashed;
 
 	nautilus_progress_info_take_status (job->progress,
@@ -1994,11 +2409,8 @@ trash_or_delete_internal (GList                  *files,
 		job->common.undo_info = nautilus_file_undo_info_trash_new (g_list_length (files));
 	}
 
-	g_io_scheduler_push_job (delete_job,
-			   job,
-			   NULL,
-			   0,
-			   NULL);
+	/* Trashing is a rename, it doesn't have to wait for the copies */
+	schedule_job ((CommonJob *)job, try_trash ? NULL : files->data, delete_job);
 }
 
 void
@@ -2307,11 +2719,7 @@ nautilus_file_operations_unmount_mount_full (GtkWindow                      *par
 			job->trash_dirs = get_trash_dirs_for_mount (mount);
 			job->done_callback = empty_trash_for_unmount_done;
 			job->done_callback_data = data;
-			g_io_scheduler_push_job (empty_trash_job,
-					   job,
-					   NULL,
-					   0,
-					   NULL);
+			schedule_job ((CommonJob *)job, NULL, empty_trash_job);
 			return;
 		} else if (response == GTK_RESPONSE_CANCEL) {
 			if (callback) {
@@ -2436,308 +2844,271 @@ nautilus_file_operations_mount_volume_full (GtkWindow *parent_window,
 	g_volume_mount (volume, 0, mount_op, NULL, volume_mount_cb, mount_op);
 }
 
-static void
-report_count_progress (CommonJob *job,
-		       SourceInfo *source_info)
-{
-	char *s;
+/* The sources are counted by a few threads while the operation already
+ * runs, so that big trees don't keep the user waiting in "Preparing".
+ * Until the scan is done, the totals in SourceInfo only grow; the
+ * progress reporting functions pick them up with source_info_sync().
+ *
+ * The scan doesn't report errors. A folder that can't be read is
+ * reported by the operation itself when it gets there.
+ */
+struct _SourceScan {
+	CommonJob *job;
+	GThreadPool *pool;
+	gboolean stop;
 
-	switch (source_info->op) {
-	default:
-	case OP_KIND_COPY:
-		s = f (ngettext("Preparing to copy %'d file (%S)",
-		                "Preparing to copy %'d files (%S)",
-		                source_info->num_files),
-		       source_info->num_files, source_info->num_bytes);
-		break;
-	case OP_KIND_MOVE:
-		s = f (ngettext("Preparing to move %'d file (%S)",
-		                "Preparing to move %'d files (%S)",
-		                source_info->num_files),
-		       source_info->num_files, source_info->num_bytes);
-		break;
-	case OP_KIND_DELETE:
-		s = f (ngettext("Preparing to delete %'d file (%S)",
-		                "Preparing to delete %'d files (%S)",
-		                source_info->num_files),
-		       source_info->num_files, source_info->num_bytes);
-		break;
-	case OP_KIND_TRASH:
-		s = f (ngettext("Preparing to trash %'d file",
-		                "Preparing to trash %'d files",
-		                source_info->num_files),
-		       source_info->num_files);
-		break;
-	} 
+	GMutex mutex;
+	GCond done_cond;
+	int pending;
+	/* Sources not stat'ed yet */
+	int toplevel_pending;
+	int num_files;
+	goffset num_bytes;
 
-	nautilus_progress_info_take_details (job->progress, s);
-	nautilus_progress_info_pulse_progress (job->progress);
-}
+	gboolean free_space_checked;
+	goffset free_space_checked_size;
+	gboolean free_space_check_done;
+};
+
+typedef struct {
+	GFile *file;
+	gboolean is_dir;
+} SourceScanItem;
 
 static void
-count_file (GFileInfo *info,
-	    CommonJob *job,
-	    SourceInfo *source_info)
+source_scan_push (SourceScan *scan,
+		  GFile *file,
+		  gboolean is_dir)
 {
-	source_info->num_files += 1;
-	source_info->num_bytes += g_file_info_get_size (info);
+	SourceScanItem *item;
 
-	if (source_info->num_files_since_progress++ > 100) {
-		report_count_progress (job, source_info);
-		source_info->num_files_since_progress = 0;
-	}
+	item = g_slice_new (SourceScanItem);
+	item->file = g_object_ref (file);
+	item->is_dir = is_dir;
+
+	g_mutex_lock (&scan->mutex);
+	scan->pending++;
+	g_mutex_unlock (&scan->mutex);
+
+	g_thread_pool_push (scan->pool, item, NULL);
 }
 
-static char *
-get_scan_primary (OpKind kind)
+/* Adds what is known about one of the sources themselves */
+static void
+source_scan_toplevel_done (SourceScan *scan,
+			   GFileInfo *info)
 {
-	switch (kind) {
-	default:
-	case OP_KIND_COPY:
-		return f (_("Error while copying."));
-	case OP_KIND_MOVE:
-		return f (_("Error while moving."));
-	case OP_KIND_DELETE:
-		return f (_("Error while deleting."));
-	case OP_KIND_TRASH:
-		return f (_("Error while moving files to trash."));
+	g_mutex_lock (&scan->mutex);
+	if (info != NULL) {
+		scan->num_files++;
+		scan->num_bytes += g_file_info_get_size (info);
 	}
+	if (--scan->toplevel_pending == 0) {
+		g_cond_broadcast (&scan->done_cond);
+	}
+	g_mutex_unlock (&scan->mutex);
 }
 
 static void
-scan_dir (GFile *dir,
-	  SourceInfo *source_info,
-	  CommonJob *job,
-	  GQueue *dirs)
+source_scan_thread_func (gpointer data,
+			 gpointer user_data)
 {
-	GFileInfo *info;
-	GError *error;
-	GFile *subdir;
+	SourceScanItem *item;
+	SourceScan *scan;
 	GFileEnumerator *enumerator;
-	char *primary, *secondary, *details;
-	int response;
-	SourceInfo saved_info;
+	GFileInfo *info;
+	GFile *child;
+	int num_files;
+	goffset num_bytes;
 
-	saved_info = *source_info;
+	item = data;
+	scan = user_data;
+	num_files = 0;
+	num_bytes = 0;
 
- retry:
-	error = NULL;
-	enumerator = g_file_enumerate_children (dir,
+	if (g_atomic_int_get (&scan->stop) ||
+	    job_aborted (scan->job)) {
+		if (!item->is_dir) {
+			source_scan_toplevel_done (scan, NULL);
+		}
+		goto out;
+	}
+
+	if (!item->is_dir) {
+		info = g_file_query_info (item->file,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  scan->job->cancellable,
+					  NULL);
+		source_scan_toplevel_done (scan, info);
+		if (info == NULL) {
+			goto out;
+		}
+
+		item->is_dir = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
+		g_object_unref (info);
+
+		if (!item->is_dir) {
+			goto out;
+		}
+	}
+
+	enumerator = g_file_enumerate_children (item->file,
 						G_FILE_ATTRIBUTE_STANDARD_NAME","
 						G_FILE_ATTRIBUTE_STANDARD_TYPE","
 						G_FILE_ATTRIBUTE_STANDARD_SIZE,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-						job->cancellable,
-						&error);
-	if (enumerator) {
-		error = NULL;
-		while ((info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL) {
-			count_file (info, job, source_info);
+						scan->job->cancellable,
+						NULL);
+	if (enumerator == NULL) {
+		goto out;
+	}
 
-			if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
-				subdir = g_file_get_child (dir,
-							   g_file_info_get_name (info));
-				
-				/* Push to head, since we want depth-first */
-				g_queue_push_head (dirs, subdir);
-			}
+	while (!g_atomic_int_get (&scan->stop) &&
+	       (info = g_file_enumerator_next_file (enumerator, scan->job->cancellable, NULL)) != NULL) {
+		num_files++;
+		num_bytes += g_file_info_get_size (info);
 
-			g_object_unref (info);
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			child = g_file_get_child (item->file,
+						  g_file_info_get_name (info));
+			source_scan_push (scan, child, TRUE);
+			g_object_unref (child);
 		}
-		g_file_enumerator_close (enumerator, job->cancellable, NULL);
-		g_object_unref (enumerator);
-		
-		if (error && IS_IO_ERROR (error, CANCELLED)) {
-			g_error_free (error);
-		} else if (error) {
-			primary = get_scan_primary (source_info->op);
-			details = NULL;
-			
-			if (IS_IO_ERROR (error, PERMISSION_DENIED)) {
-				secondary = f (_("Files in the folder “%B” cannot be handled because you do "
-						 "not have permissions to see them."), dir);
-			} else {
-				secondary = f (_("There was an error getting information about the files in the folder “%B”."), dir);
-				details = error->message;
-			}
-			
-			response = run_warning (job,
-						primary,
-						secondary,
-						details,
-						FALSE,
-						GTK_STOCK_CANCEL, RETRY, SKIP,
-						NULL);
 
-			g_error_free (error);
-			
-			if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-				abort_job (job);
-			} else if (response == 1) {
-				*source_info = saved_info;
-				goto retry;
-			} else if (response == 2) {
-				skip_readdir_error (job, dir);
-			} else {
-				g_assert_not_reached ();
-			}
-		}
-		
-	} else if (job->skip_all_error) {
-		g_error_free (error);
-		skip_file (job, dir);
-	} else if (IS_IO_ERROR (error, CANCELLED)) {
-		g_error_free (error);
-	} else {	
-		primary = get_scan_primary (source_info->op);
-		details = NULL;
-		
-		if (IS_IO_ERROR (error, PERMISSION_DENIED)) {
-			secondary = f (_("The folder “%B” cannot be handled because you do not have "
-					 "permissions to read it."), dir);
-		} else {
-			secondary = f (_("There was an error reading the folder “%B”."), dir);
-			details = error->message;
-		}
-		/* set show_all to TRUE here, as we don't know how many
-		 * files we'll end up processing yet.
-		 */
-		response = run_warning (job,
-					primary,
-					secondary,
-					details,
-					TRUE,
-					GTK_STOCK_CANCEL, SKIP_ALL, SKIP, RETRY,
-					NULL);
-		
-		g_error_free (error);
+		g_object_unref (info);
+	}
+	g_file_enumerator_close (enumerator, scan->job->cancellable, NULL);
+	g_object_unref (enumerator);
 
-		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-			abort_job (job);
-		} else if (response == 1 || response == 2) {
-			if (response == 1) {
-				job->skip_all_error = TRUE;
-			}
-			skip_file (job, dir);
-		} else if (response == 3) {
-			goto retry;
-		} else {
-			g_assert_not_reached ();
-		}
+ out:
+	g_mutex_lock (&scan->mutex);
+	scan->num_files += num_files;
+	scan->num_bytes += num_bytes;
+	if (--scan->pending == 0) {
+		g_cond_broadcast (&scan->done_cond);
 	}
-}	
+	g_mutex_unlock (&scan->mutex);
+
+	g_object_unref (item->file);
+	g_slice_free (SourceScanItem, item);
+}
 
 static void
-scan_file (GFile *file,
-	   SourceInfo *source_info,
-	   CommonJob *job)
+scan_sources_start (GList *files,
+		    SourceInfo *source_info,
+		    CommonJob *job,
+		    OpKind kind)
 {
-	GFileInfo *info;
-	GError *error;
-	GQueue *dirs;
-	GFile *dir;
-	char *primary;
-	char *secondary;
-	char *details;
-	int response;
+	SourceScan *scan;
+	GList *l;
 
-	dirs = g_queue_new ();
-	
- retry:
-	error = NULL;
-	info = g_file_query_info (file, 
-				  G_FILE_ATTRIBUTE_STANDARD_TYPE","
-				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
-				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-				  job->cancellable,
-				  &error);
+	memset (source_info, 0, sizeof (SourceInfo));
+	source_info->op = kind;
 
-	if (info) {
-		count_file (info, job, source_info);
+	scan = g_new0 (SourceScan, 1);
+	scan->job = job;
+	g_mutex_init (&scan->mutex);
+	g_cond_init (&scan->done_cond);
+	scan->pool = g_thread_pool_new (source_scan_thread_func, scan,
+					SOURCE_SCAN_THREADS, FALSE, NULL);
+	source_info->scan = scan;
 
-		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
-			g_queue_push_head (dirs, g_object_ref (file));
-		}
-		
-		g_object_unref (info);
-	} else if (job->skip_all_error) {
-		g_error_free (error);
-		skip_file (job, file);
-	} else if (IS_IO_ERROR (error, CANCELLED)) {
-		g_error_free (error);
-	} else {
-		primary = get_scan_primary (source_info->op);
-		details = NULL;
-		
-		if (IS_IO_ERROR (error, PERMISSION_DENIED)) {
-			secondary = f (_("The file “%B” cannot be handled because you do not have "
-					 "permissions to read it."), file);
-		} else {
-			secondary = f (_("There was an error getting information about “%B”."), file);
-			details = error->message;
-		}
-		/* set show_all to TRUE here, as we don't know how many
-		 * files we'll end up processing yet.
-		 */
-		response = run_warning (job,
-					primary,
-					secondary,
-					details,
-					TRUE,
-					GTK_STOCK_CANCEL, SKIP_ALL, SKIP, RETRY,
-					NULL);
-		
-		g_error_free (error);
-
-		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-			abort_job (job);
-		} else if (response == 1 || response == 2) {
-			if (response == 1) {
-				job->skip_all_error = TRUE;
-			}
-			skip_file (job, file);
-		} else if (response == 3) {
-			goto retry;
-		} else {
-			g_assert_not_reached ();
-		}
+	scan->toplevel_pending = g_list_length (files);
+	for (l = files; l != NULL; l = l->next) {
+		source_scan_push (scan, l->data, FALSE);
 	}
-		
-	while (!job_aborted (job) && 
-	       (dir = g_queue_pop_head (dirs)) != NULL) {
-		scan_dir (dir, source_info, job, dirs);
-		g_object_unref (dir);
+}
+
+/* Picks up the totals counted so far; returns TRUE if they are final */
+static gboolean
+source_info_sync (SourceInfo *source_info)
+{
+	SourceScan *scan;
+	gboolean done;
+
+	scan = source_info->scan;
+	if (scan == NULL) {
+		return TRUE;
 	}
 
-	/* Free all from queue if we exited early */
-	g_queue_foreach (dirs, (GFunc)g_object_unref, NULL);
-	g_queue_free (dirs);
+	g_mutex_lock (&scan->mutex);
+	source_info->num_files = scan->num_files;
+	source_info->num_bytes = scan->num_bytes;
+	done = scan->pending == 0;
+	g_mutex_unlock (&scan->mutex);
+
+	return done;
 }
 
+/* Stops the scan if it is still running */
 static void
-scan_sources (GList *files,
-	      SourceInfo *source_info,
-	      CommonJob *job,
-	      OpKind kind)
+scan_sources_finish (SourceInfo *source_info)
 {
-	GList *l;
-	GFile *file;
+	SourceScan *scan;
 
-	memset (source_info, 0, sizeof (SourceInfo));
-	source_info->op = kind;
+	scan = source_info->scan;
+	if (scan == NULL) {
+		return;
+	}
 
-	report_count_progress (job, source_info);
-	
-	for (l = files; l != NULL && !job_aborted (job); l = l->next) {
-		file = l->data;
+	g_atomic_int_set (&scan->stop, TRUE);
 
-		scan_file (file,
-			   source_info,
-			   job);
+	g_mutex_lock (&scan->mutex);
+	while (scan->pending > 0) {
+		g_cond_wait (&scan->done_cond, &scan->mutex);
 	}
+	g_mutex_unlock (&scan->mutex);
+
+	source_info_sync (source_info);
+	source_info->scan = NULL;
 
-	/* Make sure we report the final count */
-	report_count_progress (job, source_info);
+	g_thread_pool_free (scan->pool, FALSE, TRUE);
+	g_mutex_clear (&scan->mutex);
+	g_cond_clear (&scan->done_cond);
+	g_free (scan);
+}
+
+typedef enum {
+	FREE_SPACE_WARNING_CANCEL,
+	FREE_SPACE_WARNING_FORCE,
+	FREE_SPACE_WARNING_RETRY
+} FreeSpaceWarningResult;
+
+static FreeSpaceWarningResult
+run_free_space_warning (CommonJob *job,
+			GFile *dest,
+			guint64 size_difference)
+{
+	char *primary, *secondary, *details;
+	int response;
+
+	primary = f (_("Error while copying to “%B”."), dest);
+	secondary = f (_("There is not enough space on the destination. Try to remove files to make space."));
+	
+	details = f (_("%S more space is required to copy to the destination."), size_difference);
+	
+	response = run_warning (job,
+				primary,
+				secondary,
+				details,
+				FALSE,
+				GTK_STOCK_CANCEL,
+				COPY_FORCE,
+				RETRY,
+				NULL);
+	
+	if (response == 1) {
+		/* We are forced to copy */
+		return FREE_SPACE_WARNING_FORCE;
+	} else if (response == 2) {
+		return FREE_SPACE_WARNING_RETRY;
+	}
+
+	g_assert (response == 0 || response == GTK_RESPONSE_DELETE_EVENT);
+	abort_job (job);
+	return FREE_SPACE_WARNING_CANCEL;
 }
 
 static void
@@ -2749,7 +3120,6 @@ verify_destination (CommonJob *job,
 	GFileInfo *info, *fsinfo;
 	GError *error;
 	guint64 free_size;
-	guint64 size_difference;
 	char *primary, *secondary, *details;
 	int response;
 	GFileType file_type;
@@ -2861,30 +3231,14 @@ verify_destination (CommonJob *job,
 							      G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
 		
 		if (free_size < required_size) {
-			size_difference = required_size - free_size;
-			primary = f (_("Error while copying to “%B”."), dest);
-			secondary = f (_("There is not enough space on the destination. Try to remove files to make space."));
-			
-			details = f (_("%S more space is required to copy to the destination."), size_difference);
-			
-			response = run_warning (job,
-						primary,
-						secondary,
-						details,
-						FALSE,
-						GTK_STOCK_CANCEL,
-						COPY_FORCE,
-						RETRY,
-						NULL);
-			
-			if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-				abort_job (job);
-			} else if (response == 2) {
-				goto retry;
-			} else if (response == 1) {
-				/* We are forced to copy - just fall through ... */
-			} else {
-				g_assert_not_reached ();
+			switch (run_free_space_warning (job, dest, required_size - free_size)) {
+				case FREE_SPACE_WARNING_RETRY:
+					g_object_unref (fsinfo);
+					goto retry;
+				case FREE_SPACE_WARNING_FORCE:
+				case FREE_SPACE_WARNING_CANCEL:
+				default:
+					break;
 			}
 		}
 	}
@@ -2905,10 +3259,89 @@ verify_destination (CommonJob *job,
 		
 		g_error_free (error);
 
-		abort_job (job);
+		abort_job (job);
+	}
+	
+	g_object_unref (fsinfo);
+}
+
+/* While the sources are still being counted, verify_destination() can't
+ * know how much space is needed. The first check waits for the sizes of
+ * the sources themselves, which come quickly, since a single big file
+ * gives no other chance to check. After that the free space is checked
+ * again as the count grows, and once more when it is final.
+ */
+static void
+verify_free_space_while_scanning (CommonJob *job,
+				  GFile *dest,
+				  SourceInfo *source_info,
+				  TransferInfo *transfer_info)
+{
+	SourceScan *scan;
+	GFileInfo *fsinfo;
+	guint64 free_size;
+	goffset required_size;
+	gboolean done;
+
+	scan = source_info->scan;
+	if (scan == NULL || scan->free_space_check_done) {
+		return;
+	}
+
+	if (!scan->free_space_checked) {
+		g_mutex_lock (&scan->mutex);
+		while (scan->toplevel_pending > 0) {
+			g_cond_wait (&scan->done_cond, &scan->mutex);
+		}
+		g_mutex_unlock (&scan->mutex);
+
+		scan->free_space_checked = TRUE;
+		done = source_info_sync (source_info);
+	} else {
+		done = source_info_sync (source_info);
+		if (!done &&
+		    source_info->num_bytes < scan->free_space_checked_size + FREE_SPACE_CHECK_INTERVAL) {
+			return;
+		}
+	}
+	scan->free_space_checked_size = source_info->num_bytes;
+	scan->free_space_check_done = done;
+
+ retry:
+	/* What has been copied already takes up its space */
+	required_size = source_info->num_bytes - transfer_info->num_bytes;
+	if (required_size <= 0) {
+		return;
 	}
-	
+
+	fsinfo = g_file_query_filesystem_info (dest,
+					       G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
+					       job->cancellable,
+					       NULL);
+	if (fsinfo == NULL ||
+	    !g_file_info_has_attribute (fsinfo, G_FILE_ATTRIBUTE_FILESYSTEM_FREE)) {
+		/* Not going to get any better */
+		scan->free_space_check_done = TRUE;
+		g_clear_object (&fsinfo);
+		return;
+	}
+
+	free_size = g_file_info_get_attribute_uint64 (fsinfo,
+						      G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
 	g_object_unref (fsinfo);
+
+	if (free_size < (guint64) required_size) {
+		switch (run_free_space_warning (job, dest, required_size - free_size)) {
+			case FREE_SPACE_WARNING_RETRY:
+				source_info_sync (source_info);
+				goto retry;
+			case FREE_SPACE_WARNING_FORCE:
+			case FREE_SPACE_WARNING_CANCEL:
+			default:
+				scan->free_space_check_done = TRUE;
+				break;
+		}
+	}
 }
 
 static void
@@ -2916,16 +3349,19 @@ report_copy_progress (CopyMoveJob *copy_job,
 		      SourceInfo *source_info,
 		      TransferInfo *transfer_info)
 {
-	int files_left;
+	int files_left, file_number;
 	goffset total_size;
 	double elapsed, transfer_rate;
 	int remaining_time;
 	guint64 now;
 	CommonJob *job;
 	gboolean is_move;
+	gboolean counted;
 
 	job = (CommonJob *)copy_job;
 
+	wait_while_user_paused (job);
+
 	is_move = copy_job->is_move;
 	
 	now = g_get_monotonic_time ();
@@ -2935,6 +3371,10 @@ report_copy_progress (CopyMoveJob *copy_job,
 		return;
 	}
 	transfer_info->last_report_time = now;
+
+	/* While the sources are still being counted the totals only
+	 * grow, and so does the time left */
+	counted = source_info_sync (source_info);
 	
 	files_left = source_info->num_files - transfer_info->num_files;
 
@@ -2943,12 +3383,15 @@ report_copy_progress (CopyMoveJob *copy_job,
 		files_left = 1;
 	}
 
+	/* The copy can get ahead of the count, don't go past the end */
+	file_number = MIN (transfer_info->num_files + 1, source_info->num_files);
+
 	if (files_left != transfer_info->last_reported_files_left ||
 	    transfer_info->last_reported_files_left == 0) {
 		/* Avoid changing this unless files_left changed since last time */
 		transfer_info->last_reported_files_left = files_left;
 		
-		if (source_info->num_files == 1) {
+		if (counted && source_info->num_files == 1) {
 			if (copy_job->destination != NULL) {
 				nautilus_progress_info_take_status (job->progress,
 								    f (is_move ?
@@ -2971,14 +3414,14 @@ report_copy_progress (CopyMoveJob *copy_job,
 								       _("Moving file %'d of %'d (in “%B”) to “%B”")
 								       :
 								       _("Copying file %'d of %'d (in “%B”) to “%B”"),
-								       transfer_info->num_files + 1,
+								       file_number,
 								       source_info->num_files,
 								       (GFile *)copy_job->files->data,
 								       copy_job->destination));
 			} else {
 				nautilus_progress_info_take_status (job->progress,
 								    f (_("Duplicating file %'d of %'d (in “%B”)"),
-								       transfer_info->num_files + 1,
+								       file_number,
 								       source_info->num_files,
 								       (GFile *)copy_job->files->data));
 			}
@@ -2989,13 +3432,13 @@ report_copy_progress (CopyMoveJob *copy_job,
 								       _("Moving file %'d of %'d to “%B”")
 								       :
 								       _ ("Copying file %'d of %'d to “%B”"),
-								       transfer_info->num_files + 1,
+								       file_number,
 								       source_info->num_files,
 								       copy_job->destination));
 			} else {
 				nautilus_progress_info_take_status (job->progress,
 								    f (_("Duplicating file %'d of %'d"),
-								       transfer_info->num_files + 1,
+								       file_number,
 								       source_info->num_files));
 			}
 		}
@@ -3033,7 +3476,11 @@ report_copy_progress (CopyMoveJob *copy_job,
 		nautilus_progress_info_take_details (job->progress, s);
 	}
 
-	nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
+	if (!counted && transfer_info->num_bytes >= source_info->num_bytes) {
+		nautilus_progress_info_pulse_progress (job->progress);
+	} else {
+		nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
+	}
 }
 
 static int
@@ -3469,6 +3916,463 @@ create_dest_dir (CommonJob *job,
 	return CREATE_DEST_DIR_SUCCESS;
 }
 
+typedef enum {
+	LOCAL_COPY_DONE,
+	LOCAL_COPY_FAILED,
+	LOCAL_COPY_UNSUPPORTED
+} LocalCopyResult;
+
+static gssize
+local_copy_chunk (int src_fd,
+		  int dest_fd,
+		  gboolean use_sendfile)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	if (!use_sendfile) {
+		return copy_file_range (src_fd, NULL, dest_fd, NULL, LOCAL_COPY_CHUNK_SIZE, 0);
+	}
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+	return sendfile (dest_fd, src_fd, NULL, LOCAL_COPY_CHUNK_SIZE);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Copies a regular file between two local paths without the data going
+ * through userspace: a reflink clone where the file system can share
+ * the blocks (btrfs, XFS), else copy_file_range(), else sendfile().
+ *
+ * Returns LOCAL_COPY_UNSUPPORTED when g_file_copy() should do the copy
+ * instead: for anything but a new regular file, and for errors that
+ * g_file_copy() reports in its own way (so the callers' error handling
+ * sees the same errors as before). A partially written destination is
+ * only ever removed when this function created it.
+ */
+static LocalCopyResult
+local_copy_file (GFile *src,
+		 GFile *dest,
+		 GFileCopyFlags flags,
+		 GCancellable *cancellable,
+		 GFileProgressCallback progress_callback,
+		 gpointer progress_callback_data,
+		 GError **error)
+{
+	char *src_path, *dest_path;
+	int src_fd, dest_fd;
+	struct stat statbuf;
+	LocalCopyResult result;
+	goffset copied;
+	gssize res;
+	gboolean use_sendfile;
+	mode_t mode;
+	int errsv;
+
+	/* Replacing has its own semantics in g_file_copy(),
+	 * like making backups */
+	if (flags & G_FILE_COPY_OVERWRITE) {
+		return LOCAL_COPY_UNSUPPORTED;
+	}
+
+	src_path = g_file_get_path (src);
+	dest_path = g_file_get_path (dest);
+	result = LOCAL_COPY_UNSUPPORTED;
+	src_fd = -1;
+	dest_fd = -1;
+
+	if (src_path == NULL || dest_path == NULL) {
+		goto out;
+	}
+
+	src_fd = open (src_path, O_RDONLY | O_CLOEXEC |
+		       ((flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) ? O_NOFOLLOW : 0));
+	if (src_fd < 0 ||
+	    fstat (src_fd, &statbuf) != 0 ||
+	    !S_ISREG (statbuf.st_mode)) {
+		goto out;
+	}
+
+	mode = (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : (statbuf.st_mode & 0777);
+	dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+	if (dest_fd < 0) {
+		errsv = errno;
+		if (errsv == EEXIST) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+					     g_strerror (errsv));
+			result = LOCAL_COPY_FAILED;
+		}
+		goto out;
+	}
+
+	copied = 0;
+
+#ifdef FICLONE
+	if (ioctl (dest_fd, FICLONE, src_fd) == 0) {
+		copied = statbuf.st_size;
+		goto done;
+	}
+#endif
+
+	use_sendfile = FALSE;
+	for (;;) {
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			result = LOCAL_COPY_FAILED;
+			goto out_unlink;
+		}
+
+		res = local_copy_chunk (src_fd, dest_fd, use_sendfile);
+		errsv = errno;
+
+		if (res < 0 && errsv == EINTR) {
+			continue;
+		}
+
+		/* copy_file_range() can't do all file systems, and some
+		 * (like procfs) claim to be empty. Try sendfile() instead */
+		if (copied == 0 && !use_sendfile &&
+		    ((res < 0 && (errsv == EXDEV || errsv == ENOSYS ||
+				  errsv == EINVAL || errsv == EOPNOTSUPP)) ||
+		     (res == 0 && statbuf.st_size > 0))) {
+			use_sendfile = TRUE;
+			continue;
+		}
+
+		if (res < 0) {
+			if (copied == 0 && (errsv == EINVAL || errsv == ENOSYS)) {
+				result = LOCAL_COPY_UNSUPPORTED;
+			} else {
+				g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+						     g_strerror (errsv));
+				result = LOCAL_COPY_FAILED;
+			}
+			goto out_unlink;
+		}
+
+		if (res == 0) {
+			break;
+		}
+
+		copied += res;
+		if (progress_callback) {
+			progress_callback (copied, MAX (copied, statbuf.st_size),
+					   progress_callback_data);
+		}
+	}
+
+ done:
+	res = close (dest_fd);
+	dest_fd = -1;
+	if (res != 0) {
+		errsv = errno;
+		g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+				     g_strerror (errsv));
+		result = LOCAL_COPY_FAILED;
+		goto out_unlink;
+	}
+
+	if (progress_callback) {
+		progress_callback (copied, copied, progress_callback_data);
+	}
+
+	/* Same as g_file_copy(): failure to copy metadata is not a hard error */
+	g_file_copy_attributes (src, dest,
+				flags & (G_FILE_COPY_NOFOLLOW_SYMLINKS |
+					 G_FILE_COPY_ALL_METADATA |
+					 G_FILE_COPY_TARGET_DEFAULT_PERMS),
+				cancellable, NULL);
+
+	result = LOCAL_COPY_DONE;
+	goto out;
+
+ out_unlink:
+	if (dest_fd >= 0) {
+		close (dest_fd);
+		dest_fd = -1;
+	}
+	unlink (dest_path);
+
+ out:
+	if (src_fd >= 0) {
+		close (src_fd);
+	}
+	if (dest_fd >= 0) {
+		close (dest_fd);
+	}
+	g_free (src_path);
+	g_free (dest_path);
+
+	return result;
+}
+
+/* Small files are the worst case for copying one after the other: most
+ * of the time goes into opening, creating and closing files rather than
+ * moving data. So while copying a folder, regular files below
+ * CONCURRENT_COPY_MAX_SIZE are handed to a thread pool, and the job
+ * thread goes on with the next entry. Everything that needs the user
+ * (conflicts, errors) still happens on the job thread: a file that
+ * fails in a copy thread is simply copied again with copy_move_file(),
+ * which then runs the usual dialogs.
+ */
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GFile *dest_dir;
+	goffset size;
+	gboolean same_fs;
+	gboolean readonly_source_fs;
+	char **dest_fs_type;
+	gboolean *skipped_file;
+	int *dir_pending;
+	GError *error;
+} ConcurrentCopyItem;
+
+static void
+concurrent_copy_item_free (ConcurrentCopyItem *item)
+{
+	g_object_unref (item->src);
+	g_object_unref (item->dest);
+	g_object_unref (item->dest_dir);
+	g_clear_error (&item->error);
+	g_slice_free (ConcurrentCopyItem, item);
+}
+
+static gboolean
+concurrent_copy_file (GFile *src,
+		      GFile *dest,
+		      gboolean readonly_source_fs,
+		      GCancellable *cancellable,
+		      GError **error)
+{
+	GFileInputStream *in;
+	GFileOutputStream *out;
+	GFileCopyFlags flags;
+	gssize res;
+
+	flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+	if (readonly_source_fs) {
+		flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+	}
+
+	switch (local_copy_file (src, dest, flags, cancellable, NULL, NULL, error)) {
+		case LOCAL_COPY_DONE:
+			return TRUE;
+		case LOCAL_COPY_FAILED:
+			return FALSE;
+		case LOCAL_COPY_UNSUPPORTED:
+		default:
+			break;
+	}
+
+	in = g_file_read (src, cancellable, error);
+	if (in == NULL) {
+		return FALSE;
+	}
+
+	/* Never replace anything; if the file exists the job thread
+	 * takes care of the conflict.
+	 */
+	out = g_file_create (dest, G_FILE_CREATE_NONE, cancellable, error);
+	if (out == NULL) {
+		g_object_unref (in);
+		return FALSE;
+	}
+
+	res = g_output_stream_splice (G_OUTPUT_STREAM (out), G_INPUT_STREAM (in),
+				      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+				      G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+				      cancellable, error);
+	g_object_unref (in);
+	g_object_unref (out);
+
+	if (res < 0) {
+		/* We created the file, so it is ours to remove */
+		g_file_delete (dest, NULL, NULL);
+		return FALSE;
+	}
+
+	/* Same attributes as g_file_copy() would copy.
+	 * Ignore errors, as the serial copy does */
+	g_file_copy_attributes (src, dest, flags, cancellable, NULL);
+
+	return TRUE;
+}
+
+static void
+concurrent_copy_thread_func (gpointer data,
+			     gpointer user_data)
+{
+	ConcurrentCopyItem *item;
+	CopyMoveJob *copy_job;
+
+	item = data;
+	copy_job = user_data;
+
+	concurrent_copy_file (item->src, item->dest,
+			      item->readonly_source_fs,
+			      copy_job->common.cancellable,
+			      &item->error);
+
+	g_async_queue_push (copy_job->concurrent->results, item);
+}
+
+static void
+concurrent_copy_handle_result (CopyMoveJob *copy_job,
+			       ConcurrentCopyItem *item,
+			       SourceInfo *source_info,
+			       TransferInfo *transfer_info)
+{
+	CommonJob *job;
+
+	job = (CommonJob *)copy_job;
+
+	copy_job->concurrent->in_flight--;
+	(*item->dir_pending)--;
+
+	if (item->error == NULL) {
+		transfer_info->num_files ++;
+		transfer_info->num_bytes += item->size;
+		report_copy_progress (copy_job, source_info, transfer_info);
+
+		nautilus_file_changes_queue_file_added (item->dest);
+
+		if (job->undo_info != NULL) {
+			nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+									    item->src, item->dest);
+		}
+	} else if (job_aborted (job) || IS_IO_ERROR (item->error, CANCELLED)) {
+		*item->skipped_file = TRUE;
+	} else {
+		/* Let the serial copy deal with it, and ask the user if needed */
+		copy_move_file (copy_job, item->src, item->dest_dir, item->same_fs, FALSE,
+				item->dest_fs_type, source_info, transfer_info,
+				NULL, NULL, FALSE, item->skipped_file,
+				item->readonly_source_fs);
+	}
+
+	concurrent_copy_item_free (item);
+}
+
+static gboolean
+concurrent_copy_can_push (CopyMoveJob *copy_job,
+			  GFile *src,
+			  GFileInfo *info,
+			  GFile *dest_dir)
+{
+	if (copy_job->concurrent == NULL ||
+	    copy_job->target_name != NULL) {
+		return FALSE;
+	}
+
+	if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR ||
+	    g_file_info_get_size (info) > CONCURRENT_COPY_MAX_SIZE) {
+		return FALSE;
+	}
+
+	/* Trusted desktop files need extra care when copied to the desktop */
+	if (copy_job->desktop_location != NULL &&
+	    g_file_equal (copy_job->desktop_location, dest_dir)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+concurrent_copy_push (CopyMoveJob *copy_job,
+		      GFile *src,
+		      goffset size,
+		      GFile *dest_dir,
+		      gboolean same_fs,
+		      char **dest_fs_type,
+		      gboolean *skipped_file,
+		      gboolean readonly_source_fs,
+		      int *dir_pending,
+		      SourceInfo *source_info,
+		      TransferInfo *transfer_info)
+{
+	ConcurrentCopy *concurrent;
+	ConcurrentCopyItem *item;
+
+	concurrent = copy_job->concurrent;
+
+	item = g_slice_new0 (ConcurrentCopyItem);
+	item->src = g_object_ref (src);
+	item->dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+	item->dest_dir = g_object_ref (dest_dir);
+	item->size = size;
+	item->same_fs = same_fs;
+	item->readonly_source_fs = readonly_source_fs;
+	item->dest_fs_type = dest_fs_type;
+	item->skipped_file = skipped_file;
+	item->dir_pending = dir_pending;
+
+	while (concurrent->in_flight >= concurrent->max_in_flight) {
+		concurrent_copy_handle_result (copy_job,
+					       g_async_queue_pop (concurrent->results),
+					       source_info, transfer_info);
+	}
+
+	concurrent->in_flight++;
+	(*dir_pending)++;
+	g_thread_pool_push (concurrent->pool, item, NULL);
+
+	while ((item = g_async_queue_try_pop (concurrent->results)) != NULL) {
+		concurrent_copy_handle_result (copy_job, item,
+					       source_info, transfer_info);
+	}
+}
+
+/* Waits until all files pushed for one folder are done. Results for
+ * other folders that come in meanwhile are handled as well.
+ */
+static void
+concurrent_copy_wait (CopyMoveJob *copy_job,
+		      int *dir_pending,
+		      SourceInfo *source_info,
+		      TransferInfo *transfer_info)
+{
+	while (*dir_pending > 0) {
+		concurrent_copy_handle_result (copy_job,
+					       g_async_queue_pop (copy_job->concurrent->results),
+					       source_info, transfer_info);
+	}
+}
+
+static ConcurrentCopy *
+concurrent_copy_new (CopyMoveJob *copy_job)
+{
+	ConcurrentCopy *concurrent;
+	GSettings *prefs;
+	int n_threads;
+
+	prefs = g_settings_new ("org.gnome.nautilus.preferences");
+	n_threads = g_settings_get_int (prefs, NAUTILUS_PREFERENCES_CONCURRENT_COPIES);
+	g_object_unref (prefs);
+
+	if (n_threads <= 1) {
+		return NULL;
+	}
+
+	concurrent = g_new0 (ConcurrentCopy, 1);
+	concurrent->results = g_async_queue_new ();
+	concurrent->max_in_flight = 4 * n_threads;
+	concurrent->pool = g_thread_pool_new (concurrent_copy_thread_func,
+					      copy_job, n_threads, FALSE, NULL);
+
+	return concurrent;
+}
+
+static void
+concurrent_copy_free (ConcurrentCopy *concurrent)
+{
+	g_assert (concurrent->in_flight == 0);
+
+	g_thread_pool_free (concurrent->pool, FALSE, TRUE);
+	g_async_queue_unref (concurrent->results);
+	g_free (concurrent);
+}
+
 /* a return value of FALSE means retry, i.e.
  * the destination has changed and the source
  * is expected to re-try the preceeding
@@ -3495,10 +4399,10 @@ copy_move_directory (CopyMoveJob *copy_job,
 	char *primary, *secondary, *details;
 	char *dest_fs_type;
 	int response;
-	gboolean skip_error;
 	gboolean local_skipped_file;
 	CommonJob *job;
 	GFileCopyFlags flags;
+	int pending_files;
 
 	job = (CommonJob *)copy_job;
 	
@@ -3528,12 +4432,14 @@ copy_move_directory (CopyMoveJob *copy_job,
 
 	local_skipped_file = FALSE;
 	dest_fs_type = NULL;
-	
-	skip_error = should_skip_readdir_error (job, src);
+	pending_files = 0;
+
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (src,
-						G_FILE_ATTRIBUTE_STANDARD_NAME,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						job->cancellable,
 						&error);
@@ -3541,17 +4447,31 @@ copy_move_directory (CopyMoveJob *copy_job,
 		error = NULL;
 
 		while (!job_aborted (job) &&
-		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error)) != NULL) {
+		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL) {
 			src_file = g_file_get_child (src,
 						     g_file_info_get_name (info));
-			copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-					source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-					readonly_source_fs);
+			if (concurrent_copy_can_push (copy_job, src_file, info, *dest)) {
+				concurrent_copy_push (copy_job, src_file, g_file_info_get_size (info),
+						      *dest, same_fs, &dest_fs_type, &local_skipped_file,
+						      readonly_source_fs, &pending_files,
+						      source_info, transfer_info);
+			} else {
+				copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+						source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+						readonly_source_fs);
+			}
 			g_object_unref (src_file);
 			g_object_unref (info);
 		}
 		g_file_enumerator_close (enumerator, job->cancellable, NULL);
 		g_object_unref (enumerator);
+
+		/* The folder must be complete before its attributes
+		 * (and so its modification time) are copied */
+		if (copy_job->concurrent != NULL) {
+			concurrent_copy_wait (copy_job, &pending_files,
+					      source_info, transfer_info);
+		}
 		
 		if (error && IS_IO_ERROR (error, CANCELLED)) {
 			g_error_free (error);
@@ -4071,9 +4991,9 @@ copy_move_file (CopyMoveJob *copy_job,
 	gboolean handled_invalid_filename;
 
 	job = (CommonJob *)copy_job;
-	
-	if (should_skip_file (job, src)) {
-		*skipped_file = TRUE;
+
+	verify_free_space_while_scanning (job, dest_dir, source_info, transfer_info);
+	if (job_aborted (job)) {
 		return;
 	}
 
@@ -4185,12 +5105,28 @@ copy_move_file (CopyMoveJob *copy_job,
 				   &pdata,
 				   &error);
 	} else {
-		res = g_file_copy (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
+		switch (local_copy_file (src, dest,
+					 flags,
+					 job->cancellable,
+					 copy_file_progress_callback,
+					 &pdata,
+					 &error)) {
+			case LOCAL_COPY_DONE:
+				res = TRUE;
+				break;
+			case LOCAL_COPY_FAILED:
+				res = FALSE;
+				break;
+			case LOCAL_COPY_UNSUPPORTED:
+			default:
+				res = g_file_copy (src, dest,
+						   flags,
+						   job->cancellable,
+						   copy_file_progress_callback,
+						   &pdata,
+						   &error);
+				break;
+		}
 	}
 	
 	if (res) {
@@ -4580,13 +5516,11 @@ copy_job (GIOSchedulerJob *io_job,
 	
 	nautilus_progress_info_start (job->common.progress);
 	
-	scan_sources (job->files,
-		      &source_info,
-		      common,
-		      OP_KIND_COPY);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
+	/* Start right away, and count the sources meanwhile */
+	scan_sources_start (job->files,
+			    &source_info,
+			    common,
+			    OP_KIND_COPY);
 
 	if (job->destination) {
 		dest = g_object_ref (job->destination);
@@ -4600,7 +5534,7 @@ copy_job (GIOSchedulerJob *io_job,
 	verify_destination (&job->common,
 			    dest,
 			    &dest_fs_id,
-			    source_info.num_bytes);
+			    -1);
 	g_object_unref (dest);
 	if (job_aborted (common)) {
 		goto aborted;
@@ -4609,11 +5543,17 @@ copy_job (GIOSchedulerJob *io_job,
 	g_timer_start (job->common.time);
 	
 	memset (&transfer_info, 0, sizeof (transfer_info));
+	job->concurrent = concurrent_copy_new (job);
 	copy_files (job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
+	if (job->concurrent != NULL) {
+		concurrent_copy_free (job->concurrent);
+		job->concurrent = NULL;
+	}
 
  aborted:
+	scan_sources_finish (&source_info);
 	
 	g_free (dest_fs_id);
 	
@@ -4655,11 +5595,7 @@ nautilus_file_operations_copy_file (GFile *source_file,
 
 	inhibit_power_manager ((CommonJob *)job, _("Copying Files"));
 
-	g_io_scheduler_push_job (copy_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, target_dir, copy_job);
 }
 
 void
@@ -4700,11 +5636,7 @@ nautilus_file_operations_copy (GList *files,
 		g_object_unref (src_dir);
 	}
 
-	g_io_scheduler_push_job (copy_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, target_dir, copy_job);
 }
 
 static void
@@ -4713,6 +5645,8 @@ report_move_progress (CopyMoveJob *move_job, int total, int left)
 	CommonJob *job;
 
 	job = (CommonJob *)move_job;
+
+	wait_while_user_paused (job);
 	
 	nautilus_progress_info_take_status (job->progress,
 					    f (_("Preparing to Move to “%B”"),
@@ -5140,6 +6074,7 @@ move_job (GIOSchedulerJob *io_job,
 	dest_fs_type = NULL;
 
 	fallbacks = NULL;
+	memset (&source_info, 0, sizeof (source_info));
 	
 	nautilus_progress_info_start (job->common.progress);
 	
@@ -5158,27 +6093,15 @@ move_job (GIOSchedulerJob *io_job,
 	}
 
 	/* The rest we need to do deep copy + delete behind on,
-	   so scan for size */
+	   so scan for size while doing it */
 
 	fallback_files = get_files_from_fallbacks (fallbacks);
-	scan_sources (fallback_files,
-		      &source_info,
-		      common,
-		      OP_KIND_MOVE);
+	scan_sources_start (fallback_files,
+			    &source_info,
+			    common,
+			    OP_KIND_MOVE);
 	
 	g_list_free (fallback_files);
-	
-	if (job_aborted (common)) {
-		goto aborted;
-	}
-
-	verify_destination (&job->common,
-			    job->destination,
-			    NULL,
-			    source_info.num_bytes);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
 
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	move_files (job,
@@ -5187,6 +6110,7 @@ move_job (GIOSchedulerJob *io_job,
 		    &source_info, &transfer_info);
 
  aborted:
+	scan_sources_finish (&source_info);
 	g_list_free_full (fallbacks, g_free);
 
 	g_free (dest_fs_id);
@@ -5245,11 +6169,7 @@ nautilus_file_operations_move (GList *files,
 		g_object_unref (src_dir);
 	}
 
-	g_io_scheduler_push_job (move_job,
-				 job,
-				 NULL, /* destroy notify */
-				 0,
-				 job->common.cancellable);
+	schedule_move_job ((CommonJob *)job, files->data, target_dir, move_job);
 }
 
 static void
@@ -5561,11 +6481,7 @@ nautilus_file_operations_link (GList *files,
 		g_object_unref (src_dir);
 	}
 
-	g_io_scheduler_push_job (link_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, NULL, link_job);
 }
 
 
@@ -5603,11 +6519,7 @@ nautilus_file_operations_duplicate (GList *files,
 		g_object_unref (src_dir);
 	}
 
-	g_io_scheduler_push_job (copy_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, files->data, copy_job);
 }
 
 static gboolean
@@ -5769,11 +6681,7 @@ nautilus_file_set_permissions_recursive (const char *directory,
 								     dir_permissions, dir_mask);
 	}
 
-	g_io_scheduler_push_job (set_permissions_job,
-			   job,
-			   NULL,
-			   0,
-			   NULL);
+	schedule_job ((CommonJob *)job, NULL, set_permissions_job);
 }
 
 static GList *
@@ -6251,11 +7159,7 @@ nautilus_file_operations_new_folder (GtkWidget *parent_view,
 		job->common.undo_info = nautilus_file_undo_info_create_new (NAUTILUS_FILE_UNDO_OP_CREATE_FOLDER);
 	}
 
-	g_io_scheduler_push_job (create_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, NULL, create_job);
 }
 
 void 
@@ -6293,11 +7197,7 @@ nautilus_file_operations_new_file_from_template (GtkWidget *parent_view,
 		job->common.undo_info = nautilus_file_undo_info_create_new (NAUTILUS_FILE_UNDO_OP_CREATE_FILE_FROM_TEMPLATE);
 	}
 
-	g_io_scheduler_push_job (create_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, NULL, create_job);
 }
 
 void 
@@ -6334,11 +7234,7 @@ nautilus_file_operations_new_file (GtkWidget *parent_view,
 		job->common.undo_info = nautilus_file_undo_info_create_new (NAUTILUS_FILE_UNDO_OP_CREATE_EMPTY_FILE);
 	}
 
-	g_io_scheduler_push_job (create_job,
-			   job,
-			   NULL, /* destroy notify */
-			   0,
-			   job->common.cancellable);
+	schedule_job ((CommonJob *)job, NULL, create_job);
 }
 
 
@@ -6456,11 +7352,7 @@ nautilus_file_operations_empty_trash (GtkWidget *parent_view)
 
 	inhibit_power_manager ((CommonJob *)job, _("Emptying Trash"));
 	
-	g_io_scheduler_push_job (empty_trash_job,
-			   job,
-			   NULL,
-			   0,
-			   NULL);
+	schedule_job ((CommonJob *)job, NULL, empty_trash_job);
 }
 
 static gboolean
@@ -6680,11 +7572,7 @@ nautilus_file_mark_desktop_file_trusted (GFile *file,
 	job->done_callback = done_callback;
 	job->done_callback_data = done_callback_data;
 	
-	g_io_scheduler_push_job (mark_trusted_job,
-				 job,
-				 NULL,
-				 0,
-				 NULL);
+	schedule_job ((CommonJob *)job, NULL, mark_trusted_job);
 }
 
 #if !defined (NAUTILUS_OMIT_SELF_CHECK)
@@ -27,6 +27,7 @@
 
 #include <libnautilus-private/nautilus-directory.h>
 #include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-table.h>
 #include <libnautilus-private/nautilus-monitor.h>
 #include <libnautilus-private/nautilus-file-undo-operations.h>
 #include <eel/eel-glib-extensions.h>
@@ -52,12 +53,59 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+/* Details only directories have. Allocated the first time one of
+ * them is set, see nautilus_file_ensure_folder_details().
+ */
+typedef struct {
+	guint deep_directory_count;
+	guint deep_file_count;
+	guint deep_unreadable_count;
+	goffset deep_size;
+
+	GList *mime_list; /* The list of MIME types in the directory. */
+
+	guint64 free_space; /* (guint)-1 for unknown */
+	time_t free_space_read; /* The time free_space was updated, or 0 for never */
+} NautilusFileFolderDetails;
+
+/* Details most files never have. Allocated the first time one of
+ * them is set, see nautilus_file_ensure_extra_details().
+ */
+typedef struct {
+	eel_ref_str selinux_context;
+	eel_ref_str description;
+
+	char *top_left_text;
+
+	/* Info you might get from a link (.desktop, .directory or nautilus link) */
+	GIcon *custom_icon;
+	char *activation_uri;
+
+	char *trash_orig_path;
+	time_t trash_time; /* 0 is unknown */
+
+	/* File operations in progress */
+	GList *operations_in_progress;
+
+	/* Emblems provided by extensions */
+	GList *extension_emblems;
+	GList *pending_extension_emblems;
+
+	/* Attributes provided by extensions */
+	GHashTable *extension_attributes;
+	GHashTable *pending_extension_attributes;
+} NautilusFileExtraDetails;
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
 	
 	eel_ref_str name;
 
+	/* Where the file is in the file table, changed by the main
+	 * thread under the table lock */
+	NautilusFileTableEntry table_entry;
+
 	/* File info: */
 	GFileType type;
 
@@ -84,58 +132,32 @@ struct NautilusFileDetails
 	
 	eel_ref_str mime_type;
 	
-	char *selinux_context;
-	char *description;
-	
 	GError *get_info_error;
 	
 	guint directory_count;
 
-	guint deep_directory_count;
-	guint deep_file_count;
-	guint deep_unreadable_count;
-	goffset deep_size;
-
 	GIcon *icon;
 	
 	char *thumbnail_path;
 	GdkPixbuf *thumbnail;
 	time_t thumbnail_mtime;
-	
-	GList *mime_list; /* If this is a directory, the list of MIME types in it. */
-	char *top_left_text;
-
-	/* Info you might get from a link (.desktop, .directory or nautilus link) */
-	GIcon *custom_icon;
-	char *activation_uri;
 
 	/* used during DND, for checking whether source and destination are on
 	 * the same file system.
 	 */
 	eel_ref_str filesystem_id;
 
-	char *trash_orig_path;
-
-	/* The following is for file operations in progress. Since
-	 * there are normally only a few of these, we can move them to
-	 * a separate hash table or something if required to keep the
-	 * file objects small.
-	 */
-	GList *operations_in_progress;
-
 	/* NautilusInfoProviders that need to be run for this file */
 	GList *pending_info_providers;
 
-	/* Emblems provided by extensions */
-	GList *extension_emblems;
-	GList *pending_extension_emblems;
-
-	/* Attributes provided by extensions */
-	GHashTable *extension_attributes;
-	GHashTable *pending_extension_attributes;
-
 	GHashTable *metadata;
 
+	/* NULL until needed, read them with NAUTILUS_FILE_FOLDER_DETAILS()
+	 * and NAUTILUS_FILE_EXTRA_DETAILS() which give the defaults for NULL.
+	 */
+	NautilusFileFolderDetails *folder;
+	NautilusFileExtraDetails *extra;
+
 	/* Mount for mountpoint or the references GMount for a "mountable" */
 	GMount *mount;
 	GMount *parent_mount;
@@ -219,14 +241,19 @@ struct NautilusFileDetails
 	eel_boolean_bit filesystem_use_preview        : 2; /* GFilesystemPreviewType */
 	eel_boolean_bit filesystem_info_is_up_to_date : 1;
 
-	time_t trash_time; /* 0 is unknown */
-
 	gdouble search_relevance;
-
-	guint64 free_space; /* (guint)-1 for unknown */
-	time_t free_space_read; /* The time free_space was updated, or 0 for never */
 };
 
+extern const NautilusFileFolderDetails nautilus_file_default_folder_details;
+extern const NautilusFileExtraDetails nautilus_file_default_extra_details;
+
+#define NAUTILUS_FILE_FOLDER_DETAILS(file) \
+	((const NautilusFileFolderDetails *) ((file)->details->folder != NULL ? \
+					      (file)->details->folder : &nautilus_file_default_folder_details))
+#define NAUTILUS_FILE_EXTRA_DETAILS(file) \
+	((const NautilusFileExtraDetails *) ((file)->details->extra != NULL ? \
+					     (file)->details->extra : &nautilus_file_default_extra_details))
+
 typedef struct {
 	NautilusFile *file;
 	GCancellable *cancellable;
@@ -253,6 +280,13 @@ gboolean      nautilus_file_get_date                       (NautilusFile
 							    time_t                 *date);
 void          nautilus_file_updated_deep_count_in_progress (NautilusFile           *file);
 
+/* Allocate the cold details on first use, to set them */
+NautilusFileFolderDetails *nautilus_file_ensure_folder_details (NautilusFile *file);
+NautilusFileExtraDetails  *nautilus_file_ensure_extra_details  (NautilusFile *file);
+
+/* Prints the memory the live files use, with the File debug flag */
+void          nautilus_file_dump_memory_usage              (void);
+
 
 void          nautilus_file_clear_info                     (NautilusFile           *file);
 /* Compare file's state with a fresh file info struct, return FALSE if
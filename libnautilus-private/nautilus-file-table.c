@@ -0,0 +1,215 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-file-table.c: Table of the known files by location, usable
+   from any thread.
+
+   Copyright (C) 2014 Endless Mobile, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+#include "nautilus-file-table.h"
+
+#include "nautilus-file-private.h"
+
+#include <string.h>
+
+/* A power of two */
+#define FILE_TABLE_SHARDS 32
+
+/* The GWeakRef of an entry is cleared when the file is finalized,
+ * before it leaves the table */
+typedef NautilusFileTableEntry FileTableEntry;
+
+typedef struct {
+	GRWLock lock;
+	GHashTable *entries;
+} FileTableShard;
+
+static FileTableShard shards[FILE_TABLE_SHARDS];
+
+static guint
+entry_hash (gconstpointer key)
+{
+	const FileTableEntry *entry = key;
+
+	return entry->hash;
+}
+
+static gboolean
+entry_equal (gconstpointer a,
+	     gconstpointer b)
+{
+	const FileTableEntry *entry_a = a;
+	const FileTableEntry *entry_b = b;
+
+	return entry_a->hash == entry_b->hash &&
+		strcmp (entry_a->name, entry_b->name) == 0 &&
+		strcmp (entry_a->directory_uri, entry_b->directory_uri) == 0;
+}
+
+static guint
+get_hash (const char *directory_uri,
+	  const char *name)
+{
+	return g_str_hash (directory_uri) * 33 + g_str_hash (name);
+}
+
+static FileTableShard *
+get_shard (guint hash)
+{
+	static gsize initialized = 0;
+	int i;
+
+	if (g_once_init_enter (&initialized)) {
+		for (i = 0; i < FILE_TABLE_SHARDS; i++) {
+			g_rw_lock_init (&shards[i].lock);
+			shards[i].entries = g_hash_table_new (entry_hash, entry_equal);
+		}
+		g_once_init_leave (&initialized, 1);
+	}
+
+	/* The low bits also pick the bucket inside the shard */
+	return &shards[(hash >> 16) & (FILE_TABLE_SHARDS - 1)];
+}
+
+/* Takes entry out of its shard, if it is still the one there */
+static void
+remove_entry (FileTableEntry *entry)
+{
+	FileTableShard *shard;
+
+	shard = get_shard (entry->hash);
+
+	g_rw_lock_writer_lock (&shard->lock);
+	if (g_hash_table_lookup (shard->entries, entry) == entry) {
+		g_hash_table_remove (shard->entries, entry);
+	}
+	g_rw_lock_writer_unlock (&shard->lock);
+
+	/* Nobody can find it anymore */
+	g_weak_ref_set (&entry->file, NULL);
+	eel_ref_str_unref (entry->directory_uri);
+	eel_ref_str_unref (entry->name);
+	entry->directory_uri = NULL;
+	entry->name = NULL;
+}
+
+void
+nautilus_file_table_insert (eel_ref_str   directory_uri,
+			    NautilusFile *file)
+{
+	FileTableShard *shard;
+	FileTableEntry *entry;
+
+	g_return_if_fail (directory_uri != NULL);
+	g_return_if_fail (file->details->name != NULL);
+
+	entry = &file->details->table_entry;
+	if (entry->directory_uri != NULL) {
+		remove_entry (entry);
+	}
+
+	entry->directory_uri = eel_ref_str_ref (directory_uri);
+	entry->name = eel_ref_str_ref (file->details->name);
+	entry->hash = get_hash (entry->directory_uri, entry->name);
+	g_weak_ref_set (&entry->file, file);
+
+	shard = get_shard (entry->hash);
+
+	g_rw_lock_writer_lock (&shard->lock);
+	g_hash_table_replace (shard->entries, entry, entry);
+	g_rw_lock_writer_unlock (&shard->lock);
+}
+
+void
+nautilus_file_table_remove (eel_ref_str   directory_uri,
+			    NautilusFile *file)
+{
+	FileTableEntry *entry;
+
+	entry = &file->details->table_entry;
+	if (entry->directory_uri == NULL ||
+	    entry->directory_uri != directory_uri) {
+		return;
+	}
+
+	remove_entry (entry);
+}
+
+NautilusFile *
+nautilus_file_table_lookup (const char *uri)
+{
+	FileTableShard *shard;
+	FileTableEntry key, *entry;
+	NautilusFile *file;
+	GFile *location, *parent;
+	char *directory_uri, *name;
+
+	g_return_val_if_fail (uri != NULL, NULL);
+
+	/* Split the URI the way the directories and files are made */
+	location = g_file_new_for_uri (uri);
+	parent = g_file_get_parent (location);
+	if (parent == NULL) {
+		g_object_unref (location);
+		return NULL;
+	}
+
+	directory_uri = g_file_get_uri (parent);
+	name = g_file_get_basename (location);
+	g_object_unref (parent);
+	g_object_unref (location);
+
+	key.directory_uri = directory_uri;
+	key.name = name;
+	key.hash = get_hash (directory_uri, name);
+
+	shard = get_shard (key.hash);
+
+	file = NULL;
+	g_rw_lock_reader_lock (&shard->lock);
+	entry = g_hash_table_lookup (shard->entries, &key);
+	if (entry != NULL) {
+		/* NULL if the file is being finalized */
+		file = g_weak_ref_get (&entry->file);
+	}
+	g_rw_lock_reader_unlock (&shard->lock);
+
+	g_free (directory_uri);
+	g_free (name);
+
+	return file;
+}
+
+static gboolean
+release_file_idle (gpointer data)
+{
+	nautilus_file_unref (data);
+
+	return FALSE;
+}
+
+void
+nautilus_file_table_release (NautilusFile *file)
+{
+	if (g_main_context_is_owner (g_main_context_default ())) {
+		nautilus_file_unref (file);
+	} else {
+		g_idle_add (release_file_idle, file);
+	}
+}
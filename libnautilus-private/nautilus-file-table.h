@@ -0,0 +1,67 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-file-table.h: Table of the known files by location, usable
+   from any thread.
+
+   Copyright (C) 2014 Endless Mobile, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef NAUTILUS_FILE_TABLE_H
+#define NAUTILUS_FILE_TABLE_H
+
+#include <eel/eel-string.h>
+#include "nautilus-file.h"
+
+/* Mirrors the file hash tables of the directories: every file that is
+ * in its directory's table is also here, keyed by the interned URI of
+ * the directory and the file name. The table is split in shards with
+ * their own read-write lock, and holds weak references, so threads can
+ * look files up and ref them while the main thread changes the table.
+ *
+ * Only the directory code changes the table, from the main thread.
+ * Main thread code looks files up through their directory instead.
+ */
+
+/* Kept in each file, so that the table costs no allocation per file.
+ * Only nautilus-file-table.c looks inside. */
+typedef struct {
+	eel_ref_str directory_uri; /* NULL when not in the table */
+	eel_ref_str name;
+	guint hash;
+	GWeakRef file;
+} NautilusFileTableEntry;
+
+void           nautilus_file_table_insert  (eel_ref_str   directory_uri,
+					    NautilusFile *file);
+void           nautilus_file_table_remove  (eel_ref_str   directory_uri,
+					    NautilusFile *file);
+
+/* Returns a new reference to the known file at uri, or NULL. Can be
+ * called from any thread. Files that represent a directory with no
+ * parent are not in the table.
+ *
+ * Drop the reference with nautilus_file_table_release(), never with
+ * nautilus_file_unref() from another thread: finalizing a file changes
+ * its directory, which only the main thread may do. */
+NautilusFile * nautilus_file_table_lookup  (const char   *uri);
+
+/* Drops a reference returned by nautilus_file_table_lookup(), from the
+ * main loop unless called on the main thread. */
+void           nautilus_file_table_release (NautilusFile *file);
+
+#endif /* NAUTILUS_FILE_TABLE_H */
@@ -95,6 +95,9 @@
 #define SORT_LAST_CHAR1 '.'
 #define SORT_LAST_CHAR2 '#'
 
+/* What g_utf8_collate_key_for_filename() puts before dots and numbers */
+#define COLLATION_SENTINEL "\1\1\1"
+
 /* Name of Nautilus trash directories */
 #define TRASH_DIRECTORY_NAME ".Trash"
 
@@ -169,15 +172,117 @@ G_DEFINE_TYPE_WITH_CODE (NautilusFile, nautilus_file, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_FILE_INFO,
 						nautilus_file_info_iface_init));
 
+const NautilusFileFolderDetails nautilus_file_default_folder_details = {
+	.free_space = -1
+};
+const NautilusFileExtraDetails nautilus_file_default_extra_details = { 0 };
+
+/* For nautilus_file_dump_memory_usage() */
+static volatile gint n_live_files;
+static volatile gint n_folder_details;
+static volatile gint n_extra_details;
+
 static void
 nautilus_file_init (NautilusFile *file)
 {
 	file->details = G_TYPE_INSTANCE_GET_PRIVATE ((file), NAUTILUS_TYPE_FILE, NautilusFileDetails);
 
+	g_atomic_int_inc (&n_live_files);
+
 	nautilus_file_clear_info (file);
 	nautilus_file_invalidate_extension_info_internal (file);
+}
+
+NautilusFileFolderDetails *
+nautilus_file_ensure_folder_details (NautilusFile *file)
+{
+	if (file->details->folder == NULL) {
+		file->details->folder = g_slice_new (NautilusFileFolderDetails);
+		*file->details->folder = nautilus_file_default_folder_details;
+		g_atomic_int_inc (&n_folder_details);
+	}
+
+	return file->details->folder;
+}
+
+NautilusFileExtraDetails *
+nautilus_file_ensure_extra_details (NautilusFile *file)
+{
+	if (file->details->extra == NULL) {
+		file->details->extra = g_slice_new0 (NautilusFileExtraDetails);
+		g_atomic_int_inc (&n_extra_details);
+	}
+
+	return file->details->extra;
+}
+
+static void
+folder_details_free (NautilusFileFolderDetails *folder)
+{
+	g_list_free_full (folder->mime_list, g_free);
+
+	g_slice_free (NautilusFileFolderDetails, folder);
+	g_atomic_int_add (&n_folder_details, -1);
+}
+
+static void
+extra_details_free (NautilusFileExtraDetails *extra)
+{
+	g_assert (extra->operations_in_progress == NULL);
 
-	file->details->free_space = -1;
+	eel_ref_str_unref (extra->selinux_context);
+	eel_ref_str_unref (extra->description);
+	g_free (extra->top_left_text);
+	g_free (extra->activation_uri);
+	g_clear_object (&extra->custom_icon);
+	g_free (extra->trash_orig_path);
+
+	g_list_free_full (extra->pending_extension_emblems, g_free);
+	g_list_free_full (extra->extension_emblems, g_free);
+
+	if (extra->pending_extension_attributes) {
+		g_hash_table_destroy (extra->pending_extension_attributes);
+	}
+	if (extra->extension_attributes) {
+		g_hash_table_destroy (extra->extension_attributes);
+	}
+
+	g_slice_free (NautilusFileExtraDetails, extra);
+	g_atomic_int_add (&n_extra_details, -1);
+}
+
+void
+nautilus_file_dump_memory_usage (void)
+{
+	EelRefStrStats stats;
+	gsize file_size, inline_size;
+	gint n_files, n_folders, n_extras;
+
+	n_files = g_atomic_int_get (&n_live_files);
+	n_folders = g_atomic_int_get (&n_folder_details);
+	n_extras = g_atomic_int_get (&n_extra_details);
+
+	/* The private details are allocated with the instance */
+	file_size = sizeof (NautilusFile) + sizeof (NautilusFileDetails);
+	/* What a file took with all the details inline */
+	inline_size = file_size
+		+ sizeof (NautilusFileFolderDetails) + sizeof (NautilusFileExtraDetails)
+		- 2 * sizeof (gpointer);
+
+	DEBUG ("%d files, %d with folder details (%" G_GSIZE_FORMAT " bytes), "
+	       "%d with extra details (%" G_GSIZE_FORMAT " bytes)",
+	       n_files, n_folders, sizeof (NautilusFileFolderDetails),
+	       n_extras, sizeof (NautilusFileExtraDetails));
+	DEBUG ("Bytes per file: %" G_GSIZE_FORMAT " with inline details, %.1f now",
+	       inline_size,
+	       n_files == 0 ? (gdouble) file_size :
+	       file_size + ((gdouble) n_folders * sizeof (NautilusFileFolderDetails) +
+			    (gdouble) n_extras * sizeof (NautilusFileExtraDetails)) / n_files);
+
+	eel_ref_str_get_unique_stats (&stats);
+	DEBUG ("Interned strings: %u using %" G_GSIZE_FORMAT " bytes, "
+	       "%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " lookups shared",
+	       stats.n_strings, stats.n_bytes, stats.n_shared, stats.n_lookups);
 }
 
 static GObject*
@@ -246,8 +351,9 @@ nautilus_file_set_display_name (NautilusFile *file,
 			file->details->display_name = eel_ref_str_new (display_name);
 		}
 		
+		/* Made again when the name is first compared */
 		g_free (file->details->display_name_collation_key);
-		file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		file->details->display_name_collation_key = NULL;
 	}
 
 	if (g_strcmp0 (eel_ref_str_peek (file->details->edit_name), edit_name) != 0) {
@@ -435,10 +541,17 @@ nautilus_file_clear_info (NautilusFile *file)
 		nautilus_file_clear_display_name (file);
 	}
 
-	if (!file->details->got_custom_activation_uri &&
-	    file->details->activation_uri != NULL) {
-		g_free (file->details->activation_uri);
-		file->details->activation_uri = NULL;
+	if (file->details->extra != NULL) {
+		if (!file->details->got_custom_activation_uri) {
+			g_free (file->details->extra->activation_uri);
+			file->details->extra->activation_uri = NULL;
+		}
+
+		file->details->extra->trash_time = 0;
+		eel_ref_str_unref (file->details->extra->selinux_context);
+		file->details->extra->selinux_context = NULL;
+		eel_ref_str_unref (file->details->extra->description);
+		file->details->extra->description = NULL;
 	}
 	
 	if (file->details->icon != NULL) {
@@ -479,15 +592,10 @@ nautilus_file_clear_info (NautilusFile *file)
 	file->details->sort_order = 0;
 	file->details->mtime = 0;
 	file->details->atime = 0;
-	file->details->trash_time = 0;
 	g_free (file->details->symlink_name);
 	file->details->symlink_name = NULL;
 	eel_ref_str_unref (file->details->mime_type);
 	file->details->mime_type = NULL;
-	g_free (file->details->selinux_context);
-	file->details->selinux_context = NULL;
-	g_free (file->details->description);
-	file->details->description = NULL;
 	eel_ref_str_unref (file->details->owner);
 	file->details->owner = NULL;
 	eel_ref_str_unref (file->details->owner_real);
@@ -721,7 +829,7 @@ nautilus_file_get_existing_by_uri (const char *uri)
 {
 	GFile *location;
 	NautilusFile *file;
-	
+
 	location = g_file_new_for_uri (uri);
 	file = nautilus_file_get_internal (location, FALSE);
 	g_object_unref (location);
@@ -757,8 +865,6 @@ finalize (GObject *object)
 
 	file = NAUTILUS_FILE (object);
 
-	g_assert (file->details->operations_in_progress == NULL);
-
 	if (file->details->is_thumbnailing) {
 		uri = nautilus_file_get_uri (file);
 		nautilus_thumbnail_remove_from_queue (uri);
@@ -797,11 +903,6 @@ finalize (GObject *object)
 	eel_ref_str_unref (file->details->owner);
 	eel_ref_str_unref (file->details->owner_real);
 	eel_ref_str_unref (file->details->group);
-	g_free (file->details->selinux_context);
-	g_free (file->details->description);
-	g_free (file->details->top_left_text);
-	g_free (file->details->activation_uri);
-	g_clear_object (&file->details->custom_icon);
 
 	if (file->details->thumbnail) {
 		g_object_unref (file->details->thumbnail);
@@ -816,25 +917,22 @@ finalize (GObject *object)
 	}
 
 	eel_ref_str_unref (file->details->filesystem_id);
-	g_free (file->details->trash_orig_path);
 
-	g_list_free_full (file->details->mime_list, g_free);
-	g_list_free_full (file->details->pending_extension_emblems, g_free);
-	g_list_free_full (file->details->extension_emblems, g_free);
 	g_list_free_full (file->details->pending_info_providers, g_object_unref);
 
-	if (file->details->pending_extension_attributes) {
-		g_hash_table_destroy (file->details->pending_extension_attributes);
-	}
-	
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
-	}
-
 	if (file->details->metadata) {
 		metadata_hash_free (file->details->metadata);
 	}
 
+	if (file->details->folder != NULL) {
+		folder_details_free (file->details->folder);
+	}
+	if (file->details->extra != NULL) {
+		extra_details_free (file->details->extra);
+	}
+
+	g_atomic_int_add (&n_live_files, -1);
+
 	G_OBJECT_CLASS (nautilus_file_parent_class)->finalize (object);
 }
 
@@ -1627,6 +1725,7 @@ nautilus_file_operation_new (NautilusFile *file,
 			     gpointer callback_data)
 {
 	NautilusFileOperation *op;
+	NautilusFileExtraDetails *extra;
 
 	op = g_new0 (NautilusFileOperation, 1);
 	op->file = nautilus_file_ref (file);
@@ -1634,8 +1733,9 @@ nautilus_file_operation_new (NautilusFile *file,
 	op->callback_data = callback_data;
 	op->cancellable = g_cancellable_new ();
 
-	op->file->details->operations_in_progress = g_list_prepend
-		(op->file->details->operations_in_progress, op);
+	extra = nautilus_file_ensure_extra_details (op->file);
+	extra->operations_in_progress = g_list_prepend
+		(extra->operations_in_progress, op);
 
 	return op;
 }
@@ -1643,8 +1743,9 @@ nautilus_file_operation_new (NautilusFile *file,
 static void
 nautilus_file_operation_remove (NautilusFileOperation *op)
 {
-	op->file->details->operations_in_progress = g_list_remove
-		(op->file->details->operations_in_progress, op);
+	/* Adding the operation allocated the extra details */
+	op->file->details->extra->operations_in_progress = g_list_remove
+		(op->file->details->extra->operations_in_progress, op);
 }
 
 void
@@ -1972,7 +2073,7 @@ nautilus_file_rename_in_progress (NautilusFile *file)
 	GList *node;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = node->next) {
+	for (node = NAUTILUS_FILE_EXTRA_DETAILS (file)->operations_in_progress; node != NULL; node = node->next) {
 		op = node->data;
 		if (op->is_rename) {
 			return TRUE;
@@ -1989,7 +2090,7 @@ nautilus_file_cancel (NautilusFile *file,
 	GList *node, *next;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = next) {
+	for (node = NAUTILUS_FILE_EXTRA_DETAILS (file)->operations_in_progress; node != NULL; node = next) {
 		next = node->next;
 		op = node->data;
 
@@ -2110,6 +2211,7 @@ update_info_internal (NautilusFile *file,
 	const char *symlink_name, *mime_type, *selinux_context, *name, *thumbnail_path;
 	GFileType file_type;
 	GIcon *icon;
+	NautilusFileExtraDetails *extra;
 	char *old_activation_uri;
 	const char *activation_uri;
 	const char *description;
@@ -2161,18 +2263,19 @@ update_info_internal (NautilusFile *file,
 	if (!file->details->got_custom_activation_uri) {
 		activation_uri = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_TARGET_URI);
 		if (activation_uri == NULL) {
-			if (file->details->activation_uri) {
-				g_free (file->details->activation_uri);
-				file->details->activation_uri = NULL;
+			if (NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri) {
+				g_free (file->details->extra->activation_uri);
+				file->details->extra->activation_uri = NULL;
 				changed = TRUE;
 			}
 		} else {
-			old_activation_uri = file->details->activation_uri;
-			file->details->activation_uri = g_strdup (activation_uri);
+			extra = nautilus_file_ensure_extra_details (file);
+			old_activation_uri = extra->activation_uri;
+			extra->activation_uri = g_strdup (activation_uri);
 			
 			if (old_activation_uri) {
 				if (strcmp (old_activation_uri,
-					    file->details->activation_uri) != 0) {
+					    extra->activation_uri) != 0) {
 					changed = TRUE;
 				}
 				g_free (old_activation_uri);
@@ -2446,17 +2549,19 @@ update_info_internal (NautilusFile *file,
 	}
 	
 	selinux_context = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_SELINUX_CONTEXT);
-	if (g_strcmp0 (file->details->selinux_context, selinux_context) != 0) {
+	if (g_strcmp0 (eel_ref_str_peek (NAUTILUS_FILE_EXTRA_DETAILS (file)->selinux_context), selinux_context) != 0) {
 		changed = TRUE;
-		g_free (file->details->selinux_context);
-		file->details->selinux_context = g_strdup (selinux_context);
+		extra = nautilus_file_ensure_extra_details (file);
+		eel_ref_str_unref (extra->selinux_context);
+		extra->selinux_context = eel_ref_str_get_unique (selinux_context);
 	}
 	
 	description = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DESCRIPTION);
-	if (g_strcmp0 (file->details->description, description) != 0) {
+	if (g_strcmp0 (eel_ref_str_peek (NAUTILUS_FILE_EXTRA_DETAILS (file)->description), description) != 0) {
 		changed = TRUE;
-		g_free (file->details->description);
-		file->details->description = g_strdup (description);
+		extra = nautilus_file_ensure_extra_details (file);
+		eel_ref_str_unref (extra->description);
+		extra->description = eel_ref_str_get_unique (description);
 	}
 
 	filesystem_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
@@ -2472,16 +2577,17 @@ update_info_internal (NautilusFile *file,
 		g_time_val_from_iso8601 (time_string, &g_trash_time);
 		trash_time = g_trash_time.tv_sec;
 	}
-	if (file->details->trash_time != trash_time) {
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_time != trash_time) {
 		changed = TRUE;
-		file->details->trash_time = trash_time;
+		nautilus_file_ensure_extra_details (file)->trash_time = trash_time;
 	}
 
 	trash_orig_path = g_file_info_get_attribute_byte_string (info, "trash::orig-path");
-	if (g_strcmp0 (file->details->trash_orig_path, trash_orig_path) != 0) {
+	if (g_strcmp0 (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_orig_path, trash_orig_path) != 0) {
 		changed = TRUE;
-		g_free (file->details->trash_orig_path);
-		file->details->trash_orig_path = g_strdup (trash_orig_path);
+		extra = nautilus_file_ensure_extra_details (file);
+		g_free (extra->trash_orig_path);
+		extra->trash_orig_path = g_strdup (trash_orig_path);
 	}
 
 	changed |=
@@ -2730,7 +2836,7 @@ get_time (NautilusFile *file,
 		time = file->details->atime;
 		break;
 	case NAUTILUS_DATE_TYPE_TRASHED:
-		time = file->details->trash_time;
+		time = NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_time;
 		break;
 	default:
 		g_assert_not_reached ();
@@ -3212,6 +3318,29 @@ nautilus_file_compare_for_sort (NautilusFile *file_1,
 	return result;
 }
 
+NautilusFileSortType
+nautilus_file_get_sort_type_for_attribute_q (GQuark attribute)
+{
+	if (attribute == 0 || attribute == attribute_name_q) {
+		return NAUTILUS_FILE_SORT_BY_DISPLAY_NAME;
+	} else if (attribute == attribute_size_q) {
+		return NAUTILUS_FILE_SORT_BY_SIZE;
+	} else if (attribute == attribute_type_q) {
+		return NAUTILUS_FILE_SORT_BY_TYPE;
+	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_full_q) {
+		return NAUTILUS_FILE_SORT_BY_MTIME;
+	} else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
+		return NAUTILUS_FILE_SORT_BY_ATIME;
+	} else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
+		return NAUTILUS_FILE_SORT_BY_TRASHED_TIME;
+	} else if (attribute == attribute_search_relevance_q) {
+		return NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE;
+	}
+
+	/* A normal attribute, sorted by its string value */
+	return NAUTILUS_FILE_SORT_NONE;
+}
+
 int
 nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile                   *file_1,
 						 NautilusFile                   *file_2,
@@ -3219,6 +3348,7 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 						 gboolean                        directories_first,
 						 gboolean                        reversed)
 {
+	NautilusFileSortType sort_type;
 	int result;
 
 	if (file_1 == file_2) {
@@ -3228,39 +3358,10 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 	/* Convert certain attributes into NautilusFileSortTypes and use
 	 * nautilus_file_compare_for_sort()
 	 */
-	if (attribute == 0 || attribute == attribute_name_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_DISPLAY_NAME,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_size_q) {
+	sort_type = nautilus_file_get_sort_type_for_attribute_q (attribute);
+	if (sort_type != NAUTILUS_FILE_SORT_NONE) {
 		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SIZE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_type_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TYPE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_MTIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_ATIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TRASHED_TIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_search_relevance_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE,
+						       sort_type,
 						       directories_first,
 						       reversed);
 	}
@@ -3307,6 +3408,573 @@ nautilus_file_compare_for_sort_by_attribute     (NautilusFile
 }
 
 
+/* Packs the first bytes of a collation key so that comparing two
+ * prefixes gives the same answer as strcmp() on the keys, as long as
+ * the prefixes differ.
+ */
+static guint64
+get_collation_key_prefix (const char *key)
+{
+	guint64 prefix;
+	int i;
+
+	prefix = 0;
+	for (i = 0; i < 8 && key[i] != '\0'; i++) {
+		prefix |= (guint64) (guchar) key[i] << (56 - 8 * i);
+	}
+
+	return prefix;
+}
+
+static gint
+compare_type_strings (gconstpointer a,
+		      gconstpointer b)
+{
+	return g_utf8_collate (*(char **) a, *(char **) b);
+}
+
+/* Gives the type descriptions of the files ordinals that sort like the
+ * descriptions do, looking up the description once per mime type.
+ */
+static void
+fill_type_ordinals (NautilusFileSortKey *keys,
+		    guint                n_keys)
+{
+	GHashTable *mime_types, *ordinals;
+	GPtrArray *type_strings;
+	char **key_type_strings;
+	char *type_string;
+	const char *mime_type;
+	guint i, ordinal;
+
+	mime_types = g_hash_table_new (g_str_hash, g_str_equal);
+	type_strings = g_ptr_array_new_with_free_func (g_free);
+	key_type_strings = g_new0 (char *, n_keys);
+
+	for (i = 0; i < n_keys; i++) {
+		if (keys[i].is_directory) {
+			continue;
+		}
+
+		mime_type = keys[i].file->details->mime_type != NULL ?
+			eel_ref_str_peek (keys[i].file->details->mime_type) : NULL;
+
+		if (mime_type != NULL) {
+			type_string = g_hash_table_lookup (mime_types, mime_type);
+			if (type_string == NULL) {
+				type_string = nautilus_file_get_type_as_string (keys[i].file);
+				if (type_string == NULL) {
+					continue;
+				}
+				g_ptr_array_add (type_strings, type_string);
+				g_hash_table_insert (mime_types, (char *) mime_type, type_string);
+			}
+		} else {
+			type_string = nautilus_file_get_type_as_string (keys[i].file);
+			if (type_string == NULL) {
+				continue;
+			}
+			g_ptr_array_add (type_strings, type_string);
+		}
+
+		key_type_strings[i] = type_string;
+	}
+
+	/* Files without a description sort last, like in compare_by_type () */
+	g_ptr_array_sort (type_strings, compare_type_strings);
+
+	ordinals = g_hash_table_new (g_direct_hash, g_direct_equal);
+	ordinal = 0;
+	for (i = 0; i < type_strings->len; i++) {
+		if (i == 0 ||
+		    g_utf8_collate (g_ptr_array_index (type_strings, i - 1),
+				    g_ptr_array_index (type_strings, i)) != 0) {
+			ordinal++;
+		}
+		g_hash_table_insert (ordinals,
+				     g_ptr_array_index (type_strings, i),
+				     GUINT_TO_POINTER (ordinal));
+	}
+
+	for (i = 0; i < n_keys; i++) {
+		keys[i].type_ordinal = key_type_strings[i] != NULL ?
+			GPOINTER_TO_UINT (g_hash_table_lookup (ordinals, key_type_strings[i])) : G_MAXUINT;
+	}
+
+	g_hash_table_destroy (ordinals);
+	g_free (key_type_strings);
+	g_ptr_array_unref (type_strings);
+	g_hash_table_destroy (mime_types);
+}
+
+static void
+fill_sort_key_name_prefix (NautilusFileSortKey *key)
+{
+	key->name_prefix = get_collation_key_prefix (nautilus_file_peek_display_name_collation_key (key->file));
+}
+
+/* The name prefix is only filled when sorting by name, so other sorts
+ * don't make collation keys. With a zero prefix on both sides the
+ * names tie and the files are compared. */
+static void
+fill_sort_key (NautilusFileSortKey  *key,
+	       NautilusFileSortType  sort_type,
+	       gboolean              name_prefix)
+{
+	NautilusFile *file;
+	const char *name;
+	goffset size;
+	guint count;
+	time_t time;
+
+	file = key->file;
+	name = nautilus_file_peek_display_name (file);
+
+	key->directory = file->details->directory;
+	key->name_prefix = 0;
+	if (name_prefix && sort_type == NAUTILUS_FILE_SORT_BY_DISPLAY_NAME) {
+		fill_sort_key_name_prefix (key);
+	}
+	key->sort_order = file->details->sort_order;
+	key->is_directory = nautilus_file_is_directory (file);
+	key->sort_last = name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2;
+	key->knowledge = UNKNOWN;
+	key->value = 0;
+	key->relevance = 0;
+	key->type_ordinal = 0;
+
+	switch (sort_type) {
+	case NAUTILUS_FILE_SORT_BY_SIZE:
+		if (key->is_directory) {
+			count = 0;
+			key->knowledge = get_item_count (file, &count);
+			key->value = count;
+		} else {
+			size = 0;
+			key->knowledge = get_size (file, &size);
+			key->value = size;
+		}
+		break;
+	case NAUTILUS_FILE_SORT_BY_MTIME:
+	case NAUTILUS_FILE_SORT_BY_ATIME:
+	case NAUTILUS_FILE_SORT_BY_TRASHED_TIME:
+		time = 0;
+		key->knowledge = get_time (file, &time,
+					   sort_type == NAUTILUS_FILE_SORT_BY_MTIME ? NAUTILUS_DATE_TYPE_MODIFIED :
+					   sort_type == NAUTILUS_FILE_SORT_BY_ATIME ? NAUTILUS_DATE_TYPE_ACCESSED :
+					   NAUTILUS_DATE_TYPE_TRASHED);
+		key->value = time;
+		break;
+	case NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE:
+		key->relevance = file->details->search_relevance;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * nautilus_file_sort_keys_fill:
+ * @keys: An array of sort keys with their file set
+ * @n_keys: The number of keys
+ * @sort_type: Sort criterion the keys will be compared with
+ *
+ * Copies what sorting by @sort_type needs to know about each file into
+ * its key, so that comparing keys seldom has to look at the files.
+ **/
+static void
+fill_sort_keys (NautilusFileSortKey  *keys,
+		guint                 n_keys,
+		NautilusFileSortType  sort_type,
+		gboolean              name_prefixes)
+{
+	guint i;
+
+	for (i = 0; i < n_keys; i++) {
+		fill_sort_key (&keys[i], sort_type, name_prefixes);
+	}
+
+	if (sort_type == NAUTILUS_FILE_SORT_BY_TYPE) {
+		fill_type_ordinals (keys, n_keys);
+	}
+}
+
+void
+nautilus_file_sort_keys_fill (NautilusFileSortKey  *keys,
+			      guint                 n_keys,
+			      NautilusFileSortType  sort_type)
+{
+	fill_sort_keys (keys, n_keys, sort_type, TRUE);
+}
+
+static int
+compare_sort_key_values (const NautilusFileSortKey *key_1,
+			 const NautilusFileSortKey *key_2)
+{
+	if (key_1->knowledge != key_2->knowledge) {
+		return key_1->knowledge > key_2->knowledge ? -1 : +1;
+	}
+
+	if (key_1->knowledge != KNOWN || key_1->value == key_2->value) {
+		return 0;
+	}
+
+	return key_1->value < key_2->value ? -1 : +1;
+}
+
+/* Returns FALSE when the keys can't tell the names apart */
+static gboolean
+compare_sort_key_names (const NautilusFileSortKey *key_1,
+			const NautilusFileSortKey *key_2,
+			int                       *result)
+{
+	if (key_1->sort_last != key_2->sort_last) {
+		*result = key_1->sort_last ? +1 : -1;
+		return TRUE;
+	}
+
+	if (key_1->name_prefix != key_2->name_prefix) {
+		*result = key_1->name_prefix < key_2->name_prefix ? -1 : +1;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * nautilus_file_sort_key_compare:
+ * @key_1: A sort key filled for @sort_type
+ * @key_2: Another sort key filled for @sort_type
+ * @sort_type: Sort criterion
+ * @directories_first: Put all directories before any non-directories
+ * @reversed: Reverse the order of the items, except that
+ * the directories_first flag is still respected.
+ *
+ * Return value: the same as nautilus_file_compare_for_sort() would for
+ * the files of the keys. The files are only looked at when the keys
+ * tie.
+ **/
+int
+nautilus_file_sort_key_compare (const NautilusFileSortKey *key_1,
+				const NautilusFileSortKey *key_2,
+				NautilusFileSortType       sort_type,
+				gboolean                   directories_first,
+				gboolean                   reversed)
+{
+	int result;
+
+	if (key_1->file == key_2->file) {
+		return 0;
+	}
+
+	if (directories_first && key_1->is_directory != key_2->is_directory) {
+		return key_1->is_directory ? -1 : +1;
+	}
+
+	if (key_1->sort_order != key_2->sort_order) {
+		result = key_1->sort_order < key_2->sort_order ? -1 : +1;
+		return reversed ? -result : result;
+	}
+
+	result = 0;
+	switch (sort_type) {
+	case NAUTILUS_FILE_SORT_BY_DISPLAY_NAME:
+		if (!compare_sort_key_names (key_1, key_2, &result)) {
+			goto compare_files;
+		}
+		break;
+	case NAUTILUS_FILE_SORT_BY_SIZE:
+		if (key_1->is_directory != key_2->is_directory) {
+			result = key_1->is_directory ? -1 : +1;
+		} else {
+			result = compare_sort_key_values (key_1, key_2);
+		}
+		break;
+	case NAUTILUS_FILE_SORT_BY_TYPE:
+		if (key_1->is_directory != key_2->is_directory) {
+			result = key_1->is_directory ? -1 : +1;
+		} else if (key_1->type_ordinal != key_2->type_ordinal) {
+			result = key_1->type_ordinal < key_2->type_ordinal ? -1 : +1;
+		}
+		break;
+	case NAUTILUS_FILE_SORT_BY_MTIME:
+	case NAUTILUS_FILE_SORT_BY_ATIME:
+	case NAUTILUS_FILE_SORT_BY_TRASHED_TIME:
+		result = compare_sort_key_values (key_1, key_2);
+		break;
+	case NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE:
+		if (key_1->relevance != key_2->relevance) {
+			result = key_1->relevance < key_2->relevance ? -1 : +1;
+		}
+		break;
+	default:
+		g_return_val_if_reached (0);
+	}
+
+	if (result == 0) {
+		/* Ties are broken by the full path. Files in the same
+		 * folder only differ by their names. */
+		if (key_1->directory != key_2->directory ||
+		    !compare_sort_key_names (key_1, key_2, &result)) {
+			goto compare_files;
+		}
+
+		if (sort_type == NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE) {
+			/* ensure alphabetical order for files of the same relevance */
+			reversed = FALSE;
+		}
+	}
+
+	return reversed ? -result : result;
+
+ compare_files:
+	return nautilus_file_compare_for_sort (key_1->file, key_2->file,
+					       sort_type, directories_first, reversed);
+}
+
+/* Above this many keys, sorting is split between threads */
+#define SORT_KEYS_PARALLEL_THRESHOLD 10000
+#define SORT_KEYS_MAX_THREADS 8
+
+typedef struct {
+	NautilusFileSortType sort_type;
+	gboolean directories_first;
+	gboolean reversed;
+
+	/* The threads fill the name prefixes of their slice first */
+	gboolean fill_name_prefixes;
+
+	/* Runs still being sorted or merged by the threads */
+	GMutex lock;
+	GCond cond;
+	guint pending;
+} SortKeysData;
+
+/* Either sorts src[start, end) in place, or merges the sorted
+ * src[start, middle) and src[middle, end) into dest */
+typedef struct {
+	SortKeysData *data;
+	NautilusFileSortKey *src;
+	NautilusFileSortKey *dest;
+	guint start;
+	guint middle;
+	guint end;
+	gboolean merge;
+} SortKeysRun;
+
+static GThreadPool *sort_keys_pool = NULL;
+
+static gint
+sort_keys_compare_func (gconstpointer a,
+			gconstpointer b,
+			gpointer      user_data)
+{
+	SortKeysData *data;
+
+	data = user_data;
+
+	return nautilus_file_sort_key_compare (a, b,
+					       data->sort_type,
+					       data->directories_first,
+					       data->reversed);
+}
+
+static void
+merge_sort_key_runs (SortKeysRun *run)
+{
+	NautilusFileSortKey *src, *dest;
+	guint i, j, k;
+
+	src = run->src;
+	dest = run->dest;
+	i = run->start;
+	j = run->middle;
+	k = run->start;
+
+	/* Take from the left run on ties to keep the sort stable */
+	while (i < run->middle && j < run->end) {
+		if (sort_keys_compare_func (&src[j], &src[i], run->data) < 0) {
+			dest[k++] = src[j++];
+		} else {
+			dest[k++] = src[i++];
+		}
+	}
+
+	memcpy (&dest[k], &src[i], (run->middle - i) * sizeof (NautilusFileSortKey));
+	k += run->middle - i;
+	memcpy (&dest[k], &src[j], (run->end - j) * sizeof (NautilusFileSortKey));
+}
+
+static void
+sort_keys_thread_func (gpointer task_data,
+		       gpointer user_data)
+{
+	SortKeysRun *run;
+	SortKeysData *data;
+	guint i;
+
+	run = task_data;
+	data = run->data;
+
+	if (run->merge) {
+		merge_sort_key_runs (run);
+	} else {
+		if (data->fill_name_prefixes) {
+			for (i = run->start; i < run->end; i++) {
+				fill_sort_key_name_prefix (&run->src[i]);
+			}
+		}
+		g_qsort_with_data (run->src + run->start, run->end - run->start,
+				   sizeof (NautilusFileSortKey),
+				   sort_keys_compare_func, data);
+	}
+
+	g_mutex_lock (&data->lock);
+	if (--data->pending == 0) {
+		g_cond_signal (&data->cond);
+	}
+	g_mutex_unlock (&data->lock);
+}
+
+static void
+run_sort_key_runs (SortKeysData *data,
+		   SortKeysRun  *runs,
+		   guint         n_runs)
+{
+	guint i;
+
+	data->pending = n_runs;
+	for (i = 0; i < n_runs; i++) {
+		g_thread_pool_push (sort_keys_pool, &runs[i], NULL);
+	}
+
+	g_mutex_lock (&data->lock);
+	while (data->pending > 0) {
+		g_cond_wait (&data->cond, &data->lock);
+	}
+	g_mutex_unlock (&data->lock);
+}
+
+/* Sorts equal slices of the keys on the threads, then merges them two
+ * by two. The caller waits, so the files the keys fall back to on ties
+ * don't change under the threads.
+ */
+static void
+sort_keys_parallel (NautilusFileSortKey *keys,
+		    guint                n_keys,
+		    SortKeysData        *data)
+{
+	NautilusFileSortKey *tmp, *src, *dest;
+	SortKeysRun *runs;
+	guint *bounds;
+	guint i, n_slices, n_threads, n_runs, width;
+
+	n_threads = CLAMP (g_get_num_processors (), 2, SORT_KEYS_MAX_THREADS);
+	if (sort_keys_pool == NULL) {
+		sort_keys_pool = g_thread_pool_new (sort_keys_thread_func, NULL,
+						    n_threads, FALSE, NULL);
+	}
+
+	/* A power of two, so the slices merge evenly */
+	n_slices = 1;
+	while (n_slices * 2 <= n_threads) {
+		n_slices *= 2;
+	}
+
+	bounds = g_new (guint, n_slices + 1);
+	for (i = 0; i <= n_slices; i++) {
+		bounds[i] = (guint64) n_keys * i / n_slices;
+	}
+
+	g_mutex_init (&data->lock);
+	g_cond_init (&data->cond);
+
+	runs = g_new (SortKeysRun, n_slices);
+	for (i = 0; i < n_slices; i++) {
+		runs[i].data = data;
+		runs[i].src = keys;
+		runs[i].dest = NULL;
+		runs[i].start = bounds[i];
+		runs[i].middle = bounds[i + 1];
+		runs[i].end = bounds[i + 1];
+		runs[i].merge = FALSE;
+	}
+	run_sort_key_runs (data, runs, n_slices);
+
+	tmp = g_new (NautilusFileSortKey, n_keys);
+	src = keys;
+	dest = tmp;
+	for (width = 1; width < n_slices; width *= 2) {
+		n_runs = 0;
+		for (i = 0; i < n_slices; i += 2 * width) {
+			runs[n_runs].data = data;
+			runs[n_runs].src = src;
+			runs[n_runs].dest = dest;
+			runs[n_runs].start = bounds[i];
+			runs[n_runs].middle = bounds[i + width];
+			runs[n_runs].end = bounds[i + 2 * width];
+			runs[n_runs].merge = TRUE;
+			n_runs++;
+		}
+		run_sort_key_runs (data, runs, n_runs);
+
+		src = dest;
+		dest = src == keys ? tmp : keys;
+	}
+
+	if (src != keys) {
+		memcpy (keys, src, n_keys * sizeof (NautilusFileSortKey));
+	}
+
+	g_free (tmp);
+	g_free (runs);
+	g_free (bounds);
+	g_cond_clear (&data->cond);
+	g_mutex_clear (&data->lock);
+}
+
+/**
+ * nautilus_file_sort_keys_sort:
+ * @keys: An array of sort keys with their file set
+ * @n_keys: The number of keys
+ * @sort_type: Sort criterion
+ * @directories_first: Put all directories before any non-directories
+ * @reversed: Reverse the order of the items, except that
+ * the directories_first flag is still respected.
+ *
+ * Fills the keys and sorts them in the order of
+ * nautilus_file_compare_for_sort(). Large arrays are sorted on several
+ * threads; the call returns once they are done.
+ **/
+void
+nautilus_file_sort_keys_sort (NautilusFileSortKey  *keys,
+			      guint                 n_keys,
+			      NautilusFileSortType  sort_type,
+			      gboolean              directories_first,
+			      gboolean              reversed)
+{
+	SortKeysData data;
+	gboolean parallel;
+
+	g_return_if_fail (sort_type != NAUTILUS_FILE_SORT_NONE);
+
+	/* On the threads, the collation keys are made there too */
+	parallel = n_keys >= SORT_KEYS_PARALLEL_THRESHOLD;
+	fill_sort_keys (keys, n_keys, sort_type, !parallel);
+
+	data.sort_type = sort_type;
+	data.directories_first = directories_first;
+	data.reversed = reversed;
+	data.fill_name_prefixes = parallel && sort_type == NAUTILUS_FILE_SORT_BY_DISPLAY_NAME;
+
+	if (parallel) {
+		sort_keys_parallel (keys, n_keys, &data);
+	} else {
+		g_qsort_with_data (keys, n_keys, sizeof (NautilusFileSortKey),
+				   sort_keys_compare_func, &data);
+	}
+}
+
 /**
  * nautilus_file_compare_name:
  * @file: A file object
@@ -3710,16 +4378,153 @@ nautilus_file_set_integer_metadata (NautilusFile *file,
 				    default_as_string, value_as_string);
 }
 
+static void
+append_collate_key (GString    *result,
+		    const char *text,
+		    gsize       length)
+{
+	char *piece;
+	gsize old_length, key_length;
+
+	piece = g_strndup (text, length);
+	key_length = strxfrm (NULL, piece, 0);
+
+	old_length = result->len;
+	g_string_set_size (result, old_length + key_length);
+	strxfrm (result->str + old_length, piece, key_length + 1);
+
+	g_free (piece);
+}
+
+/* Gives the same key as g_utf8_collate_key_for_filename() for plain
+ * ASCII names in a UTF-8 locale, where normalizing the name does
+ * nothing and the key of each piece of text is what strxfrm() gives,
+ * without the copies and Unicode passes. Returns NULL for other names
+ * and locales.
+ */
+static char *
+collate_key_for_ascii_filename (const char *name)
+{
+	static gsize utf8_locale = 0;
+	GString *result, *append;
+	const char *prev, *p;
+	int leading_zeros, digits;
+
+	if (g_once_init_enter (&utf8_locale)) {
+		g_once_init_leave (&utf8_locale, g_get_charset (NULL) ? 1 : 2);
+	}
+	if (utf8_locale != 1) {
+		return NULL;
+	}
+
+	for (p = name; *p != '\0'; p++) {
+		if ((guchar) *p >= 0x80) {
+			return NULL;
+		}
+	}
+
+	result = g_string_sized_new (2 * (p - name) + 8);
+	append = g_string_new (NULL);
+
+	prev = name;
+	for (p = name; *p != '\0'; p++) {
+		if (*p == '.') {
+			if (prev != p) {
+				append_collate_key (result, prev, p - prev);
+			}
+			g_string_append (result, COLLATION_SENTINEL "\1");
+
+			/* Skip the dot */
+			prev = p + 1;
+		} else if (g_ascii_isdigit (*p)) {
+			if (prev != p) {
+				append_collate_key (result, prev, p - prev);
+			}
+			g_string_append (result, COLLATION_SENTINEL "\2");
+			prev = p;
+
+			/* Numbers sort by their value: longer ones get
+			 * more colons, leading zeros only break ties. */
+			if (*p == '0') {
+				leading_zeros = 1;
+				digits = 0;
+			} else {
+				leading_zeros = 0;
+				digits = 1;
+			}
+
+			while (*++p != '\0') {
+				if (*p == '0' && !digits) {
+					++leading_zeros;
+				} else if (g_ascii_isdigit (*p)) {
+					++digits;
+				} else {
+					if (!digits) {
+						/* A number made of zeros only */
+						++digits;
+						--leading_zeros;
+					}
+					break;
+				}
+			}
+
+			while (digits > 1) {
+				g_string_append_c (result, ':');
+				--digits;
+			}
+
+			if (leading_zeros > 0) {
+				g_string_append_c (append, (char) leading_zeros);
+				prev += leading_zeros;
+			}
+
+			g_string_append_len (result, prev, p - prev);
+			prev = p;
+			--p;
+		}
+	}
+
+	if (prev != p) {
+		append_collate_key (result, prev, p - prev);
+	}
+
+	g_string_append (result, append->str);
+	g_string_free (append, TRUE);
+
+	return g_string_free (result, FALSE);
+}
+
+/* The key is made on first use, since many views never compare the
+ * names. This can happen on the sort threads as well.
+ */
 static const char *
 nautilus_file_peek_display_name_collation_key (NautilusFile *file)
 {
-	const char *res;
+	const char *display_name;
+	char *key;
 
-	res = file->details->display_name_collation_key;
-	if (res == NULL)
-		res = "";
+	key = g_atomic_pointer_get (&file->details->display_name_collation_key);
+	if (key != NULL) {
+		return key;
+	}
 
-	return res;
+	display_name = eel_ref_str_peek (file->details->display_name);
+	if (display_name == NULL) {
+		return "";
+	}
+
+	key = collate_key_for_ascii_filename (display_name);
+	if (key == NULL) {
+		key = g_utf8_collate_key_for_filename (display_name, -1);
+	}
+
+	if (!g_atomic_pointer_compare_and_exchange (&file->details->display_name_collation_key,
+						    NULL, key)) {
+		g_free (key);
+		key = g_atomic_pointer_get (&file->details->display_name_collation_key);
+	}
+
+	return key;
 }
 
 static const char *
@@ -3794,7 +4599,7 @@ nautilus_file_get_name (NautilusFile *file)
 char *
 nautilus_file_get_description (NautilusFile *file)
 {
-	return g_strdup (file->details->description);
+	return g_strdup (eel_ref_str_peek (NAUTILUS_FILE_EXTRA_DETAILS (file)->description));
 }
    
 void             
@@ -3839,7 +4644,7 @@ nautilus_file_is_trusted_link (NautilusFile *file)
 gboolean
 nautilus_file_has_activation_uri (NautilusFile *file)
 {
-	return file->details->activation_uri != NULL;
+	return NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri != NULL;
 }
 
 
@@ -3852,8 +4657,8 @@ nautilus_file_get_activation_uri (NautilusFile *file)
 {
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-	if (file->details->activation_uri != NULL) {
-		return g_strdup (file->details->activation_uri);
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri != NULL) {
+		return g_strdup (NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri);
 	}
 	
 	return nautilus_file_get_uri (file);
@@ -3864,8 +4669,8 @@ nautilus_file_get_activation_location (NautilusFile *file)
 {
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-	if (file->details->activation_uri != NULL) {
-		return g_file_new_for_uri (file->details->activation_uri);
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri != NULL) {
+		return g_file_new_for_uri (NAUTILUS_FILE_EXTRA_DETAILS (file)->activation_uri);
 	}
 	
 	return nautilus_file_get_location (file);
@@ -3963,8 +4768,8 @@ get_link_icon (NautilusFile *file)
 {
 	GIcon *icon = NULL;
 
-	if (file->details->got_link_info && file->details->custom_icon != NULL) {
-		icon = g_object_ref (file->details->custom_icon);
+	if (file->details->got_link_info && NAUTILUS_FILE_EXTRA_DETAILS (file)->custom_icon != NULL) {
+		icon = g_object_ref (NAUTILUS_FILE_EXTRA_DETAILS (file)->custom_icon);
 	}
 
 	return icon;
@@ -4413,7 +5218,7 @@ nautilus_file_get_trash_original_file_parent_as_string (NautilusFile *file)
 	GFile *location;
 	char *filename;
 
-	if (file->details->trash_orig_path != NULL) {
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_orig_path != NULL) {
 		orig_file = nautilus_file_get_trash_original_file (file);
 		parent = nautilus_file_get_parent (orig_file);
 		location = nautilus_file_get_location (parent);
@@ -4735,7 +5540,7 @@ nautilus_file_get_directory_item_mime_types (NautilusFile *file,
 		return FALSE;
 	}
 
-	*mime_list = g_list_copy_deep (file->details->mime_list, (GCopyFunc) g_strdup, NULL);
+	*mime_list = g_list_copy_deep (NAUTILUS_FILE_FOLDER_DETAILS (file)->mime_list, (GCopyFunc) g_strdup, NULL);
 	return TRUE;
 }
 
@@ -4992,7 +5797,7 @@ nautilus_file_set_permissions (NautilusFile *file,
 gboolean
 nautilus_file_can_get_selinux_context (NautilusFile *file)
 {
-	return file->details->selinux_context != NULL;
+	return NAUTILUS_FILE_EXTRA_DETAILS (file)->selinux_context != NULL;
 }
 
 
@@ -5018,7 +5823,7 @@ nautilus_file_get_selinux_context (NautilusFile *file)
 		return NULL;
 	}
 
-	raw = file->details->selinux_context;
+	raw = NAUTILUS_FILE_EXTRA_DETAILS (file)->selinux_context;
 
 #ifdef HAVE_SELINUX
 	if (selinux_raw_to_trans_context (raw, &translated) == 0) {
@@ -6036,13 +6841,13 @@ nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 
 	extension_attribute = NULL;
 	
-	if (file->details->pending_extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->pending_extension_attributes,
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->pending_extension_attributes) {
+		extension_attribute = g_hash_table_lookup (NAUTILUS_FILE_EXTRA_DETAILS (file)->pending_extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	} 
 
-	if (extension_attribute == NULL && file->details->extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->extension_attributes,
+	if (extension_attribute == NULL && NAUTILUS_FILE_EXTRA_DETAILS (file)->extension_attributes) {
+		extension_attribute = g_hash_table_lookup (NAUTILUS_FILE_EXTRA_DETAILS (file)->extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	}
 		
@@ -6209,11 +7014,57 @@ get_basic_type_for_mime_type (const char *mime_type)
 	return basic_type;
 }
 
+/* The descriptions of the mime types, interned. Cleared when the
+ * mime data changes. */
+static GHashTable *basic_type_descriptions = NULL;
+static GHashTable *detailed_type_descriptions = NULL;
+
+static void
+clear_type_descriptions (void)
+{
+	if (basic_type_descriptions != NULL) {
+		g_hash_table_remove_all (basic_type_descriptions);
+	}
+	if (detailed_type_descriptions != NULL) {
+		g_hash_table_remove_all (detailed_type_descriptions);
+	}
+}
+
+static GHashTable *
+type_descriptions_new (void)
+{
+	return g_hash_table_new_full (g_str_hash, g_str_equal,
+				      (GDestroyNotify) eel_ref_str_unref,
+				      (GDestroyNotify) eel_ref_str_unref);
+}
+
+static char *
+get_description_for_mime_type (const char *mime_type,
+			       gboolean    detailed)
+{
+	char *description;
+
+	if (detailed) {
+		description = g_content_type_get_description (mime_type);
+	} else {
+		description = get_basic_type_for_mime_type (mime_type);
+	}
+
+	if (description == NULL) {
+		description = g_strdup (mime_type);
+	}
+
+	return description;
+}
+
 static char *
 get_description (NautilusFile *file,
 		 gboolean      detailed)
 {
 	const char *mime_type;
+	GHashTable **descriptions;
+	eel_ref_str description;
+	char *new_description;
 
 	g_assert (NAUTILUS_IS_FILE (file));
 
@@ -6233,23 +7084,23 @@ get_description (NautilusFile *file,
 		return g_strdup (_("Folder"));
 	}
 
-	if (detailed) {
-		char *description;
+	descriptions = detailed ? &detailed_type_descriptions : &basic_type_descriptions;
+	if (*descriptions == NULL) {
+		*descriptions = type_descriptions_new ();
+	}
 
-		description = g_content_type_get_description (mime_type);
-		if (description != NULL) {
-			return description;
-		}
-	} else {
-		char *category;
+	description = g_hash_table_lookup (*descriptions, mime_type);
+	if (description == NULL) {
+		new_description = get_description_for_mime_type (mime_type, detailed);
+		description = eel_ref_str_get_unique (new_description);
+		g_free (new_description);
 
-		category = get_basic_type_for_mime_type (mime_type);
-		if (category != NULL) {
-			return category;
-		}
+		g_hash_table_insert (*descriptions,
+				     eel_ref_str_ref (file->details->mime_type),
+				     description);
 	}
 
-	return g_strdup (mime_type);
+	return g_strdup (eel_ref_str_peek (description));
 }
 
 /* Takes ownership of string */
@@ -6489,8 +7340,8 @@ nautilus_file_get_keywords (NautilusFile *file)
 
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-	keywords = g_list_copy_deep (file->details->extension_emblems, (GCopyFunc) g_strdup, NULL);
-	keywords = g_list_concat (keywords, g_list_copy_deep (file->details->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
+	keywords = g_list_copy_deep (NAUTILUS_FILE_EXTRA_DETAILS (file)->extension_emblems, (GCopyFunc) g_strdup, NULL);
+	keywords = g_list_concat (keywords, g_list_copy_deep (NAUTILUS_FILE_EXTRA_DETAILS (file)->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
 
 	metadata_keywords = nautilus_file_get_metadata_list (file, NAUTILUS_METADATA_KEY_EMBLEMS);
 	clean_up_metadata_keywords (file, &metadata_keywords);
@@ -6668,8 +7519,8 @@ get_fs_free_cb (GObject *source_object,
 		g_object_unref (info);
 	}
 
-	if (file->details->free_space != free_space) {
-		file->details->free_space = free_space;
+	if (NAUTILUS_FILE_FOLDER_DETAILS (file)->free_space != free_space) {
+		nautilus_file_ensure_folder_details (file)->free_space = free_space;
 		nautilus_file_emit_changed (file);
 	}
 
@@ -6686,15 +7537,18 @@ get_fs_free_cb (GObject *source_object,
 char *
 nautilus_file_get_volume_free_space (NautilusFile *file)
 {
+	NautilusFileFolderDetails *folder;
 	GFile *location;
 	char *res;
 	time_t now;
 
+	folder = nautilus_file_ensure_folder_details (file);
+
 	now = time (NULL);
 	/* Update first time and then every 2 seconds */
-	if (file->details->free_space_read == 0 ||
-	    (now - file->details->free_space_read) > 2)  {
-		file->details->free_space_read = now;
+	if (folder->free_space_read == 0 ||
+	    (now - folder->free_space_read) > 2)  {
+		folder->free_space_read = now;
 		location = nautilus_file_get_location (file);
 		g_file_query_filesystem_info_async (location,
 						    G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
@@ -6705,8 +7559,8 @@ nautilus_file_get_volume_free_space (NautilusFile *file)
 	}
 
 	res = NULL;
-	if (file->details->free_space != (guint64)-1) {
-		res = g_format_size (file->details->free_space);
+	if (folder->free_space != (guint64)-1) {
+		res = g_format_size (folder->free_space);
 	}
 
 	return res;
@@ -7053,7 +7907,7 @@ nautilus_file_peek_top_left_text (NautilusFile *file,
 	}
 	
 	/* Show what we read in. */
-	return file->details->top_left_text;
+	return NAUTILUS_FILE_EXTRA_DETAILS (file)->top_left_text;
 }
 
 /**
@@ -7085,8 +7939,8 @@ nautilus_file_get_trash_original_file (NautilusFile *file)
 
 	original_file = NULL;
 
-	if (file->details->trash_orig_path != NULL) {
-		location = g_file_new_for_path (file->details->trash_orig_path);
+	if (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_orig_path != NULL) {
+		location = g_file_new_for_path (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_orig_path);
 		original_file = nautilus_file_get (location);
 		g_object_unref (location);
 	}
@@ -7509,7 +8363,7 @@ nautilus_file_invalidate_all_attributes (NautilusFile *file)
 void
 nautilus_file_dump (NautilusFile *file)
 {
-	long size = file->details->deep_size;
+	long size = NAUTILUS_FILE_FOLDER_DETAILS (file)->deep_size;
 	char *uri;
 	const char *file_kind;
 
@@ -8026,6 +8880,8 @@ show_thumbnails_changed_callback (gpointer user_data)
 static void
 mime_type_data_changed_callback (GObject *signaller, gpointer user_data)
 {
+	clear_type_descriptions ();
+
 	/* Tell the world that icons might have changed. We could invent a narrower-scope
 	 * signal to mean only "thumbnails might have changed" if this ends up being slow
 	 * for some reason.
@@ -8159,12 +9015,16 @@ static void
 nautilus_file_add_emblem (NautilusFile *file,
 			  const char *emblem_name)
 {
+	NautilusFileExtraDetails *extra;
+
+	extra = nautilus_file_ensure_extra_details (file);
+
 	if (file->details->pending_info_providers) {
-		file->details->pending_extension_emblems = g_list_prepend (file->details->pending_extension_emblems,
-									   g_strdup (emblem_name));
-	} else {
-		file->details->extension_emblems = g_list_prepend (file->details->extension_emblems,
+		extra->pending_extension_emblems = g_list_prepend (extra->pending_extension_emblems,
 								   g_strdup (emblem_name));
+	} else {
+		extra->extension_emblems = g_list_prepend (extra->extension_emblems,
+							   g_strdup (emblem_name));
 	}
 
 	nautilus_file_changed (file);
@@ -8175,25 +9035,29 @@ nautilus_file_add_string_attribute (NautilusFile *file,
 				    const char *attribute_name,
 				    const char *value)
 {
+	NautilusFileExtraDetails *extra;
+
+	extra = nautilus_file_ensure_extra_details (file);
+
 	if (file->details->pending_info_providers) {
 		/* Lazily create hashtable */
-		if (!file->details->pending_extension_attributes) {
-			file->details->pending_extension_attributes = 
+		if (!extra->pending_extension_attributes) {
+			extra->pending_extension_attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->pending_extension_attributes,
+		g_hash_table_insert (extra->pending_extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	} else {
-		if (!file->details->extension_attributes) {
-			file->details->extension_attributes = 
+		if (!extra->extension_attributes) {
+			extra->extension_attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->extension_attributes,
+		g_hash_table_insert (extra->extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	}
@@ -8210,16 +9074,21 @@ nautilus_file_invalidate_extension_info (NautilusFile *file)
 void
 nautilus_file_info_providers_done (NautilusFile *file)
 {
-	g_list_free_full (file->details->extension_emblems, g_free);
-	file->details->extension_emblems = file->details->pending_extension_emblems;
-	file->details->pending_extension_emblems = NULL;
+	NautilusFileExtraDetails *extra;
+
+	extra = file->details->extra;
+	if (extra != NULL) {
+		g_list_free_full (extra->extension_emblems, g_free);
+		extra->extension_emblems = extra->pending_extension_emblems;
+		extra->pending_extension_emblems = NULL;
 
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
+		if (extra->extension_attributes) {
+			g_hash_table_destroy (extra->extension_attributes);
+		}
+
+		extra->extension_attributes = extra->pending_extension_attributes;
+		extra->pending_extension_attributes = NULL;
 	}
-	
-	file->details->extension_attributes = file->details->pending_extension_attributes;
-	file->details->pending_extension_attributes = NULL;
 
 	nautilus_file_changed (file);
 }
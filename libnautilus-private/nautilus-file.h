@@ -405,6 +405,41 @@ int                     nautilus_file_compare_for_sort_by_attribute_q   (Nautilu
 									 gboolean                        directories_first,
 									 gboolean                        reversed);
 gboolean                nautilus_file_is_date_sort_attribute_q          (GQuark                          attribute);
+NautilusFileSortType    nautilus_file_get_sort_type_for_attribute_q     (GQuark                          attribute);
+
+/* What sorting needs to know about a file, copied out of it so that
+ * sorting many files runs over a flat array. Set file and data, the
+ * rest is filled in by nautilus_file_sort_keys_fill().
+ */
+typedef struct {
+	NautilusFile *file;
+	gpointer data;
+
+	/* private */
+	gpointer directory;
+	guint64 name_prefix;
+	gint64 value;
+	gdouble relevance;
+	int sort_order;
+	guint type_ordinal;
+	guint8 is_directory;
+	guint8 sort_last;
+	guint8 knowledge;
+} NautilusFileSortKey;
+
+void                    nautilus_file_sort_keys_fill                    (NautilusFileSortKey            *keys,
+									 guint                           n_keys,
+									 NautilusFileSortType            sort_type);
+int                     nautilus_file_sort_key_compare                  (const NautilusFileSortKey      *key_1,
+									 const NautilusFileSortKey      *key_2,
+									 NautilusFileSortType            sort_type,
+									 gboolean                        directories_first,
+									 gboolean                        reversed);
+void                    nautilus_file_sort_keys_sort                    (NautilusFileSortKey            *keys,
+									 guint                           n_keys,
+									 NautilusFileSortType            sort_type,
+									 gboolean                        directories_first,
+									 gboolean                        reversed);
 
 int                     nautilus_file_compare_display_name              (NautilusFile                   *file_1,
 									 const char                     *pattern);
@@ -0,0 +1,1774 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-filename-index.c: Persistent index of the file names below
+   the folders configured for search.
+
+   Copyright (C) 2014 Endless Mobile, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+#include "nautilus-filename-index.h"
+
+#include "nautilus-global-preferences.h"
+#include "nautilus-search-hit.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <eel/eel-debug.h>
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#define INDEX_FILE_NAME "filename-index"
+
+/* time of the crawl, roots, names, name offsets, parents, flags,
+ * modification times */
+#define INDEX_FORMAT "(xaayayauauayax)"
+
+/* An index older than this is crawled again, while the old one keeps
+ * answering queries. */
+#define INDEX_MAX_AGE_USEC (G_GINT64_CONSTANT (12) * 60 * 60 * G_USEC_PER_SEC)
+
+#define INDEX_SAVE_DELAY_SECS 30
+
+/* How often the folders in the index are checked for changes made while
+ * nobody was monitoring them */
+#define INDEX_REFRESH_INTERVAL_SECS (10 * 60)
+
+/* Removed entries are only flagged; the index is compacted when they
+ * make up this fraction of it */
+#define INDEX_COMPACT_RATIO 4
+
+#define NO_PARENT G_MAXUINT32
+
+#define CRAWL_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_ID_FILESYSTEM
+
+enum {
+	ENTRY_DIRECTORY = 1 << 0,
+	ENTRY_HIDDEN = 1 << 1,
+	ENTRY_REMOVED = 1 << 2,
+	/* A folder on another filesystem, whose contents are not indexed */
+	ENTRY_MOUNT = 1 << 3
+};
+
+/* Entries are kept in parallel arrays, so that they are written to disk
+ * and read back as a handful of fixed size arrays. An entry is a file
+ * name, the entry of its parent folder, or NO_PARENT for the roots which
+ * have their full path as name, some flags and a modification time.
+ * Removed entries are only flagged, they go away when the index is
+ * compacted or crawled again.
+ */
+typedef struct {
+	char **roots;
+	gint64 stamp;
+	guint n_removed;
+
+	GByteArray *names;
+	GArray *name_offsets;
+	GArray *parents;
+	GByteArray *flags;
+	GArray *mtimes;
+
+	/* Trigram of the folded names -> sorted array of entry ids */
+	GHashTable *trigrams;
+	/* Path -> entry id, for the folders */
+	GHashTable *directories;
+} Index;
+
+#define ENTRY_NAME(index, id) ((const char *) (index)->names->data + g_array_index ((index)->name_offsets, guint32, (id)))
+#define ENTRY_PARENT(index, id) g_array_index ((index)->parents, guint32, (id))
+#define ENTRY_FLAGS(index, id) ((index)->flags->data[(id)])
+#define ENTRY_MTIME(index, id) g_array_index ((index)->mtimes, gint64, (id))
+
+#define TRIGRAM(s) (((guint32) (guchar) (s)[0] << 16) | \
+		    ((guint32) (guchar) (s)[1] << 8) | \
+		    (guint32) (guchar) (s)[2])
+
+typedef enum {
+	TASK_LOAD,
+	TASK_CRAWL,
+	TASK_ADD,
+	TASK_REMOVE,
+	TASK_REFRESH,
+	TASK_SAVE
+} IndexTaskType;
+
+typedef struct {
+	IndexTaskType type;
+	GFile *location;
+} IndexTask;
+
+/* current_index is only changed on the index thread, which reads it
+ * without locking. Other threads take a reader lock, and the index
+ * thread takes the writer lock only around its changes, so that no
+ * crawl or lookup runs with the index locked. */
+static GRWLock index_lock;
+static Index *current_index = NULL;
+static gboolean index_dirty = FALSE;
+/* Changes whenever current_index is replaced, so that entry ids found
+ * under one reader lock can be checked under the next one */
+static guint index_generation = 0;
+
+/* Lock roots_mutex when accessing configured_roots */
+static GMutex roots_mutex;
+static char **configured_roots = NULL;
+
+/* Loads, crawls and updates run one after the other on this pool */
+static GThreadPool *index_pool = NULL;
+static gboolean index_requested = FALSE;
+static guint save_timeout_id = 0;
+
+static void
+free_trigram_ids (gpointer data)
+{
+	g_array_free (data, TRUE);
+}
+
+static Index *
+index_new (char **roots)
+{
+	Index *index;
+
+	index = g_new0 (Index, 1);
+	index->roots = g_strdupv (roots);
+	index->stamp = g_get_real_time ();
+	index->names = g_byte_array_new ();
+	index->name_offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+	index->parents = g_array_new (FALSE, FALSE, sizeof (guint32));
+	index->flags = g_byte_array_new ();
+	index->mtimes = g_array_new (FALSE, FALSE, sizeof (gint64));
+	index->trigrams = g_hash_table_new_full (NULL, NULL, NULL, free_trigram_ids);
+	index->directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return index;
+}
+
+static void
+index_free (Index *index)
+{
+	if (index == NULL) {
+		return;
+	}
+
+	g_strfreev (index->roots);
+	g_byte_array_free (index->names, TRUE);
+	g_array_free (index->name_offsets, TRUE);
+	g_array_free (index->parents, TRUE);
+	g_byte_array_free (index->flags, TRUE);
+	g_array_free (index->mtimes, TRUE);
+	g_hash_table_destroy (index->trigrams);
+	g_hash_table_destroy (index->directories);
+	g_free (index);
+}
+
+static gboolean
+roots_equal (char **a,
+	     char **b)
+{
+	guint i;
+
+	if (a == NULL || b == NULL) {
+		return a == b;
+	}
+
+	for (i = 0; a[i] != NULL && b[i] != NULL; i++) {
+		if (strcmp (a[i], b[i]) != 0) {
+			return FALSE;
+		}
+	}
+
+	return a[i] == NULL && b[i] == NULL;
+}
+
+/* Same folding as nautilus_query_matches_string () */
+static char *
+fold_string (const char *string)
+{
+	char *normalized, *folded;
+
+	normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
+	folded = g_utf8_strdown (normalized != NULL ? normalized : string, -1);
+	g_free (normalized);
+
+	return folded;
+}
+
+static char *
+fold_name (const char *name)
+{
+	char *display_name, *folded;
+
+	display_name = g_filename_display_name (name);
+	folded = fold_string (display_name);
+	g_free (display_name);
+
+	return folded;
+}
+
+static void
+index_trigrams (Index *index,
+		guint32 id,
+		const char *folded)
+{
+	GArray *ids;
+	guint32 trigram;
+	gsize i, len;
+
+	len = strlen (folded);
+	for (i = 0; i + 3 <= len; i++) {
+		trigram = TRIGRAM (folded + i);
+		ids = g_hash_table_lookup (index->trigrams, GUINT_TO_POINTER (trigram));
+		if (ids == NULL) {
+			ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+			g_hash_table_insert (index->trigrams, GUINT_TO_POINTER (trigram), ids);
+		}
+
+		/* New entries have the highest id, so the arrays stay
+		 * sorted, and a trigram seen twice in a name is at the end */
+		if (ids->len == 0 || g_array_index (ids, guint32, ids->len - 1) != id) {
+			g_array_append_val (ids, id);
+		}
+	}
+}
+
+static char *
+get_entry_path (Index *index,
+		guint32 id)
+{
+	GPtrArray *names;
+	GString *path;
+	const char *name;
+	guint i;
+
+	names = g_ptr_array_new ();
+	for (; id != NO_PARENT; id = ENTRY_PARENT (index, id)) {
+		g_ptr_array_add (names, (gpointer) ENTRY_NAME (index, id));
+	}
+
+	path = g_string_new (NULL);
+	for (i = names->len; i > 0; i--) {
+		name = g_ptr_array_index (names, i - 1);
+		if (path->len > 0 && path->str[path->len - 1] != '/') {
+			g_string_append_c (path, '/');
+		}
+		g_string_append (path, name);
+	}
+
+	g_ptr_array_free (names, TRUE);
+
+	return g_string_free (path, FALSE);
+}
+
+/* path is the full path of the entry, only needed for folders. */
+static guint32
+index_add_entry (Index *index,
+		 guint32 parent,
+		 const char *name,
+		 guint8 flags,
+		 gint64 mtime,
+		 const char *path)
+{
+	guint32 id, offset;
+	char *folded;
+
+	id = index->parents->len;
+	offset = index->names->len;
+
+	g_byte_array_append (index->names, (const guint8 *) name, strlen (name) + 1);
+	g_array_append_val (index->name_offsets, offset);
+	g_array_append_val (index->parents, parent);
+	g_byte_array_append (index->flags, &flags, 1);
+	g_array_append_val (index->mtimes, mtime);
+
+	if (flags & ENTRY_REMOVED) {
+		return id;
+	}
+
+	folded = fold_name (name);
+	index_trigrams (index, id, folded);
+	g_free (folded);
+
+	if ((flags & ENTRY_DIRECTORY) && !(flags & ENTRY_MOUNT) && path != NULL) {
+		g_hash_table_insert (index->directories, g_strdup (path), GUINT_TO_POINTER (id));
+	}
+
+	return id;
+}
+
+static gboolean
+path_is_below (gpointer key,
+	       gpointer value,
+	       gpointer user_data)
+{
+	const char *path = key;
+	const char *prefix = user_data;
+
+	return g_str_has_prefix (path, prefix);
+}
+
+static void
+index_remove_entry (Index *index,
+		    guint32 id)
+{
+	char *path, *prefix;
+
+	if (ENTRY_FLAGS (index, id) & ENTRY_REMOVED) {
+		return;
+	}
+
+	ENTRY_FLAGS (index, id) |= ENTRY_REMOVED;
+	index->n_removed++;
+
+	/* Entries below a removed folder are left alone, queries skip
+	 * them when they walk up to the folder. */
+	if (ENTRY_FLAGS (index, id) & ENTRY_DIRECTORY) {
+		path = get_entry_path (index, id);
+		prefix = g_strconcat (path, "/", NULL);
+		g_hash_table_remove (index->directories, path);
+		g_hash_table_foreach_remove (index->directories, path_is_below, prefix);
+		g_free (prefix);
+		g_free (path);
+	}
+}
+
+/* Iterates over the entries whose folded names may contain all of the
+ * words, using the shortest trigram list and looking the others up. */
+typedef struct {
+	Index *index;
+	GPtrArray *lists;
+	guint pos;
+	guint end;
+} CandidateIter;
+
+static gint
+compare_list_length (gconstpointer a,
+		     gconstpointer b)
+{
+	const GArray *list_a = *(const GArray **) a;
+	const GArray *list_b = *(const GArray **) b;
+
+	return (gint) list_a->len - (gint) list_b->len;
+}
+
+/* Leaves nothing to iterate over if a trigram is in no name. */
+static void
+candidate_iter_init (CandidateIter *iter,
+		     Index *index,
+		     char **words)
+{
+	GArray *ids;
+	gsize i, len;
+	guint w;
+
+	iter->index = index;
+	iter->lists = g_ptr_array_new ();
+	iter->pos = 0;
+
+	for (w = 0; words[w] != NULL; w++) {
+		len = strlen (words[w]);
+		for (i = 0; i + 3 <= len; i++) {
+			ids = g_hash_table_lookup (index->trigrams,
+						   GUINT_TO_POINTER (TRIGRAM (words[w] + i)));
+			if (ids == NULL) {
+				iter->end = 0;
+				return;
+			}
+			g_ptr_array_add (iter->lists, ids);
+		}
+	}
+
+	if (iter->lists->len == 0) {
+		/* Only words shorter than a trigram, look at everything */
+		iter->end = index->parents->len;
+	} else {
+		g_ptr_array_sort (iter->lists, compare_list_length);
+		iter->end = ((GArray *) g_ptr_array_index (iter->lists, 0))->len;
+	}
+}
+
+static gboolean
+sorted_ids_contain (GArray *ids,
+		    guint32 id)
+{
+	guint low, high, middle;
+	guint32 value;
+
+	low = 0;
+	high = ids->len;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		value = g_array_index (ids, guint32, middle);
+		if (value == id) {
+			return TRUE;
+		} else if (value < id) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean
+candidate_iter_next (CandidateIter *iter,
+		     guint32 *id)
+{
+	guint32 candidate;
+	guint i;
+
+	while (iter->pos < iter->end) {
+		if (iter->lists->len == 0) {
+			*id = iter->pos++;
+			return TRUE;
+		}
+
+		candidate = g_array_index ((GArray *) g_ptr_array_index (iter->lists, 0),
+					   guint32, iter->pos++);
+		for (i = 1; i < iter->lists->len; i++) {
+			if (!sorted_ids_contain (g_ptr_array_index (iter->lists, i), candidate)) {
+				break;
+			}
+		}
+
+		if (i == iter->lists->len) {
+			*id = candidate;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+candidate_iter_clear (CandidateIter *iter)
+{
+	g_ptr_array_free (iter->lists, TRUE);
+}
+
+/* Returns the entry called name in the folder parent, or NO_PARENT. */
+static guint32
+index_find_entry (Index *index,
+		  guint32 parent,
+		  const char *name)
+{
+	CandidateIter iter;
+	char *words[2];
+	guint32 id, found;
+
+	words[0] = fold_name (name);
+	words[1] = NULL;
+
+	found = NO_PARENT;
+	candidate_iter_init (&iter, index, words);
+	while (candidate_iter_next (&iter, &id)) {
+		if (ENTRY_PARENT (index, id) == parent &&
+		    !(ENTRY_FLAGS (index, id) & ENTRY_REMOVED) &&
+		    strcmp (ENTRY_NAME (index, id), name) == 0) {
+			found = id;
+			break;
+		}
+	}
+	candidate_iter_clear (&iter);
+
+	g_free (words[0]);
+
+	return found;
+}
+
+/* Returns TRUE if id is below the folder ancestor, and not hidden from
+ * it unless show_hidden is set. */
+static gboolean
+index_entry_is_below (Index *index,
+		      guint32 id,
+		      guint32 ancestor,
+		      gboolean show_hidden)
+{
+	guint8 flags;
+
+	flags = ENTRY_FLAGS (index, id);
+	if ((flags & ENTRY_REMOVED) ||
+	    (!show_hidden && (flags & ENTRY_HIDDEN))) {
+		return FALSE;
+	}
+
+	for (id = ENTRY_PARENT (index, id); id != NO_PARENT; id = ENTRY_PARENT (index, id)) {
+		if (id == ancestor) {
+			return TRUE;
+		}
+
+		flags = ENTRY_FLAGS (index, id);
+		if ((flags & ENTRY_REMOVED) ||
+		    (!show_hidden && (flags & ENTRY_HIDDEN))) {
+			return FALSE;
+		}
+	}
+
+	return FALSE;
+}
+
+static guint8
+get_info_flags (GFileInfo *info)
+{
+	guint8 flags;
+
+	flags = 0;
+	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		flags |= ENTRY_DIRECTORY;
+	}
+	if (g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info)) {
+		flags |= ENTRY_HIDDEN;
+	}
+
+	return flags;
+}
+
+typedef struct {
+	guint32 id;
+	GFile *dir;
+} CrawlItem;
+
+static char *
+get_filesystem_id (GFile *file)
+{
+	GFileInfo *info;
+	char *fs_id;
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  NULL, NULL);
+	if (info == NULL) {
+		return NULL;
+	}
+
+	fs_id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM));
+	g_object_unref (info);
+
+	return fs_id;
+}
+
+/* Whether a folder with info is on the filesystem fs_id, which is where
+ * crawls stay, so that network and FUSE mounts are left alone */
+static gboolean
+info_is_on_filesystem (GFileInfo *info,
+		       const char *fs_id)
+{
+	return fs_id != NULL &&
+		g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM),
+			   fs_id) == 0;
+}
+
+/* Adds everything below dir, which is the entry id, to index, without
+ * going into mount points. Never call this on the current index, crawl
+ * into a new one and merge it. */
+static void
+index_crawl_directory (Index *index,
+		       guint32 id,
+		       GFile *dir)
+{
+	GQueue queue = G_QUEUE_INIT;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *child;
+	CrawlItem *item, *child_item;
+	guint32 child_id;
+	guint8 flags;
+	char *path, *fs_id;
+
+	fs_id = get_filesystem_id (dir);
+	if (fs_id == NULL) {
+		return;
+	}
+
+	item = g_slice_new (CrawlItem);
+	item->id = id;
+	item->dir = g_object_ref (dir);
+	g_queue_push_tail (&queue, item);
+
+	while ((item = g_queue_pop_head (&queue)) != NULL) {
+		enumerator = g_file_enumerate_children (item->dir, CRAWL_ATTRIBUTES,
+							G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+							NULL, NULL);
+		while (enumerator != NULL &&
+		       (info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+			flags = get_info_flags (info);
+			if ((flags & ENTRY_DIRECTORY) && !info_is_on_filesystem (info, fs_id)) {
+				flags |= ENTRY_MOUNT;
+			}
+			child = g_file_get_child (item->dir, g_file_info_get_name (info));
+			path = (flags & ENTRY_DIRECTORY) ? g_file_get_path (child) : NULL;
+
+			child_id = index_add_entry (index, item->id,
+						    g_file_info_get_name (info), flags,
+						    g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+						    path);
+
+			/* Mount points are in the index, but not what they hold */
+			if ((flags & ENTRY_DIRECTORY) && !(flags & ENTRY_MOUNT)) {
+				child_item = g_slice_new (CrawlItem);
+				child_item->id = child_id;
+				child_item->dir = g_object_ref (child);
+				g_queue_push_tail (&queue, child_item);
+			}
+
+			g_free (path);
+			g_object_unref (child);
+			g_object_unref (info);
+		}
+
+		g_clear_object (&enumerator);
+		g_object_unref (item->dir);
+		g_slice_free (CrawlItem, item);
+	}
+
+	g_free (fs_id);
+}
+
+/* Appends the entries of sub to index, with the entries whose parent is
+ * the first entry of sub going below the folder parent instead. Only
+ * copies what was computed while crawling sub, so that the index is not
+ * locked for long. */
+static void
+index_merge (Index *index,
+	     guint32 parent,
+	     Index *sub)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GArray *ids, *sub_ids;
+	guint32 base, names_base, offset, sub_parent, id;
+	guint i;
+
+	/* Entry i of sub becomes entry base + i */
+	base = index->parents->len - 1;
+	names_base = index->names->len;
+
+	g_byte_array_append (index->names, sub->names->data, sub->names->len);
+	for (i = 1; i < sub->parents->len; i++) {
+		offset = names_base + g_array_index (sub->name_offsets, guint32, i);
+		sub_parent = ENTRY_PARENT (sub, i);
+		id = sub_parent == 0 ? parent : base + sub_parent;
+
+		g_array_append_val (index->name_offsets, offset);
+		g_array_append_val (index->parents, id);
+		g_byte_array_append (index->flags, &ENTRY_FLAGS (sub, i), 1);
+		g_array_append_val (index->mtimes, ENTRY_MTIME (sub, i));
+	}
+
+	/* The merged ids are higher than all the others, so appending
+	 * keeps the arrays sorted */
+	g_hash_table_iter_init (&iter, sub->trigrams);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		sub_ids = value;
+		ids = g_hash_table_lookup (index->trigrams, key);
+		if (ids == NULL) {
+			ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), sub_ids->len);
+			g_hash_table_insert (index->trigrams, key, ids);
+		}
+		for (i = 0; i < sub_ids->len; i++) {
+			id = base + g_array_index (sub_ids, guint32, i);
+			g_array_append_val (ids, id);
+		}
+	}
+
+	g_hash_table_iter_init (&iter, sub->directories);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_hash_table_insert (index->directories, g_strdup (key),
+				     GUINT_TO_POINTER (base + GPOINTER_TO_UINT (value)));
+	}
+}
+
+/* Returns a copy of index without the removed entries, nor the ones
+ * below removed folders. */
+static Index *
+index_compact (Index *index)
+{
+	Index *compact;
+	guint32 *ids;
+	guint32 id, parent;
+	guint8 flags;
+	char *path;
+
+	compact = index_new (index->roots);
+	compact->stamp = index->stamp;
+
+	/* Parents always come before their children */
+	ids = g_new (guint32, index->parents->len);
+	for (id = 0; id < index->parents->len; id++) {
+		parent = ENTRY_PARENT (index, id);
+		flags = ENTRY_FLAGS (index, id);
+		if ((flags & ENTRY_REMOVED) ||
+		    (parent != NO_PARENT && ids[parent] == NO_PARENT)) {
+			ids[id] = NO_PARENT;
+			continue;
+		}
+
+		path = (flags & ENTRY_DIRECTORY) ? get_entry_path (index, id) : NULL;
+		ids[id] = index_add_entry (compact,
+					   parent != NO_PARENT ? ids[parent] : NO_PARENT,
+					   ENTRY_NAME (index, id), flags,
+					   ENTRY_MTIME (index, id), path);
+		g_free (path);
+	}
+	g_free (ids);
+
+	return compact;
+}
+
+static char *
+get_index_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "nautilus", INDEX_FILE_NAME, NULL);
+}
+
+static void
+save_index (void)
+{
+	GVariant *variant;
+	char *filename, *dirname;
+	GError *error;
+
+	g_rw_lock_writer_lock (&index_lock);
+
+	if (current_index == NULL || !index_dirty) {
+		g_rw_lock_writer_unlock (&index_lock);
+		return;
+	}
+
+	variant = g_variant_new ("(x^aay@ay@au@au@ay@ax)",
+				 current_index->stamp,
+				 current_index->roots,
+				 g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+							    current_index->names->data,
+							    current_index->names->len, 1),
+				 g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+							    current_index->name_offsets->data,
+							    current_index->name_offsets->len, sizeof (guint32)),
+				 g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+							    current_index->parents->data,
+							    current_index->parents->len, sizeof (guint32)),
+				 g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+							    current_index->flags->data,
+							    current_index->flags->len, 1),
+				 g_variant_new_fixed_array (G_VARIANT_TYPE_INT64,
+							    current_index->mtimes->data,
+							    current_index->mtimes->len, sizeof (gint64)));
+	index_dirty = FALSE;
+
+	DEBUG ("Saving filename index, %u entries, %u trigrams",
+	       current_index->parents->len,
+	       g_hash_table_size (current_index->trigrams));
+
+	g_rw_lock_writer_unlock (&index_lock);
+
+	g_variant_ref_sink (variant);
+
+	filename = get_index_filename ();
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	error = NULL;
+	if (!g_file_set_contents (filename,
+				  g_variant_get_data (variant),
+				  g_variant_get_size (variant),
+				  &error)) {
+		g_warning ("Unable to save the filename index: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (variant);
+}
+
+static Index *
+read_index (void)
+{
+	GVariant *variant, *names, *name_offsets, *parents, *flags, *mtimes;
+	const guint8 *names_data, *flags_data;
+	const guint32 *name_offsets_data, *parents_data;
+	const gint64 *mtimes_data;
+	gsize n_names, n_entries, n;
+	char *filename, *contents, *path;
+	char **roots;
+	gsize length;
+	gint64 stamp;
+	Index *index;
+	guint32 id;
+	gboolean valid;
+
+	filename = get_index_filename ();
+	if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+		g_free (filename);
+		return NULL;
+	}
+	g_free (filename);
+
+	variant = g_variant_new_from_data (G_VARIANT_TYPE (INDEX_FORMAT),
+					   contents, length, FALSE,
+					   g_free, contents);
+	g_variant_ref_sink (variant);
+	g_variant_get (variant, "(x^aay@ay@au@au@ay@ax)",
+		       &stamp, &roots, &names, &name_offsets, &parents, &flags, &mtimes);
+
+	names_data = g_variant_get_fixed_array (names, &n_names, 1);
+	name_offsets_data = g_variant_get_fixed_array (name_offsets, &n_entries, sizeof (guint32));
+	parents_data = g_variant_get_fixed_array (parents, &n, sizeof (guint32));
+	valid = (n == n_entries);
+	flags_data = g_variant_get_fixed_array (flags, &n, 1);
+	valid = valid && (n == n_entries);
+	mtimes_data = g_variant_get_fixed_array (mtimes, &n, sizeof (gint64));
+	valid = valid && (n == n_entries);
+	valid = valid && (n_names == 0 || names_data[n_names - 1] == '\0');
+
+	/* Parents always come before their children */
+	for (id = 0; valid && id < n_entries; id++) {
+		valid = name_offsets_data[id] < n_names &&
+			(parents_data[id] == NO_PARENT || parents_data[id] < id);
+	}
+
+	index = NULL;
+	if (valid) {
+		index = index_new (roots);
+		index->stamp = stamp;
+		g_byte_array_append (index->names, names_data, n_names);
+		g_array_append_vals (index->name_offsets, name_offsets_data, n_entries);
+		g_array_append_vals (index->parents, parents_data, n_entries);
+		g_byte_array_append (index->flags, flags_data, n_entries);
+		g_array_append_vals (index->mtimes, mtimes_data, n_entries);
+
+		for (id = 0; id < n_entries; id++) {
+			char *folded;
+
+			if (ENTRY_FLAGS (index, id) & ENTRY_REMOVED) {
+				index->n_removed++;
+				continue;
+			}
+
+			folded = fold_name (ENTRY_NAME (index, id));
+			index_trigrams (index, id, folded);
+			g_free (folded);
+
+			if ((ENTRY_FLAGS (index, id) & ENTRY_DIRECTORY) &&
+			    !(ENTRY_FLAGS (index, id) & ENTRY_MOUNT)) {
+				path = get_entry_path (index, id);
+				g_hash_table_insert (index->directories, path, GUINT_TO_POINTER (id));
+			}
+		}
+
+		/* Folders below removed ones are not reachable anymore */
+		for (id = 0; id < n_entries; id++) {
+			if ((ENTRY_FLAGS (index, id) & ENTRY_REMOVED) &&
+			    (ENTRY_FLAGS (index, id) & ENTRY_DIRECTORY)) {
+				index_remove_entry (index, id);
+			}
+		}
+	}
+
+	g_strfreev (roots);
+	g_variant_unref (names);
+	g_variant_unref (name_offsets);
+	g_variant_unref (parents);
+	g_variant_unref (flags);
+	g_variant_unref (mtimes);
+	g_variant_unref (variant);
+
+	return index;
+}
+
+static void
+crawl_index (void)
+{
+	Index *index, *old_index;
+	GFileInfo *info;
+	GFile *root;
+	char **roots;
+	guint32 id;
+	guint i;
+
+	g_mutex_lock (&roots_mutex);
+	roots = g_strdupv (configured_roots);
+	g_mutex_unlock (&roots_mutex);
+
+	DEBUG ("Crawling filename index");
+
+	index = index_new (roots);
+	for (i = 0; roots[i] != NULL; i++) {
+		/* Nested roots are crawled with their parent */
+		if (g_hash_table_contains (index->directories, roots[i])) {
+			continue;
+		}
+
+		root = g_file_new_for_path (roots[i]);
+		info = g_file_query_info (root, CRAWL_ATTRIBUTES, 0, NULL, NULL);
+		if (info != NULL && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			id = index_add_entry (index, NO_PARENT, roots[i],
+					      get_info_flags (info) & ~ENTRY_HIDDEN,
+					      g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+					      roots[i]);
+			index_crawl_directory (index, id, root);
+		}
+
+		g_clear_object (&info);
+		g_object_unref (root);
+	}
+	g_strfreev (roots);
+
+	DEBUG ("Crawled filename index, %u entries, %u trigrams",
+	       index->parents->len,
+	       g_hash_table_size (index->trigrams));
+
+	g_rw_lock_writer_lock (&index_lock);
+	old_index = current_index;
+	current_index = index;
+	index_generation++;
+	index_dirty = TRUE;
+	g_rw_lock_writer_unlock (&index_lock);
+
+	index_free (old_index);
+
+	save_index ();
+}
+
+/* Call this on the index thread. Returns the folder entry for
+ * location's parent, or NO_PARENT. */
+static guint32
+lookup_parent_entry (GFile *location)
+{
+	GFile *parent;
+	char *path;
+	gpointer value;
+	guint32 id;
+
+	id = NO_PARENT;
+	parent = g_file_get_parent (location);
+	path = parent != NULL ? g_file_get_path (parent) : NULL;
+	if (current_index != NULL && path != NULL &&
+	    g_hash_table_lookup_extended (current_index->directories, path, NULL, &value)) {
+		id = GPOINTER_TO_UINT (value);
+	}
+
+	g_free (path);
+	g_clear_object (&parent);
+
+	return id;
+}
+
+/* Call this on the index thread. Removes the entries below removed
+ * folders and the removed entries themselves once there are enough. */
+static void
+maybe_compact_index (void)
+{
+	Index *compact, *old_index;
+
+	if (current_index == NULL ||
+	    current_index->n_removed * INDEX_COMPACT_RATIO < current_index->parents->len) {
+		return;
+	}
+
+	compact = index_compact (current_index);
+
+	DEBUG ("Compacted filename index from %u to %u entries",
+	       current_index->parents->len, compact->parents->len);
+
+	g_rw_lock_writer_lock (&index_lock);
+	old_index = current_index;
+	current_index = compact;
+	index_generation++;
+	index_dirty = TRUE;
+	g_rw_lock_writer_unlock (&index_lock);
+
+	index_free (old_index);
+}
+
+/* Call this on the index thread. Adds or updates location, described
+ * by info, in the folder parent, whose entry may already be id. New
+ * folders are crawled if they are on fs_id, the filesystem of parent. */
+static void
+update_entry (guint32 parent,
+	      guint32 id,
+	      GFile *location,
+	      GFileInfo *info,
+	      const char *fs_id)
+{
+	Index *sub;
+	const char *name;
+	char *path;
+	guint8 flags;
+	gint64 mtime;
+
+	name = g_file_info_get_name (info);
+	flags = get_info_flags (info);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	if ((flags & ENTRY_DIRECTORY) && !info_is_on_filesystem (info, fs_id)) {
+		flags |= ENTRY_MOUNT;
+	}
+
+	if (id != NO_PARENT &&
+	    (ENTRY_FLAGS (current_index, id) & (ENTRY_DIRECTORY | ENTRY_MOUNT)) ==
+	    (flags & (ENTRY_DIRECTORY | ENTRY_MOUNT))) {
+		if (ENTRY_FLAGS (current_index, id) != flags ||
+		    ENTRY_MTIME (current_index, id) != mtime) {
+			g_rw_lock_writer_lock (&index_lock);
+			ENTRY_FLAGS (current_index, id) = flags;
+			ENTRY_MTIME (current_index, id) = mtime;
+			index_dirty = TRUE;
+			g_rw_lock_writer_unlock (&index_lock);
+		}
+		return;
+	}
+
+	/* A new folder is crawled on its own, its first entry standing
+	 * for the folder */
+	sub = NULL;
+	if ((flags & ENTRY_DIRECTORY) && !(flags & ENTRY_MOUNT)) {
+		sub = index_new (NULL);
+		index_add_entry (sub, NO_PARENT, "", ENTRY_REMOVED, 0, NULL);
+		index_crawl_directory (sub, 0, location);
+	}
+
+	path = (flags & ENTRY_DIRECTORY) ? g_file_get_path (location) : NULL;
+
+	g_rw_lock_writer_lock (&index_lock);
+	if (id != NO_PARENT) {
+		index_remove_entry (current_index, id);
+	}
+	id = index_add_entry (current_index, parent, name, flags, mtime, path);
+	if (sub != NULL) {
+		index_merge (current_index, id, sub);
+	}
+	index_dirty = TRUE;
+	g_rw_lock_writer_unlock (&index_lock);
+
+	index_free (sub);
+	g_free (path);
+}
+
+static void
+add_file (GFile *location)
+{
+	GFileInfo *info;
+	GFile *parent_location;
+	char *fs_id;
+	guint32 parent, id;
+
+	parent = lookup_parent_entry (location);
+	if (parent == NO_PARENT) {
+		return;
+	}
+
+	info = g_file_query_info (location, CRAWL_ATTRIBUTES,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  NULL, NULL);
+	if (info == NULL) {
+		return;
+	}
+
+	parent_location = g_file_get_parent (location);
+	fs_id = get_filesystem_id (parent_location);
+	g_object_unref (parent_location);
+
+	id = index_find_entry (current_index, parent, g_file_info_get_name (info));
+	update_entry (parent, id, location, info, fs_id);
+
+	g_free (fs_id);
+	g_object_unref (info);
+}
+
+static void
+remove_file (GFile *location)
+{
+	guint32 parent, id;
+	char *name;
+
+	name = g_file_get_basename (location);
+
+	parent = lookup_parent_entry (location);
+	if (parent != NO_PARENT && name != NULL) {
+		id = index_find_entry (current_index, parent, name);
+		if (id != NO_PARENT) {
+			g_rw_lock_writer_lock (&index_lock);
+			index_remove_entry (current_index, id);
+			index_dirty = TRUE;
+			g_rw_lock_writer_unlock (&index_lock);
+		}
+	}
+
+	g_free (name);
+
+	maybe_compact_index ();
+}
+
+/* Call this on the index thread. Brings the entries of the folder id at
+ * location up to date with its contents; children are the entries
+ * currently in the folder. */
+static void
+refresh_directory (guint32 id,
+		   GFile *location,
+		   GArray *children)
+{
+	GHashTable *existing;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *child;
+	GHashTableIter iter;
+	gpointer value;
+	char *fs_id;
+	guint32 child_id;
+	guint i;
+
+	fs_id = get_filesystem_id (location);
+	enumerator = g_file_enumerate_children (location, CRAWL_ATTRIBUTES,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						NULL, NULL);
+	if (fs_id == NULL || enumerator == NULL) {
+		/* The folder is gone, its parent changed too */
+		g_clear_object (&enumerator);
+		g_free (fs_id);
+		return;
+	}
+
+	/* Adding entries moves the names, keep copies */
+	existing = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; children != NULL && i < children->len; i++) {
+		child_id = g_array_index (children, guint32, i);
+		g_hash_table_insert (existing, g_strdup (ENTRY_NAME (current_index, child_id)),
+				     GUINT_TO_POINTER (child_id));
+	}
+
+	while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+		child_id = NO_PARENT;
+		if (g_hash_table_lookup_extended (existing, g_file_info_get_name (info), NULL, &value)) {
+			child_id = GPOINTER_TO_UINT (value);
+			g_hash_table_remove (existing, g_file_info_get_name (info));
+		}
+
+		child = g_file_get_child (location, g_file_info_get_name (info));
+		update_entry (id, child_id, child, info, fs_id);
+		g_object_unref (child);
+		g_object_unref (info);
+	}
+	g_object_unref (enumerator);
+
+	/* Whatever was not seen is gone */
+	g_rw_lock_writer_lock (&index_lock);
+	g_hash_table_iter_init (&iter, existing);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		index_remove_entry (current_index, GPOINTER_TO_UINT (value));
+	}
+	index_dirty = TRUE;
+	g_rw_lock_writer_unlock (&index_lock);
+
+	g_hash_table_destroy (existing);
+	g_free (fs_id);
+}
+
+static void
+free_children (gpointer data)
+{
+	/* NULL for the folders that are empty */
+	if (data != NULL) {
+		g_array_free (data, TRUE);
+	}
+}
+
+/* Crawls the index again when it is old. Otherwise only the folders
+ * whose modification time changed are read again: that is where files
+ * were added, removed or renamed. */
+static void
+refresh_index (void)
+{
+	GHashTable *changed;
+	GHashTableIter iter;
+	GStatBuf statbuf;
+	GArray *children;
+	GFile *location;
+	gpointer key, value;
+	char *path;
+	guint32 id, parent;
+
+	if (current_index == NULL) {
+		return;
+	}
+
+	if (g_get_real_time () - current_index->stamp >= INDEX_MAX_AGE_USEC) {
+		crawl_index ();
+		return;
+	}
+
+	/* Changed folder id -> array of the ids of its entries */
+	changed = g_hash_table_new_full (NULL, NULL, NULL, free_children);
+	g_hash_table_iter_init (&iter, current_index->directories);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		id = GPOINTER_TO_UINT (value);
+		if (g_stat (key, &statbuf) == 0 &&
+		    (gint64) statbuf.st_mtime != ENTRY_MTIME (current_index, id)) {
+			g_hash_table_insert (changed, value, NULL);
+		}
+	}
+
+	DEBUG ("Refreshing %u changed folders of the filename index",
+	       g_hash_table_size (changed));
+
+	if (g_hash_table_size (changed) == 0) {
+		g_hash_table_destroy (changed);
+		maybe_compact_index ();
+		return;
+	}
+
+	for (id = 0; id < current_index->parents->len; id++) {
+		parent = ENTRY_PARENT (current_index, id);
+		if (parent == NO_PARENT ||
+		    (ENTRY_FLAGS (current_index, id) & ENTRY_REMOVED) ||
+		    !g_hash_table_lookup_extended (changed, GUINT_TO_POINTER (parent), NULL, &value)) {
+			continue;
+		}
+
+		children = value;
+		if (children == NULL) {
+			children = g_array_new (FALSE, FALSE, sizeof (guint32));
+			g_hash_table_insert (changed, GUINT_TO_POINTER (parent), children);
+		}
+		g_array_append_val (children, id);
+	}
+
+	g_hash_table_iter_init (&iter, changed);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		id = GPOINTER_TO_UINT (key);
+		path = get_entry_path (current_index, id);
+
+		/* A folder below one refreshed before may be gone, removing
+		 * a folder drops all of those below it */
+		if (g_hash_table_contains (current_index->directories, path) &&
+		    g_stat (path, &statbuf) == 0) {
+			location = g_file_new_for_path (path);
+			refresh_directory (id, location, value);
+			g_object_unref (location);
+
+			g_rw_lock_writer_lock (&index_lock);
+			ENTRY_MTIME (current_index, id) = statbuf.st_mtime;
+			g_rw_lock_writer_unlock (&index_lock);
+		}
+
+		g_free (path);
+	}
+	g_hash_table_destroy (changed);
+
+	maybe_compact_index ();
+}
+
+static void
+load_index (void)
+{
+	Index *index;
+	gboolean usable, fresh;
+
+	index = read_index ();
+
+	g_mutex_lock (&roots_mutex);
+	usable = index != NULL && roots_equal (index->roots, configured_roots);
+	g_mutex_unlock (&roots_mutex);
+
+	fresh = usable && g_get_real_time () - index->stamp < INDEX_MAX_AGE_USEC;
+	if (usable) {
+		/* An old index still answers until the new one is ready */
+		g_rw_lock_writer_lock (&index_lock);
+		current_index = index;
+		index_generation++;
+		index_dirty = FALSE;
+		g_rw_lock_writer_unlock (&index_lock);
+		DEBUG ("Loaded filename index, %u entries", index->parents->len);
+	}
+
+	if (!usable) {
+		index_free (index);
+	}
+
+	if (!fresh) {
+		crawl_index ();
+	} else {
+		/* Catch up with what changed while nautilus was not running */
+		refresh_index ();
+	}
+}
+
+static void
+index_thread_func (gpointer task_data,
+		   gpointer pool_data)
+{
+	IndexTask *task = task_data;
+
+	switch (task->type) {
+	case TASK_LOAD:
+		load_index ();
+		break;
+	case TASK_CRAWL:
+		crawl_index ();
+		break;
+	case TASK_ADD:
+		add_file (task->location);
+		break;
+	case TASK_REMOVE:
+		remove_file (task->location);
+		break;
+	case TASK_REFRESH:
+		refresh_index ();
+		save_index ();
+		break;
+	case TASK_SAVE:
+		save_index ();
+		break;
+	}
+
+	g_clear_object (&task->location);
+	g_slice_free (IndexTask, task);
+}
+
+static void
+push_task (IndexTaskType type,
+	   GFile *location)
+{
+	IndexTask *task;
+
+	task = g_slice_new0 (IndexTask);
+	task->type = type;
+	if (location != NULL) {
+		task->location = g_object_ref (location);
+	}
+
+	g_thread_pool_push (index_pool, task, NULL);
+}
+
+static char **
+get_configured_roots (void)
+{
+	char **roots;
+
+	roots = g_settings_get_strv (nautilus_preferences,
+				     NAUTILUS_PREFERENCES_SEARCH_INDEX_ROOTS);
+	if (roots[0] == NULL) {
+		g_strfreev (roots);
+		roots = g_new0 (char *, 2);
+		roots[0] = g_strdup (g_get_home_dir ());
+	}
+
+	return roots;
+}
+
+static void
+roots_changed (GSettings *settings,
+	       const char *key,
+	       gpointer user_data)
+{
+	char **roots;
+
+	roots = get_configured_roots ();
+
+	g_mutex_lock (&roots_mutex);
+	if (!roots_equal (roots, configured_roots)) {
+		g_strfreev (configured_roots);
+		configured_roots = roots;
+		roots = NULL;
+		push_task (TASK_CRAWL, NULL);
+	}
+	g_mutex_unlock (&roots_mutex);
+
+	g_strfreev (roots);
+}
+
+static void
+shutdown_index (void)
+{
+	if (save_timeout_id != 0) {
+		g_source_remove (save_timeout_id);
+		save_timeout_id = 0;
+	}
+
+	save_index ();
+}
+
+static gboolean
+save_timeout_cb (gpointer user_data)
+{
+	save_timeout_id = 0;
+	push_task (TASK_SAVE, NULL);
+
+	return FALSE;
+}
+
+static gboolean
+refresh_timeout_cb (gpointer user_data)
+{
+	push_task (TASK_REFRESH, NULL);
+
+	return TRUE;
+}
+
+static void
+ensure_index_requested (void)
+{
+	if (index_requested) {
+		return;
+	}
+
+	index_requested = TRUE;
+	configured_roots = get_configured_roots ();
+	g_signal_connect (nautilus_preferences,
+			  "changed::" NAUTILUS_PREFERENCES_SEARCH_INDEX_ROOTS,
+			  G_CALLBACK (roots_changed), NULL);
+	eel_debug_call_at_shutdown (shutdown_index);
+
+	index_pool = g_thread_pool_new (index_thread_func, NULL, 1, FALSE, NULL);
+	push_task (TASK_LOAD, NULL);
+
+	/* Monitors only see the folders that are open */
+	g_timeout_add_seconds (INDEX_REFRESH_INTERVAL_SECS, refresh_timeout_cb, NULL);
+}
+
+
+static void
+file_event (IndexTaskType type,
+	    GFile *location)
+{
+	static gint index_exists = -1;
+	char *filename;
+
+	if (!g_file_is_native (location)) {
+		return;
+	}
+
+	/* Events are only worth loading the index for if it is used */
+	if (!index_requested) {
+		if (index_exists == -1) {
+			filename = get_index_filename ();
+			index_exists = g_file_test (filename, G_FILE_TEST_EXISTS);
+			g_free (filename);
+		}
+		if (!index_exists) {
+			return;
+		}
+		ensure_index_requested ();
+	}
+
+	push_task (type, location);
+
+	if (save_timeout_id == 0) {
+		save_timeout_id = g_timeout_add_seconds (INDEX_SAVE_DELAY_SECS,
+							 save_timeout_cb, NULL);
+	}
+}
+
+void
+nautilus_filename_index_file_added (GFile *location)
+{
+	file_event (TASK_ADD, location);
+}
+
+void
+nautilus_filename_index_file_changed (GFile *location)
+{
+	file_event (TASK_ADD, location);
+}
+
+void
+nautilus_filename_index_file_removed (GFile *location)
+{
+	file_event (TASK_REMOVE, location);
+}
+
+gboolean
+nautilus_filename_index_covers (const char *uri)
+{
+	GFile *location;
+	char *path;
+	gboolean covered;
+
+	ensure_index_requested ();
+
+	location = g_file_new_for_uri (uri);
+	path = g_file_get_path (location);
+	g_object_unref (location);
+
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	/* Called on the main thread, so don't wait for the index thread
+	 * to be done with a change, and crawl instead */
+	covered = FALSE;
+	if (g_rw_lock_reader_trylock (&index_lock)) {
+		covered = current_index != NULL &&
+			g_hash_table_contains (current_index->directories, path);
+		g_rw_lock_reader_unlock (&index_lock);
+	}
+
+	g_free (path);
+
+	return covered;
+}
+
+static gboolean
+matches_mime_types (const char *display_name,
+		    guint8 flags,
+		    GList *mime_types)
+{
+	char *content_type;
+	gboolean found;
+	GList *l;
+
+	if (flags & ENTRY_DIRECTORY) {
+		content_type = g_strdup ("inode/directory");
+	} else {
+		content_type = g_content_type_guess (display_name, NULL, 0, NULL);
+	}
+
+	found = FALSE;
+	for (l = mime_types; l != NULL; l = l->next) {
+		if (g_content_type_is_a (content_type, l->data)) {
+			found = TRUE;
+			break;
+		}
+	}
+
+	g_free (content_type);
+
+	return found;
+}
+
+/* Times a query starts over when the index is replaced under it */
+#define QUERY_MAX_ATTEMPTS 3
+
+typedef struct {
+	guint32 id;
+	guint32 name_offset;
+	guint8 flags;
+	gint64 mtime;
+	gdouble rank;
+	char *path;
+} IndexMatch;
+
+/* Copies the candidates below path out of the current index, so that
+ * matching them does not keep the index locked. Returns FALSE if path
+ * is not in the index. */
+static gboolean
+collect_candidates (const char *path,
+		    char **words,
+		    gboolean show_hidden,
+		    GCancellable *cancellable,
+		    GArray *candidates,
+		    GByteArray *names,
+		    guint *generation)
+{
+	CandidateIter iter;
+	IndexMatch candidate = { 0, };
+	const char *name;
+	gpointer value;
+	gboolean found;
+	guint32 id, location_id;
+	guint n_checked;
+
+	g_rw_lock_reader_lock (&index_lock);
+
+	*generation = index_generation;
+	found = current_index != NULL && path != NULL &&
+		g_hash_table_lookup_extended (current_index->directories, path, NULL, &value);
+
+	if (found) {
+		location_id = GPOINTER_TO_UINT (value);
+		n_checked = 0;
+
+		candidate_iter_init (&iter, current_index, words);
+		while (candidate_iter_next (&iter, &id)) {
+			if (++n_checked % 4096 == 0 &&
+			    g_cancellable_is_cancelled (cancellable)) {
+				break;
+			}
+
+			if (!index_entry_is_below (current_index, id, location_id, show_hidden)) {
+				continue;
+			}
+
+			name = ENTRY_NAME (current_index, id);
+			candidate.id = id;
+			candidate.name_offset = names->len;
+			candidate.flags = ENTRY_FLAGS (current_index, id);
+			candidate.mtime = ENTRY_MTIME (current_index, id);
+			g_byte_array_append (names, (const guint8 *) name, strlen (name) + 1);
+			g_array_append_val (candidates, candidate);
+		}
+		candidate_iter_clear (&iter);
+	}
+
+	g_rw_lock_reader_unlock (&index_lock);
+
+	return found;
+}
+
+/* Returns FALSE if the index was replaced since the candidates were
+ * collected, and their ids mean nothing anymore. */
+static gboolean
+get_match_paths (GArray *matches,
+		 guint generation)
+{
+	IndexMatch *match;
+	gboolean valid;
+	guint i;
+
+	g_rw_lock_reader_lock (&index_lock);
+
+	valid = generation == index_generation;
+	for (i = 0; valid && i < matches->len; i++) {
+		match = &g_array_index (matches, IndexMatch, i);
+		match->path = get_entry_path (current_index, match->id);
+	}
+
+	g_rw_lock_reader_unlock (&index_lock);
+
+	return valid;
+}
+
+GList *
+nautilus_filename_index_query (NautilusQuery *query,
+			       GCancellable *cancellable)
+{
+	GArray *candidates, *matches;
+	GByteArray *names;
+	IndexMatch *match;
+	NautilusSearchHit *hit;
+	GDateTime *dt;
+	GFile *location;
+	GList *mime_types, *hits;
+	char *text, *folded, *uri, *path, *display_name;
+	const char *name;
+	char **words;
+	gboolean show_hidden, found, valid;
+	guint i, j, generation, attempt;
+	gdouble rank;
+
+	text = nautilus_query_get_text (query);
+	if (text == NULL) {
+		return NULL;
+	}
+
+	folded = fold_string (text);
+	words = g_strsplit (folded, " ", -1);
+	g_free (folded);
+	g_free (text);
+
+	uri = nautilus_query_get_location (query);
+	location = g_file_new_for_uri (uri);
+	path = g_file_get_path (location);
+	g_object_unref (location);
+	g_free (uri);
+
+	mime_types = nautilus_query_get_mime_types (query);
+	show_hidden = nautilus_query_get_show_hidden_files (query);
+	candidates = g_array_new (FALSE, FALSE, sizeof (IndexMatch));
+	matches = g_array_new (FALSE, FALSE, sizeof (IndexMatch));
+	names = g_byte_array_new ();
+
+	valid = FALSE;
+	for (attempt = 0; attempt < QUERY_MAX_ATTEMPTS && !valid; attempt++) {
+		g_array_set_size (candidates, 0);
+		g_array_set_size (matches, 0);
+		g_byte_array_set_size (names, 0);
+
+		if (!collect_candidates (path, words, show_hidden, cancellable,
+					 candidates, names, &generation)) {
+			break;
+		}
+
+		for (i = 0; i < candidates->len; i++) {
+			if (i % 4096 == 0 && g_cancellable_is_cancelled (cancellable)) {
+				break;
+			}
+
+			match = &g_array_index (candidates, IndexMatch, i);
+			name = (const char *) names->data + match->name_offset;
+
+			/* The trigrams only narrow the candidates down */
+			folded = fold_name (name);
+			found = TRUE;
+			for (j = 0; words[j] != NULL && found; j++) {
+				found = strstr (folded, words[j]) != NULL;
+			}
+			g_free (folded);
+
+			if (!found) {
+				continue;
+			}
+
+			display_name = g_filename_display_name (name);
+			rank = nautilus_query_matches_string (query, display_name);
+			found = rank > -1 &&
+				(mime_types == NULL ||
+				 matches_mime_types (display_name, match->flags, mime_types));
+			g_free (display_name);
+
+			if (found) {
+				match->rank = rank;
+				g_array_append_val (matches, *match);
+			}
+		}
+
+		valid = get_match_paths (matches, generation);
+	}
+
+	DEBUG ("Filename index checked %u candidates, %u matches",
+	       candidates->len, valid ? matches->len : 0);
+
+	if (!valid) {
+		g_array_set_size (matches, 0);
+	}
+
+	/* Changes outside of the monitored folders are only seen by the
+	 * next crawl, so don't report files that are gone. */
+	hits = NULL;
+	for (i = 0; i < matches->len; i++) {
+		match = &g_array_index (matches, IndexMatch, i);
+
+		if (!g_cancellable_is_cancelled (cancellable) &&
+		    g_file_test (match->path, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_SYMLINK)) {
+			uri = g_filename_to_uri (match->path, NULL, NULL);
+			hit = nautilus_search_hit_new (uri);
+			nautilus_search_hit_set_fts_rank (hit, match->rank);
+			dt = g_date_time_new_from_unix_local (match->mtime);
+			nautilus_search_hit_set_modification_time (hit, dt);
+			g_date_time_unref (dt);
+			hits = g_list_prepend (hits, hit);
+			g_free (uri);
+		}
+
+		g_free (match->path);
+	}
+
+	g_array_free (matches, TRUE);
+	g_array_free (candidates, TRUE);
+	g_byte_array_free (names, TRUE);
+	g_list_free_full (mime_types, g_free);
+	g_strfreev (words);
+	g_free (path);
+
+	return hits;
+}
@@ -0,0 +1,59 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-filename-index.h: Persistent index of the file names below
+   the folders configured for search.
+
+   Copyright (C) 2014 Endless Mobile, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef NAUTILUS_FILENAME_INDEX_H
+#define NAUTILUS_FILENAME_INDEX_H
+
+#include <gio/gio.h>
+#include "nautilus-query.h"
+
+/* Keeps the names of every file below the folders listed in the
+ * search-index-roots setting (the home folder by default) in memory,
+ * with a trigram index that answers substring queries without touching
+ * the disk. The index is written to the user cache directory, updated
+ * from the directory monitors while Nautilus runs, and every few minutes
+ * the folders whose modification time changed are read again, since
+ * monitors only watch the open folders. It is crawled again from scratch
+ * once it gets old. Mount points below the roots are in the index, but
+ * not what they hold.
+ *
+ * All the work happens on a background thread; the functions below can
+ * be called from the main thread.
+ */
+
+/* Returns TRUE if the index is loaded and uri is a folder below one of
+ * its roots. Starts loading the index if needed. */
+gboolean nautilus_filename_index_covers        (const char    *uri);
+
+/* Returns a list of NautilusSearchHits for the files matching query, or
+ * NULL if the index doesn't cover the query location. Blocks while the
+ * index is searched, so call it from a thread. */
+GList *  nautilus_filename_index_query         (NautilusQuery *query,
+						GCancellable  *cancellable);
+
+/* Keep the index up to date with what the directory monitors see */
+void     nautilus_filename_index_file_added    (GFile         *location);
+void     nautilus_filename_index_file_changed  (GFile         *location);
+void     nautilus_filename_index_file_removed  (GFile         *location);
+
+#endif /* NAUTILUS_FILENAME_INDEX_H */
@@ -35,6 +35,10 @@ G_BEGIN_DECLS
 #define NAUTILUS_PREFERENCES_CONFIRM_TRASH			"confirm-trash"
 #define NAUTILUS_PREFERENCES_ENABLE_DELETE			"enable-delete"
 
+/* File operations */
+#define NAUTILUS_PREFERENCES_CONCURRENT_COPIES			"concurrent-copies"
+#define NAUTILUS_PREFERENCES_OPERATIONS_PER_DEVICE		"operations-per-device"
+
 /* Display  */
 #define NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES			"show-hidden"
 
@@ -132,6 +136,9 @@ typedef enum
 #define NAUTILUS_PREFERENCES_SHOW_FILE_THUMBNAILS	"show-image-thumbnails"
 #define NAUTILUS_PREFERENCES_FILE_THUMBNAIL_LIMIT	"thumbnail-limit"
 
+/* Search */
+#define NAUTILUS_PREFERENCES_SEARCH_INDEX_ROOTS		"search-index-roots"
+
 typedef enum
 {
 	NAUTILUS_COMPLEX_SEARCH_BAR,
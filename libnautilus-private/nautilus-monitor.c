@@ -27,6 +27,7 @@
 #include <config.h>
 #include "nautilus-monitor.h"
 #include "nautilus-file-changes-queue.h"
+#include "nautilus-filename-index.h"
 #include "nautilus-file-utilities.h"
 
 #include <gio/gio.h>
@@ -62,7 +63,13 @@ nautilus_monitor_active (void)
 	return monitor_success;
 }
 
-static gboolean call_consume_changes_idle_id = 0;
+/* Changes arriving within this many milliseconds of the first one are
+ * delivered together, which gives the changes queue a chance to coalesce
+ * bursts of events (e.g. a build or a git checkout) on the same files.
+ */
+#define CONSUME_CHANGES_DELAY_MSEC 100
+
+static guint call_consume_changes_idle_id = 0;
 
 static gboolean
 call_consume_changes_idle_cb (gpointer not_used)
@@ -77,7 +84,8 @@ schedule_call_consume_changes (void)
 {
 	if (call_consume_changes_idle_id == 0) {
 		call_consume_changes_idle_id =
-			g_idle_add (call_consume_changes_idle_cb, NULL);
+			g_timeout_add (CONSUME_CHANGES_DELAY_MSEC,
+				       call_consume_changes_idle_cb, NULL);
 	}
 }
 
@@ -117,13 +125,16 @@ dir_changed (GFileMonitor* monitor,
 	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
 	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
 		nautilus_file_changes_queue_file_changed (child);
+		nautilus_filename_index_file_changed (child);
 		break;
 	case G_FILE_MONITOR_EVENT_UNMOUNTED:
 	case G_FILE_MONITOR_EVENT_DELETED:
 		nautilus_file_changes_queue_file_removed (child);
+		nautilus_filename_index_file_removed (child);
 		break;
 	case G_FILE_MONITOR_EVENT_CREATED:
 		nautilus_file_changes_queue_file_added (child);
+		nautilus_filename_index_file_added (child);
 		break;
 	}
 
@@ -24,10 +24,42 @@
 
 #include <config.h>
 
+#include <glib/gi18n.h>
+
 #include "nautilus-progress-info-manager.h"
+#include "nautilus-global-preferences.h"
+
+/* Jobs writing to the same file system are queued, and only a few of
+ * them (NAUTILUS_PREFERENCES_OPERATIONS_PER_DEVICE) run at a time, so
+ * that several big copies to one disk don't fight over it.
+ */
+typedef struct {
+	char *fs_id;
+	GQueue waiting;
+	int running;
+} DeviceQueue;
+
+typedef struct {
+	NautilusProgressInfoManager *manager;
+	NautilusProgressInfo *info;
+	GCancellable *cancellable;
+	GIOSchedulerJobFunc job_func;
+	gpointer user_data;
+	DeviceQueue *queue;
+	gulong cancelled_id;
+
+	/* For moves, the first source, and the file system of the
+	 * destination while the one of the source is looked up */
+	GFile *source_file;
+	char *fs_id;
+} ScheduledJob;
 
 struct _NautilusProgressInfoManagerPriv {
 	GList *progress_infos;
+
+	GSettings *settings;
+	GHashTable *device_queues;
+	GHashTable *queued_jobs;
 };
 
 enum {
@@ -51,6 +83,12 @@ nautilus_progress_info_manager_finalize (GObject *obj)
 		g_list_free_full (self->priv->progress_infos, g_object_unref);
 	}
 
+	/* Every scheduled job keeps the manager alive */
+	g_assert (g_hash_table_size (self->priv->queued_jobs) == 0);
+	g_hash_table_destroy (self->priv->queued_jobs);
+	g_hash_table_destroy (self->priv->device_queues);
+	g_object_unref (self->priv->settings);
+
 	G_OBJECT_CLASS (nautilus_progress_info_manager_parent_class)->finalize (obj);
 }
 
@@ -79,6 +117,10 @@ nautilus_progress_info_manager_init (NautilusProgressInfoManager *self)
 {
 	self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, NAUTILUS_TYPE_PROGRESS_INFO_MANAGER,
 						  NautilusProgressInfoManagerPriv);
+
+	self->priv->settings = g_settings_new ("org.gnome.nautilus.preferences");
+	self->priv->device_queues = g_hash_table_new (g_str_hash, g_str_equal);
+	self->priv->queued_jobs = g_hash_table_new (NULL, NULL);
 }
 
 static void
@@ -140,3 +182,333 @@ nautilus_progress_info_manager_get_all_infos (NautilusProgressInfoManager *self)
 {
 	return self->priv->progress_infos;
 }
+
+static void
+scheduled_job_free (ScheduledJob *job)
+{
+	if (job->cancelled_id != 0) {
+		g_signal_handler_disconnect (job->cancellable, job->cancelled_id);
+	}
+	g_clear_object (&job->source_file);
+	g_free (job->fs_id);
+	g_object_unref (job->cancellable);
+	g_object_unref (job->info);
+	g_object_unref (job->manager);
+	g_slice_free (ScheduledJob, job);
+}
+
+static void
+device_queue_free (DeviceQueue *queue)
+{
+	g_assert (g_queue_is_empty (&queue->waiting));
+
+	g_free (queue->fs_id);
+	g_slice_free (DeviceQueue, queue);
+}
+
+static void device_queue_run (NautilusProgressInfoManager *self,
+			      DeviceQueue *queue);
+
+static gboolean
+scheduled_job_done (gpointer user_data)
+{
+	ScheduledJob *job;
+	NautilusProgressInfoManager *self;
+	DeviceQueue *queue;
+
+	job = user_data;
+	self = job->manager;
+	queue = job->queue;
+
+	if (queue != NULL) {
+		queue->running--;
+		device_queue_run (self, queue);
+
+		if (queue->running == 0 &&
+		    g_queue_is_empty (&queue->waiting)) {
+			g_hash_table_remove (self->priv->device_queues, queue->fs_id);
+			device_queue_free (queue);
+		}
+	}
+
+	scheduled_job_free (job);
+
+	return FALSE;
+}
+
+static gboolean
+scheduled_job_func (GIOSchedulerJob *io_job,
+		    GCancellable *cancellable,
+		    gpointer user_data)
+{
+	ScheduledJob *job;
+
+	job = user_data;
+
+	while (job->job_func (io_job, cancellable, job->user_data)) {
+		;
+	}
+
+	/* The device is free once the job thread is done, even if
+	 * the job still has to report back to the main loop */
+	g_idle_add (scheduled_job_done, job);
+
+	return FALSE;
+}
+
+static void
+scheduled_job_run (ScheduledJob *job)
+{
+	if (job->queue != NULL) {
+		job->queue->running++;
+	}
+
+	if (job->cancelled_id != 0) {
+		g_signal_handler_disconnect (job->cancellable, job->cancelled_id);
+		job->cancelled_id = 0;
+	}
+
+	g_hash_table_remove (job->manager->priv->queued_jobs, job->info);
+	nautilus_progress_info_set_queued (job->info, FALSE);
+
+	/* Like the jobs did before; a job must run even if
+	 * it was cancelled, to report back */
+	g_io_scheduler_push_job (scheduled_job_func,
+				 job,
+				 NULL, /* destroy notify */
+				 0,
+				 NULL);
+}
+
+static void
+device_queue_run (NautilusProgressInfoManager *self,
+		  DeviceQueue *queue)
+{
+	int limit;
+
+	limit = g_settings_get_int (self->priv->settings,
+				    NAUTILUS_PREFERENCES_OPERATIONS_PER_DEVICE);
+
+	while (queue->running < limit &&
+	       !g_queue_is_empty (&queue->waiting)) {
+		scheduled_job_run (g_queue_pop_head (&queue->waiting));
+	}
+}
+
+static gboolean
+start_cancelled_job (gpointer user_data)
+{
+	NautilusProgressInfo *info;
+	NautilusProgressInfoManager *self;
+	ScheduledJob *job;
+
+	info = user_data;
+	self = nautilus_progress_info_manager_new ();
+
+	/* There's nothing left to wait for; let the job
+	 * run so it can clean up and report back */
+	job = g_hash_table_lookup (self->priv->queued_jobs, info);
+	if (job != NULL && job->queue != NULL) {
+		g_queue_remove (&job->queue->waiting, job);
+		scheduled_job_run (job);
+	}
+
+	g_object_unref (self);
+	g_object_unref (info);
+
+	return FALSE;
+}
+
+static void
+queued_job_cancelled (GCancellable *cancellable,
+		      NautilusProgressInfo *info)
+{
+	/* Might be on any thread */
+	g_idle_add (start_cancelled_job, g_object_ref (info));
+}
+
+static void
+scheduled_job_queue (ScheduledJob *job,
+		     const char *fs_id)
+{
+	NautilusProgressInfoManager *self;
+	DeviceQueue *queue;
+
+	self = job->manager;
+
+	if (fs_id == NULL ||
+	    g_cancellable_is_cancelled (job->cancellable)) {
+		scheduled_job_run (job);
+		return;
+	}
+
+	queue = g_hash_table_lookup (self->priv->device_queues, fs_id);
+	if (queue == NULL) {
+		queue = g_slice_new0 (DeviceQueue);
+		queue->fs_id = g_strdup (fs_id);
+		g_queue_init (&queue->waiting);
+		g_hash_table_insert (self->priv->device_queues, queue->fs_id, queue);
+	}
+
+	job->queue = queue;
+	g_queue_push_tail (&queue->waiting, job);
+	device_queue_run (self, queue);
+
+	if (g_hash_table_lookup (self->priv->queued_jobs, job->info) == job) {
+		nautilus_progress_info_set_queued (job->info, TRUE);
+		nautilus_progress_info_set_details (job->info,
+						    _("Waiting for other operations on the same device"));
+		job->cancelled_id = g_signal_connect (job->cancellable, "cancelled",
+						      G_CALLBACK (queued_job_cancelled), job->info);
+	}
+}
+
+static void
+query_source_fs_id_cb (GObject *source_object,
+		       GAsyncResult *res,
+		       gpointer user_data)
+{
+	ScheduledJob *job;
+	GFileInfo *info;
+	char *fs_id;
+
+	job = user_data;
+	fs_id = job->fs_id;
+	job->fs_id = NULL;
+
+	/* Moving within a file system is only a rename, which doesn't
+	 * have to wait for the copies */
+	info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+	if (info != NULL &&
+	    g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM),
+		       fs_id) == 0) {
+		scheduled_job_queue (job, NULL);
+	} else {
+		scheduled_job_queue (job, fs_id);
+	}
+
+	g_clear_object (&info);
+	g_free (fs_id);
+}
+
+static void
+query_fs_id_cb (GObject *source_object,
+		GAsyncResult *res,
+		gpointer user_data)
+{
+	ScheduledJob *job;
+	GFileInfo *info;
+	const char *fs_id;
+
+	job = user_data;
+
+	info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+	fs_id = info != NULL ? g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM) : NULL;
+
+	if (fs_id != NULL && job->source_file != NULL) {
+		job->fs_id = g_strdup (fs_id);
+		g_file_query_info_async (job->source_file,
+					 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+					 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					 G_PRIORITY_DEFAULT,
+					 NULL,
+					 query_source_fs_id_cb,
+					 job);
+	} else {
+		scheduled_job_queue (job, fs_id);
+	}
+
+	g_clear_object (&info);
+}
+
+static void
+queue_job (NautilusProgressInfoManager *self,
+	   NautilusProgressInfo *info,
+	   GFile *source_file,
+	   GFile *device_file,
+	   GIOSchedulerJobFunc job_func,
+	   gpointer user_data)
+{
+	ScheduledJob *job;
+
+	job = g_slice_new0 (ScheduledJob);
+	job->manager = g_object_ref (self);
+	job->info = g_object_ref (info);
+	job->cancellable = nautilus_progress_info_get_cancellable (info);
+	job->job_func = job_func;
+	job->user_data = user_data;
+	if (source_file != NULL) {
+		job->source_file = g_object_ref (source_file);
+	}
+
+	g_hash_table_insert (self->priv->queued_jobs, info, job);
+
+	if (device_file == NULL) {
+		scheduled_job_run (job);
+		return;
+	}
+
+	/* Show the job while its device is being looked up,
+	 * and while it waits for its turn */
+	nautilus_progress_info_start (info);
+
+	g_file_query_info_async (device_file,
+				 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				 G_PRIORITY_DEFAULT,
+				 NULL,
+				 query_fs_id_cb,
+				 job);
+}
+
+/* Runs job_func in an I/O job thread, like g_io_scheduler_push_job() does,
+ * once it is the turn of the job among the others writing to the file system
+ * of device_file. Jobs without a device_file run right away.
+ */
+void
+nautilus_progress_info_manager_queue_job (NautilusProgressInfoManager *self,
+					  NautilusProgressInfo *info,
+					  GFile *device_file,
+					  GIOSchedulerJobFunc job_func,
+					  gpointer user_data)
+{
+	queue_job (self, info, NULL, device_file, job_func, user_data);
+}
+
+/* Like nautilus_progress_info_manager_queue_job(), for a move of
+ * source_file, but runs right away when source_file is on the file
+ * system of device_file. */
+void
+nautilus_progress_info_manager_queue_move_job (NautilusProgressInfoManager *self,
+					       NautilusProgressInfo *info,
+					       GFile *source_file,
+					       GFile *device_file,
+					       GIOSchedulerJobFunc job_func,
+					       gpointer user_data)
+{
+	queue_job (self, info, source_file, device_file, job_func, user_data);
+}
+
+/* Moves a queued job delta places towards the front (negative)
+ * or the back (positive) of the queue of its device */
+void
+nautilus_progress_info_manager_move_job (NautilusProgressInfoManager *self,
+					 NautilusProgressInfo *info,
+					 int delta)
+{
+	ScheduledJob *job;
+	GQueue *waiting;
+	int position;
+
+	job = g_hash_table_lookup (self->priv->queued_jobs, info);
+	if (job == NULL || job->queue == NULL) {
+		return;
+	}
+
+	waiting = &job->queue->waiting;
+	position = g_queue_index (waiting, job) + delta;
+	position = CLAMP (position, 0, (int) g_queue_get_length (waiting) - 1);
+
+	g_queue_remove (waiting, job);
+	g_queue_push_nth (waiting, job, position);
+}
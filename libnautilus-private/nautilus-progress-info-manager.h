@@ -26,6 +26,7 @@
 #define __NAUTILUS_PROGRESS_INFO_MANAGER_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <libnautilus-private/nautilus-progress-info.h>
 
@@ -64,6 +65,21 @@ void nautilus_progress_info_manager_add_new_info (NautilusProgressInfoManager *s
                                                   NautilusProgressInfo *info);
 GList *nautilus_progress_info_manager_get_all_infos (NautilusProgressInfoManager *self);
 
+void nautilus_progress_info_manager_queue_job (NautilusProgressInfoManager *self,
+                                               NautilusProgressInfo *info,
+                                               GFile *device_file,
+                                               GIOSchedulerJobFunc job_func,
+                                               gpointer user_data);
+void nautilus_progress_info_manager_queue_move_job (NautilusProgressInfoManager *self,
+                                                    NautilusProgressInfo *info,
+                                                    GFile *source_file,
+                                                    GFile *device_file,
+                                                    GIOSchedulerJobFunc job_func,
+                                                    gpointer user_data);
+void nautilus_progress_info_manager_move_job (NautilusProgressInfoManager *self,
+                                              NautilusProgressInfo *info,
+                                              int delta);
+
 G_END_DECLS
 
 #endif /* __NAUTILUS_PROGRESS_INFO_MANAGER_H__ */
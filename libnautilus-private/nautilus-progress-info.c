@@ -56,6 +56,8 @@ struct _NautilusProgressInfo
 	gboolean started;
 	gboolean finished;
 	gboolean paused;
+	gboolean user_paused;
+	gboolean queued;
 	
 	GSource *idle_source;
 	gboolean source_is_now;
@@ -73,6 +75,9 @@ struct _NautilusProgressInfoClass
 
 G_LOCK_DEFINE_STATIC(progress_info);
 
+/* Signalled, with the progress_info lock, when a job is resumed or cancelled */
+static GCond user_paused_cond;
+
 G_DEFINE_TYPE (NautilusProgressInfo, nautilus_progress_info, G_TYPE_OBJECT)
 
 static void
@@ -157,12 +162,25 @@ nautilus_progress_info_class_init (NautilusProgressInfoClass *klass)
 	
 }
 
+/* Jobs get cancelled through their cancellable too, wake them up if
+ * they are paused. */
+static void
+cancellable_cancelled (GCancellable *cancellable,
+		       gpointer      user_data)
+{
+	G_LOCK (progress_info);
+	g_cond_broadcast (&user_paused_cond);
+	G_UNLOCK (progress_info);
+}
+
 static void
 nautilus_progress_info_init (NautilusProgressInfo *info)
 {
 	NautilusProgressInfoManager *manager;
 
 	info->cancellable = g_cancellable_new ();
+	g_signal_connect (info->cancellable, "cancelled",
+			  G_CALLBACK (cancellable_cancelled), NULL);
 
 	manager = nautilus_progress_info_manager_new ();
 	nautilus_progress_info_manager_add_new_info (manager, info);
@@ -236,11 +254,8 @@ nautilus_progress_info_get_progress (NautilusProgressInfo *info)
 void
 nautilus_progress_info_cancel (NautilusProgressInfo *info)
 {
-	G_LOCK (progress_info);
-	
+	/* Not under the lock, cancellable_cancelled() takes it */
 	g_cancellable_cancel (info->cancellable);
-	
-	G_UNLOCK (progress_info);
 }
 
 GCancellable *
@@ -299,6 +314,34 @@ nautilus_progress_info_get_is_paused (NautilusProgressInfo *info)
 	return res;
 }
 
+gboolean
+nautilus_progress_info_get_is_user_paused (NautilusProgressInfo *info)
+{
+	gboolean res;
+	
+	G_LOCK (progress_info);
+	
+	res = info->user_paused;
+	
+	G_UNLOCK (progress_info);
+	
+	return res;
+}
+
+gboolean
+nautilus_progress_info_get_is_queued (NautilusProgressInfo *info)
+{
+	gboolean res;
+	
+	G_LOCK (progress_info);
+	
+	res = info->queued;
+	
+	G_UNLOCK (progress_info);
+	
+	return res;
+}
+
 static gboolean
 idle_callback (gpointer data)
 {
@@ -422,6 +465,78 @@ nautilus_progress_info_resume (NautilusProgressInfo *info)
 	G_UNLOCK (progress_info);
 }
 
+/* Pausing on behalf of the user, unlike nautilus_progress_info_pause(),
+ * which only tells that the job is waiting for a dialog. The job thread
+ * stops in nautilus_progress_info_wait_while_user_paused().
+ */
+void
+nautilus_progress_info_set_user_paused (NautilusProgressInfo *info,
+					gboolean              paused)
+{
+	G_LOCK (progress_info);
+
+	if (info->user_paused != paused) {
+		info->user_paused = paused;
+		if (!paused) {
+			g_cond_broadcast (&user_paused_cond);
+		}
+
+		info->changed_at_idle = TRUE;
+		queue_idle (info, TRUE);
+	}
+
+	G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_wait_while_user_paused (NautilusProgressInfo *info)
+{
+	G_LOCK (progress_info);
+
+	while (info->user_paused &&
+	       !g_cancellable_is_cancelled (info->cancellable)) {
+		g_cond_wait (&user_paused_cond, &G_LOCK_NAME (progress_info));
+	}
+
+	G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_set_queued (NautilusProgressInfo *info,
+				   gboolean              queued)
+{
+	G_LOCK (progress_info);
+
+	if (info->queued != queued) {
+		info->queued = queued;
+
+		info->changed_at_idle = TRUE;
+		queue_idle (info, TRUE);
+	}
+
+	G_UNLOCK (progress_info);
+}
+
+void
+nautilus_progress_info_raise (NautilusProgressInfo *info)
+{
+	NautilusProgressInfoManager *manager;
+
+	manager = nautilus_progress_info_manager_new ();
+	nautilus_progress_info_manager_move_job (manager, info, -1);
+	g_object_unref (manager);
+}
+
+void
+nautilus_progress_info_lower (NautilusProgressInfo *info)
+{
+	NautilusProgressInfoManager *manager;
+
+	manager = nautilus_progress_info_manager_new ();
+	nautilus_progress_info_manager_move_job (manager, info, 1);
+	g_object_unref (manager);
+}
+
 void
 nautilus_progress_info_start (NautilusProgressInfo *info)
 {
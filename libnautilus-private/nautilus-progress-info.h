@@ -47,7 +47,12 @@ GType nautilus_progress_info_get_type (void) G_GNUC_CONST;
    "finished" - emitted when job is done
    
    All signals are emitted from idles in main loop.
-   All methods are threadsafe.
+   All methods are threadsafe, except raise and lower, which
+   must be called from the main loop.
+
+   A job that waits for other jobs on the same device is started
+   (so that it shows up) and queued until it really runs. Raising
+   or lowering it moves it one place in the queue of that device.
  */
 
 NautilusProgressInfo *nautilus_progress_info_new (void);
@@ -62,11 +67,20 @@ void          nautilus_progress_info_cancel          (NautilusProgressInfo *info
 gboolean      nautilus_progress_info_get_is_started  (NautilusProgressInfo *info);
 gboolean      nautilus_progress_info_get_is_finished (NautilusProgressInfo *info);
 gboolean      nautilus_progress_info_get_is_paused   (NautilusProgressInfo *info);
+gboolean      nautilus_progress_info_get_is_user_paused (NautilusProgressInfo *info);
+gboolean      nautilus_progress_info_get_is_queued   (NautilusProgressInfo *info);
 
 void          nautilus_progress_info_start           (NautilusProgressInfo *info);
 void          nautilus_progress_info_finish          (NautilusProgressInfo *info);
 void          nautilus_progress_info_pause           (NautilusProgressInfo *info);
 void          nautilus_progress_info_resume          (NautilusProgressInfo *info);
+void          nautilus_progress_info_set_user_paused (NautilusProgressInfo *info,
+						      gboolean              paused);
+void          nautilus_progress_info_wait_while_user_paused (NautilusProgressInfo *info);
+void          nautilus_progress_info_set_queued      (NautilusProgressInfo *info,
+						      gboolean              queued);
+void          nautilus_progress_info_raise           (NautilusProgressInfo *info);
+void          nautilus_progress_info_lower           (NautilusProgressInfo *info);
 void          nautilus_progress_info_set_status      (NautilusProgressInfo *info,
 						      const char           *status);
 void          nautilus_progress_info_take_status     (NautilusProgressInfo *info,
@@ -30,13 +30,24 @@
 #include "nautilus-file-utilities.h"
 #include "nautilus-query.h"
 
+/* The words of the query text, folded like the strings they are
+ * compared to. Built on first use and then shared by the threads of
+ * the search engines.
+ */
+typedef struct {
+	char **words;
+	gsize *lengths;
+	/* Whether every word is plain ASCII */
+	gboolean ascii;
+} PreparedWords;
+
 struct NautilusQueryDetails {
 	char *text;
 	char *location_uri;
 	GList *mime_types;
 	gboolean show_hidden;
 
-	char **prepared_words;
+	PreparedWords *prepared_words;
 };
 
 static void  nautilus_query_class_init       (NautilusQueryClass *class);
@@ -44,6 +55,18 @@ static void  nautilus_query_init             (NautilusQuery      *query);
 
 G_DEFINE_TYPE (NautilusQuery, nautilus_query, G_TYPE_OBJECT);
 
+static void
+prepared_words_free (PreparedWords *prepared)
+{
+	if (prepared == NULL) {
+		return;
+	}
+
+	g_strfreev (prepared->words);
+	g_free (prepared->lengths);
+	g_free (prepared);
+}
+
 static void
 finalize (GObject *object)
 {
@@ -51,7 +74,7 @@ finalize (GObject *object)
 
 	query = NAUTILUS_QUERY (object);
 	g_free (query->details->text);
-	g_strfreev (query->details->prepared_words);
+	prepared_words_free (query->details->prepared_words);
 	g_free (query->details->location_uri);
 
 	G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
@@ -89,11 +112,97 @@ prepare_string_for_compare (const gchar *string)
 	return res;
 }
 
+#define ONE_BYTES G_GUINT64_CONSTANT (0x0101010101010101)
+#define HIGH_BITS (ONE_BYTES * 0x80)
+
+/* Lower-cases the length bytes of string into folded, eight at a time,
+ * and returns TRUE if string is plain ASCII. For those, this is the same
+ * as prepare_string_for_compare () since normalization doesn't change
+ * them, but much cheaper. */
+static gboolean
+fold_ascii_string (const gchar *string,
+		   gsize length,
+		   gchar *folded)
+{
+	guint64 chunk, is_upper;
+	gsize i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		memcpy (&chunk, string + i, 8);
+		if (chunk & HIGH_BITS) {
+			return FALSE;
+		}
+
+		/* Without high bits no byte carries into the next one, and
+		 * the high bit of the sums tells whether a byte is at least
+		 * 'A' and whether it is past 'Z' */
+		is_upper = (chunk + ONE_BYTES * (0x80 - 'A')) &
+			~(chunk + ONE_BYTES * (0x7f - 'Z')) &
+			HIGH_BITS;
+		chunk |= is_upper >> 2;
+		memcpy (folded + i, &chunk, 8);
+	}
+
+	for (; i < length; i++) {
+		if ((guchar) string[i] & 0x80) {
+			return FALSE;
+		}
+		folded[i] = g_ascii_tolower (string[i]);
+	}
+	folded[length] = '\0';
+
+	return TRUE;
+}
+
+static gboolean
+string_is_ascii (const gchar *string)
+{
+	for (; *string != '\0'; string++) {
+		if ((guchar) *string & 0x80) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static PreparedWords *
+get_prepared_words (NautilusQuery *query)
+{
+	PreparedWords *prepared;
+	gchar *prepared_string;
+	guint idx, n_words;
+
+	if (g_once_init_enter (&query->details->prepared_words)) {
+		prepared = g_new0 (PreparedWords, 1);
+
+		prepared_string = prepare_string_for_compare (query->details->text);
+		prepared->words = g_strsplit (prepared_string, " ", -1);
+		g_free (prepared_string);
+
+		n_words = g_strv_length (prepared->words);
+		prepared->lengths = g_new (gsize, n_words);
+		prepared->ascii = TRUE;
+		for (idx = 0; idx < n_words; idx++) {
+			prepared->lengths[idx] = strlen (prepared->words[idx]);
+			prepared->ascii = prepared->ascii &&
+				string_is_ascii (prepared->words[idx]);
+		}
+
+		g_once_init_leave (&query->details->prepared_words, prepared);
+	}
+
+	return query->details->prepared_words;
+}
+
 gdouble
 nautilus_query_matches_string (NautilusQuery *query,
 			       const gchar *string)
 {
+	PreparedWords *prepared;
+	gchar buffer[256];
 	gchar *prepared_string, *ptr;
+	gsize length;
 	gboolean found;
 	gdouble retval;
 	gint idx, nonexact_malus;
@@ -102,37 +211,104 @@ nautilus_query_matches_string (NautilusQuery *query,
 		return -1;
 	}
 
-	if (!query->details->prepared_words) {
-		prepared_string = prepare_string_for_compare (query->details->text);
-		query->details->prepared_words = g_strsplit (prepared_string, " ", -1);
-		g_free (prepared_string);
+	prepared = get_prepared_words (query);
+
+	length = strlen (string);
+	prepared_string = length < sizeof (buffer) ? buffer : g_malloc (length + 1);
+
+	if (!fold_ascii_string (string, length, prepared_string)) {
+		if (prepared_string != buffer) {
+			g_free (prepared_string);
+		}
+		prepared_string = prepare_string_for_compare (string);
+		length = strlen (prepared_string);
+	} else if (!prepared->ascii) {
+		/* Words with other characters can't be in a plain ASCII string */
+		if (prepared_string != buffer) {
+			g_free (prepared_string);
+		}
+		return -1;
 	}
 
-	prepared_string = prepare_string_for_compare (string);
 	found = TRUE;
 	ptr = NULL;
 	nonexact_malus = 0;
 
-	for (idx = 0; query->details->prepared_words[idx] != NULL; idx++) {
-		if ((ptr = strstr (prepared_string, query->details->prepared_words[idx])) == NULL) {
+	for (idx = 0; prepared->words[idx] != NULL; idx++) {
+		if ((ptr = strstr (prepared_string, prepared->words[idx])) == NULL) {
 			found = FALSE;
 			break;
 		}
 
-		nonexact_malus += strlen (ptr) - strlen (query->details->prepared_words[idx]);
+		nonexact_malus += length - (ptr - prepared_string) - prepared->lengths[idx];
 	}
 
-	if (!found) {
-		g_free (prepared_string);
-		return -1;
+	if (found) {
+		retval = MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
+	} else {
+		retval = -1;
 	}
 
-	retval = MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
-	g_free (prepared_string);
+	if (prepared_string != buffer) {
+		g_free (prepared_string);
+	}
 
 	return retval;
 }
 
+static gboolean
+mime_types_equal (GList *a,
+		  GList *b)
+{
+	for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+		if (g_strcmp0 (a->data, b->data) != 0) {
+			return FALSE;
+		}
+	}
+
+	return a == NULL && b == NULL;
+}
+
+/* Returns TRUE if every file matching query also matches previous, that
+ * is, if the queries only differ by query having a more specific text.
+ * The results of previous can then be filtered instead of searching
+ * again.
+ */
+gboolean
+nautilus_query_is_refinement_of (NautilusQuery *query,
+				 NautilusQuery *previous)
+{
+	PreparedWords *prepared, *previous_prepared;
+	gint idx, prev_idx;
+	gboolean found;
+
+	if (query->details->text == NULL ||
+	    previous->details->text == NULL ||
+	    query->details->show_hidden != previous->details->show_hidden ||
+	    g_strcmp0 (query->details->location_uri, previous->details->location_uri) != 0 ||
+	    !mime_types_equal (query->details->mime_types, previous->details->mime_types)) {
+		return FALSE;
+	}
+
+	prepared = get_prepared_words (query);
+	previous_prepared = get_prepared_words (previous);
+
+	/* Every word of previous has to be part of a word of query */
+	for (prev_idx = 0; previous_prepared->words[prev_idx] != NULL; prev_idx++) {
+		found = FALSE;
+		for (idx = 0; prepared->words[idx] != NULL && !found; idx++) {
+			found = strstr (prepared->words[idx],
+					previous_prepared->words[prev_idx]) != NULL;
+		}
+
+		if (!found) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
 NautilusQuery *
 nautilus_query_new (void)
 {
@@ -152,7 +328,7 @@ nautilus_query_set_text (NautilusQuery *query, const char *text)
 	g_free (query->details->text);
 	query->details->text = g_strstrip (g_strdup (text));
 
-	g_strfreev (query->details->prepared_words);
+	prepared_words_free (query->details->prepared_words);
 	query->details->prepared_words = NULL;
 }
 
@@ -62,6 +62,7 @@ void           nautilus_query_set_mime_types     (NautilusQuery *query, GList *m
 void           nautilus_query_add_mime_type      (NautilusQuery *query, const char *mime_type);
 
 gdouble        nautilus_query_matches_string     (NautilusQuery *query, const gchar *string);
+gboolean       nautilus_query_is_refinement_of   (NautilusQuery *query, NautilusQuery *previous);
 
 char *         nautilus_query_to_readable_string (NautilusQuery *query);
 NautilusQuery *nautilus_query_load               (char *file);
@@ -31,6 +31,7 @@
 #include "nautilus-search-provider.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-search-hit.h"
 
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
@@ -47,6 +48,8 @@ struct NautilusSearchDirectoryDetails {
 
 	gboolean search_running;
 	gboolean search_loaded;
+	/* The engine is searching for a broader query than the current one */
+	gboolean search_refined;
 
 	GList *files;
 	GHashTable *files_hash;
@@ -162,6 +165,7 @@ start_search (NautilusSearchDirectory *search)
 	/* We need to start the search engine */
 	search->details->search_running = TRUE;
 	search->details->search_loaded = FALSE;
+	search->details->search_refined = FALSE;
 
 	set_hidden_files (search);
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (search->details->engine),
@@ -186,6 +190,7 @@ stop_search (NautilusSearchDirectory *search)
 	}
 
 	search->details->search_running = FALSE;
+	search->details->search_refined = FALSE;
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (search->details->engine));
 
 	reset_file_list (search);
@@ -202,6 +207,20 @@ file_changed (NautilusFile *file, NautilusSearchDirectory *search)
 	nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (search), &list);
 }
 
+static gboolean
+file_matches_query (NautilusSearchDirectory *search,
+		    NautilusFile *file)
+{
+	char *display_name;
+	gboolean matches;
+
+	display_name = nautilus_file_get_display_name (file);
+	matches = nautilus_query_matches_string (search->details->query, display_name) > -1;
+	g_free (display_name);
+
+	return matches;
+}
+
 static void
 search_monitor_add (NautilusDirectory *directory,
 		    gconstpointer client,
@@ -538,6 +557,9 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 
 	file_list = NULL;
 
+	/* Most providers score their hits on their own threads */
+	nautilus_search_hit_compute_scores_batch (hits, search->details->query);
+
 	for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next) {
 		NautilusSearchHit *hit = hit_list->data;
 		const char *uri;
@@ -548,9 +570,13 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 			continue;
 		}
 
-		nautilus_search_hit_compute_scores (hit, search->details->query);
-
 		file = nautilus_file_get_by_uri (uri);
+		if (search->details->search_refined &&
+		    !file_matches_query (search, file)) {
+			nautilus_file_unref (file);
+			continue;
+		}
+
 		nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
 
 		for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
@@ -901,6 +927,155 @@ nautilus_search_directory_set_query (NautilusSearchDirectory *search,
 	nautilus_file_unref (file);
 }
 
+static NautilusQuery *
+copy_query (NautilusQuery *query)
+{
+	NautilusQuery *copy;
+	GList *mime_types;
+	char *text, *location;
+
+	text = nautilus_query_get_text (query);
+	location = nautilus_query_get_location (query);
+	mime_types = nautilus_query_get_mime_types (query);
+
+	copy = nautilus_query_new ();
+	nautilus_query_set_text (copy, text);
+	nautilus_query_set_location (copy, location);
+	nautilus_query_set_mime_types (copy, mime_types);
+	nautilus_query_set_show_hidden_files (copy, nautilus_query_get_show_hidden_files (query));
+
+	g_list_free_full (mime_types, g_free);
+	g_free (location);
+	g_free (text);
+
+	return copy;
+}
+
+/* A hit for a file that is already in the results, to score it again */
+static NautilusSearchHit *
+search_hit_for_file (NautilusFile *file,
+		     gdouble rank)
+{
+	NautilusSearchHit *hit;
+	GDateTime *dt;
+	time_t date;
+	char *uri;
+
+	uri = nautilus_file_get_uri (file);
+	hit = nautilus_search_hit_new (uri);
+	g_free (uri);
+
+	nautilus_search_hit_set_fts_rank (hit, rank);
+
+	if (nautilus_file_get_date (file, NAUTILUS_DATE_TYPE_MODIFIED, &date)) {
+		dt = g_date_time_new_from_unix_local (date);
+		nautilus_search_hit_set_modification_time (hit, dt);
+		g_date_time_unref (dt);
+	}
+	if (nautilus_file_get_date (file, NAUTILUS_DATE_TYPE_ACCESSED, &date)) {
+		dt = g_date_time_new_from_unix_local (date);
+		nautilus_search_hit_set_access_time (hit, dt);
+		g_date_time_unref (dt);
+	}
+
+	return hit;
+}
+
+/* Applies query by filtering the current results when it only narrows
+ * down the current query. The engine keeps running with the broader
+ * query on the folders it didn't visit yet, and its hits are filtered
+ * too. Returns FALSE if the search has to be started again instead.
+ */
+gboolean
+nautilus_search_directory_refine_query (NautilusSearchDirectory *search,
+					NautilusQuery *query)
+{
+	GList *list, *next, *removed, *changed, *kept, *hits, *monitor_list;
+	NautilusQuery *refined;
+	NautilusFile *file;
+	SearchMonitor *monitor;
+	char *display_name;
+	gdouble rank, relevance;
+
+	if (!search->details->search_running ||
+	    search->details->query == NULL) {
+		return FALSE;
+	}
+
+	/* Hidden files are shown as the monitors asked for the current
+	 * query. The caller's query is left alone, a copy is used. */
+	refined = copy_query (query);
+	nautilus_query_set_show_hidden_files (refined,
+					      nautilus_query_get_show_hidden_files (search->details->query));
+
+	if (!nautilus_query_is_refinement_of (refined, search->details->query)) {
+		g_object_unref (refined);
+		return FALSE;
+	}
+
+	nautilus_search_directory_set_query (search, refined);
+	g_object_unref (refined);
+	search->details->search_refined = TRUE;
+
+	removed = NULL;
+	kept = NULL;
+	hits = NULL;
+	for (list = search->details->files; list != NULL; list = next) {
+		next = list->next;
+		file = list->data;
+
+		display_name = nautilus_file_get_display_name (file);
+		rank = nautilus_query_matches_string (search->details->query, display_name);
+		g_free (display_name);
+
+		if (rank > -1) {
+			kept = g_list_prepend (kept, file);
+			hits = g_list_prepend (hits, search_hit_for_file (file, rank));
+			continue;
+		}
+
+		g_signal_handlers_disconnect_by_func (file, file_changed, search);
+		for (monitor_list = search->details->monitor_list; monitor_list;
+		     monitor_list = monitor_list->next) {
+			monitor = monitor_list->data;
+			nautilus_file_monitor_remove (file, monitor);
+		}
+
+		g_hash_table_remove (search->details->files_hash, file);
+		search->details->files = g_list_delete_link (search->details->files, list);
+		removed = g_list_prepend (removed, file);
+	}
+
+	/* How well the name matches is part of the relevance, score the
+	 * files that stay again */
+	nautilus_search_hit_compute_scores_batch (hits, search->details->query);
+
+	changed = removed;
+	for (list = kept, next = hits; list != NULL; list = list->next, next = next->next) {
+		file = list->data;
+		relevance = nautilus_search_hit_get_relevance (next->data);
+		if (relevance != file->details->search_relevance) {
+			nautilus_file_set_search_relevance (file, relevance);
+			changed = g_list_prepend (changed, nautilus_file_ref (file));
+		}
+	}
+	g_list_free_full (hits, g_object_unref);
+	g_list_free (kept);
+
+	if (changed != NULL) {
+		/* The views drop files the directory doesn't contain
+		 * anymore, and sort the others again */
+		nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (search), changed);
+		nautilus_file_list_free (changed);
+
+		file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (search));
+		nautilus_file_emit_changed (file);
+		nautilus_file_unref (file);
+	}
+
+	return TRUE;
+}
+
 NautilusQuery *
 nautilus_search_directory_get_query (NautilusSearchDirectory *search)
 {
@@ -0,0 +1,219 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Copyright (C) 2014 Endless Mobile, Inc.
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#include "nautilus-search-engine-index.h"
+#include "nautilus-filename-index.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+typedef struct {
+	NautilusSearchEngineIndex *engine;
+	NautilusQuery *query;
+	GCancellable *cancellable;
+	GList *hits;
+} SearchThreadData;
+
+struct NautilusSearchEngineIndexDetails {
+	NautilusQuery *query;
+
+	SearchThreadData *active_search;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderIface  *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineIndex,
+			 nautilus_search_engine_index,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+						nautilus_search_provider_init))
+
+static void
+finalize (GObject *object)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+	g_clear_object (&engine->details->query);
+
+	G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static void
+search_thread_data_free (SearchThreadData *data)
+{
+	g_list_free_full (data->hits, g_object_unref);
+	g_object_unref (data->cancellable);
+	g_object_unref (data->query);
+	g_object_unref (data->engine);
+
+	g_free (data);
+}
+
+static gboolean
+search_thread_done_idle (gpointer user_data)
+{
+	SearchThreadData *data = user_data;
+	NautilusSearchEngineIndex *engine = data->engine;
+
+	DEBUG ("Index engine done");
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		if (data->hits != NULL) {
+			nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (engine),
+							     data->hits);
+		}
+
+		engine->details->active_search = NULL;
+	}
+
+	nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine));
+
+	search_thread_data_free (data);
+
+	return FALSE;
+}
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+	SearchThreadData *data = user_data;
+
+	data->hits = nautilus_filename_index_query (data->query, data->cancellable);
+	nautilus_search_hit_compute_scores_batch (data->hits, data->query);
+
+	g_idle_add (search_thread_done_idle, data);
+
+	return NULL;
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineIndex *engine;
+	SearchThreadData *data;
+	GThread *thread;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	if (engine->details->active_search != NULL) {
+		return;
+	}
+
+	DEBUG ("Index engine start");
+
+	data = g_new0 (SearchThreadData, 1);
+	data->engine = g_object_ref (engine);
+	data->query = g_object_ref (engine->details->query);
+	data->cancellable = g_cancellable_new ();
+
+	thread = g_thread_new ("nautilus-search-index", search_thread_func, data);
+	engine->details->active_search = data;
+
+	g_thread_unref (thread);
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	if (engine->details->active_search != NULL) {
+		DEBUG ("Index engine stop");
+		g_cancellable_cancel (engine->details->active_search->cancellable);
+		engine->details->active_search = NULL;
+	}
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchProvider *provider,
+					NautilusQuery          *query)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	g_object_ref (query);
+	g_clear_object (&engine->details->query);
+	engine->details->query = query;
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderIface *iface)
+{
+	iface->set_query = nautilus_search_engine_index_set_query;
+	iface->start = nautilus_search_engine_index_start;
+	iface->stop = nautilus_search_engine_index_stop;
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *class)
+{
+	GObjectClass *gobject_class;
+
+	gobject_class = G_OBJECT_CLASS (class);
+	gobject_class->finalize = finalize;
+
+	g_type_class_add_private (class, sizeof (NautilusSearchEngineIndexDetails));
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *engine)
+{
+	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NAUTILUS_TYPE_SEARCH_ENGINE_INDEX,
+						       NautilusSearchEngineIndexDetails);
+}
+
+NautilusSearchEngineIndex *
+nautilus_search_engine_index_new (void)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+
+	return engine;
+}
+
+/* Whether the filename index can answer the current query, in which
+ * case there is no need to crawl the folder. */
+gboolean
+nautilus_search_engine_index_can_search (NautilusSearchEngineIndex *engine)
+{
+	char *uri;
+	gboolean covered;
+
+	if (engine->details->query == NULL) {
+		return FALSE;
+	}
+
+	uri = nautilus_query_get_location (engine->details->query);
+	covered = uri != NULL && nautilus_filename_index_covers (uri);
+	g_free (uri);
+
+	return covered;
+}
@@ -35,11 +35,27 @@
 
 #define BATCH_SIZE 500
 
+/* Directories are enumerated on a thread pool shared by all searches,
+ * one task per directory, so a recursive search of a big tree keeps
+ * every thread busy instead of walking it from a single thread.
+ */
+#define SEARCH_MAX_THREADS 16
+
+/* The visited set is split in shards with their own lock so the
+ * threads rarely wait for each other when checking it.
+ */
+#define VISITED_SHARDS 16
+
 enum {
 	PROP_RECURSIVE = 1,
 	NUM_PROPERTIES
 };
 
+typedef struct {
+	GMutex lock;
+	GHashTable *ids;
+} VisitedShard;
+
 typedef struct {
 	NautilusSearchEngineSimple *engine;
 	GCancellable *cancellable;
@@ -47,17 +63,26 @@ typedef struct {
 	GList *mime_types;
 	GList *found_list;
 
-	GQueue *directories; /* GFiles */
+	GFile *location;
+
+	VisitedShard visited[VISITED_SHARDS];
 
-	GHashTable *visited;
+	/* Directories queued or being visited. Use atomic operations. */
+	volatile gint n_pending;
 
-	gboolean recursive;
+	/* Lock hits_lock when accessing these */
+	GMutex hits_lock;
 	gint n_processed_files;
 	GList *hits;
 
 	NautilusQuery *query;
 } SearchThreadData;
 
+typedef struct {
+	SearchThreadData *data;
+	GFile *dir;
+} SearchDirectory;
+
 
 struct NautilusSearchEngineSimpleDetails {
 	NautilusQuery *query;
@@ -70,6 +95,8 @@ struct NautilusSearchEngineSimpleDetails {
 
 static GParamSpec *properties[NUM_PROPERTIES] = { NULL, };
 
+static GThreadPool *search_pool = NULL;
+
 static void nautilus_search_provider_init (NautilusSearchProviderIface  *iface);
 
 G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineSimple,
@@ -95,20 +122,22 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 {
 	SearchThreadData *data;
 	char *uri;
-	GFile *location;
+	int i;
 	
 	data = g_new0 (SearchThreadData, 1);
 
 	data->engine = g_object_ref (engine);
-	data->directories = g_queue_new ();
-	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < VISITED_SHARDS; i++) {
+		g_mutex_init (&data->visited[i].lock);
+		data->visited[i].ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+	g_mutex_init (&data->hits_lock);
 	data->query = g_object_ref (query);
 
 	uri = nautilus_query_get_location (query);
-	location = g_file_new_for_uri (uri);
+	data->location = g_file_new_for_uri (uri);
 	g_free (uri);
 
-	g_queue_push_tail (data->directories, location);
 	data->mime_types = nautilus_query_get_mime_types (query);
 
 	data->cancellable = g_cancellable_new ();
@@ -119,10 +148,14 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 static void 
 search_thread_data_free (SearchThreadData *data)
 {
-	g_queue_foreach (data->directories,
-			 (GFunc)g_object_unref, NULL);
-	g_queue_free (data->directories);
-	g_hash_table_destroy (data->visited);
+	int i;
+
+	for (i = 0; i < VISITED_SHARDS; i++) {
+		g_mutex_clear (&data->visited[i].lock);
+		g_hash_table_destroy (data->visited[i].ids);
+	}
+	g_mutex_clear (&data->hits_lock);
+	g_object_unref (data->location);
 	g_object_unref (data->cancellable);
 	g_object_unref (data->query);
 	g_list_free_full (data->mime_types, g_free);
@@ -172,6 +205,7 @@ search_thread_add_hits_idle (gpointer user_data)
 	return FALSE;
 }
 
+/* Lock thread_data->hits_lock when calling this. */
 static void
 send_batch (SearchThreadData *thread_data)
 {
@@ -188,6 +222,62 @@ send_batch (SearchThreadData *thread_data)
 	thread_data->hits = NULL;
 }
 
+/* Adds the hits found by one thread and sends them once enough files
+ * have been processed by all threads together. Takes ownership of hits.
+ */
+static void
+add_hits (SearchThreadData *data,
+	  GList *hits,
+	  gint n_processed_files)
+{
+	/* Score them here rather than in the main thread */
+	nautilus_search_hit_compute_scores_batch (hits, data->query);
+
+	g_mutex_lock (&data->hits_lock);
+
+	data->hits = g_list_concat (hits, data->hits);
+	data->n_processed_files += n_processed_files;
+	if (data->n_processed_files > BATCH_SIZE) {
+		send_batch (data);
+	}
+
+	g_mutex_unlock (&data->hits_lock);
+}
+
+/* Returns TRUE if id was not visited before. */
+static gboolean
+mark_visited (SearchThreadData *data,
+	      const char *id)
+{
+	VisitedShard *shard;
+	gboolean added;
+
+	shard = &data->visited[g_str_hash (id) % VISITED_SHARDS];
+
+	g_mutex_lock (&shard->lock);
+	added = !g_hash_table_contains (shard->ids, id);
+	if (added) {
+		g_hash_table_add (shard->ids, g_strdup (id));
+	}
+	g_mutex_unlock (&shard->lock);
+
+	return added;
+}
+
+static void
+push_directory (SearchThreadData *data,
+		GFile *dir)
+{
+	SearchDirectory *task;
+
+	task = g_new (SearchDirectory, 1);
+	task->data = data;
+	task->dir = g_object_ref (dir);
+
+	g_atomic_int_inc (&data->n_pending);
+	g_thread_pool_push (search_pool, task, NULL);
+}
+
 #define STD_ATTRIBUTES \
 	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
 	G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
@@ -208,7 +298,8 @@ visit_directory (GFile *dir, SearchThreadData *data)
 	gboolean is_hidden, found;
 	GList *l;
 	const char *id;
-	gboolean visited;
+	GList *hits;
+	gint n_processed_files;
 
 	enumerator = g_file_enumerate_children (dir,
 						data->mime_types != NULL ?
@@ -223,6 +314,9 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		return;
 	}
 
+	hits = NULL;
+	n_processed_files = 0;
+
 	while ((info = g_file_enumerator_next_file (enumerator, data->cancellable, NULL)) != NULL) {
 		display_name = g_file_info_get_display_name (info);
 		if (display_name == NULL) {
@@ -265,28 +359,20 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			nautilus_search_hit_set_modification_time (hit, dt);
 			g_date_time_unref (dt);
 
-			data->hits = g_list_prepend (data->hits, hit);
+			hits = g_list_prepend (hits, hit);
 		}
 		
-		data->n_processed_files++;
-		if (data->n_processed_files > BATCH_SIZE) {
-			send_batch (data);
+		n_processed_files++;
+		if (n_processed_files > BATCH_SIZE) {
+			add_hits (data, hits, n_processed_files);
+			hits = NULL;
+			n_processed_files = 0;
 		}
 
 		if (data->engine->details->recursive && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 			id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-			visited = FALSE;
-			if (id) {
-				if (g_hash_table_lookup_extended (data->visited,
-								  id, NULL, NULL)) {
-					visited = TRUE;
-				} else {
-					g_hash_table_insert (data->visited, g_strdup (id), NULL);
-				}
-			}
-			
-			if (!visited) {
-				g_queue_push_tail (data->directories, g_object_ref (child));
+			if (id == NULL || mark_visited (data, id)) {
+				push_directory (data, child);
 			}
 		}
 		
@@ -295,44 +381,52 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		g_object_unref (info);
 	}
 
+	add_hits (data, hits, n_processed_files);
+
 	g_object_unref (enumerator);
 }
 
 
-static gpointer 
-search_thread_func (gpointer user_data)
+static void
+search_thread_func (gpointer task_data,
+		    gpointer pool_data)
 {
+	SearchDirectory *task;
 	SearchThreadData *data;
-	GFile *dir;
 	GFileInfo *info;
 	const char *id;
 
-	data = user_data;
+	task = task_data;
+	data = task->data;
 
-	/* Insert id for toplevel directory into visited */
-	dir = g_queue_peek_head (data->directories);
-	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
-	if (info) {
-		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-		if (id) {
-			g_hash_table_insert (data->visited, g_strdup (id), NULL);
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		if (task->dir == data->location) {
+			/* Insert id for toplevel directory into visited */
+			info = g_file_query_info (task->dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+			if (info) {
+				id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+				if (id) {
+					mark_visited (data, id);
+				}
+				g_object_unref (info);
+			}
 		}
-		g_object_unref (info);
-	}
-	
-	while (!g_cancellable_is_cancelled (data->cancellable) &&
-	       (dir = g_queue_pop_head (data->directories)) != NULL) {
-		visit_directory (dir, data);
-		g_object_unref (dir);
-	}
 
-	if (!g_cancellable_is_cancelled (data->cancellable)) {
-		send_batch (data);
+		visit_directory (task->dir, data);
 	}
 
-	g_idle_add (search_thread_done_idle, data);
-	
-	return NULL;
+	g_object_unref (task->dir);
+	g_free (task);
+
+	if (g_atomic_int_dec_and_test (&data->n_pending)) {
+		if (!g_cancellable_is_cancelled (data->cancellable)) {
+			g_mutex_lock (&data->hits_lock);
+			send_batch (data);
+			g_mutex_unlock (&data->hits_lock);
+		}
+
+		g_idle_add (search_thread_done_idle, data);
+	}
 }
 
 static void
@@ -340,7 +434,6 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 {
 	NautilusSearchEngineSimple *simple;
 	SearchThreadData *data;
-	GThread *thread;
 	
 	simple = NAUTILUS_SEARCH_ENGINE_SIMPLE (provider);
 
@@ -352,10 +445,14 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 	
 	data = search_thread_data_new (simple, simple->details->query);
 
-	thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
-	simple->details->active_search = data;
+	if (search_pool == NULL) {
+		search_pool = g_thread_pool_new (search_thread_func, NULL,
+						 CLAMP (g_get_num_processors (), 2, SEARCH_MAX_THREADS),
+						 FALSE, NULL);
+	}
 
-	g_thread_unref (thread);
+	simple->details->active_search = data;
+	push_directory (data, data->location);
 }
 
 static void
@@ -28,6 +28,7 @@
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-simple.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-search-engine-index.h"
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
 
@@ -42,6 +43,7 @@ struct NautilusSearchEngineDetails
 #endif
 	NautilusSearchEngineSimple *simple;
 	NautilusSearchEngineModel *model;
+	NautilusSearchEngineIndex *index;
 
 	GHashTable *uris;
 	guint providers_running;
@@ -70,11 +72,14 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
 #endif
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->model), query);
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->simple), query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->index), query);
 }
 
 static void
 search_engine_start_real (NautilusSearchEngine *engine)
 {
+	gboolean recursive;
+
 	engine->details->providers_running = 0;
 	engine->details->providers_finished = 0;
 	engine->details->providers_error = 0;
@@ -94,7 +99,15 @@ search_engine_start_real (NautilusSearchEngine *engine)
 		engine->details->providers_running++;
 	}
 
-	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+	/* The filename index answers recursive searches of the folders it
+	 * covers without crawling them. It catches up with the folders
+	 * that changed while they were not open every few minutes. */
+	g_object_get (engine->details->simple, "recursive", &recursive, NULL);
+	if (recursive && nautilus_search_engine_index_can_search (engine->details->index)) {
+		nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->index));
+	} else {
+		nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+	}
 	engine->details->providers_running++;
 }
 
@@ -138,6 +151,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
 #endif
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->model));
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->index));
 
 	engine->details->running = FALSE;
 	engine->details->restart = FALSE;
@@ -262,6 +276,7 @@ nautilus_search_engine_finalize (GObject *object)
 #endif
 	g_clear_object (&engine->details->model);
 	g_clear_object (&engine->details->simple);
+	g_clear_object (&engine->details->index);
 
 	G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
 }
@@ -296,6 +311,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
 
 	engine->details->simple = nautilus_search_engine_simple_new ();
 	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+
+	engine->details->index = nautilus_search_engine_index_new ();
+	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->index));
 }
 
 NautilusSearchEngine *
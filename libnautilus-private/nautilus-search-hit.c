@@ -38,6 +38,7 @@ struct NautilusSearchHitDetails
 	gdouble    fts_rank;
 
 	gdouble    relevance;
+	gboolean   scored;
 };
 
 enum {
@@ -51,46 +52,71 @@ enum {
 
 G_DEFINE_TYPE (NautilusSearchHit, nautilus_search_hit, G_TYPE_OBJECT)
 
-void
-nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
-				    NautilusQuery     *query)
+/* Returns the URI of the query location with a trailing slash, so the
+ * hits below it are the URIs it is a prefix of */
+static char *
+get_query_prefix (NautilusQuery *query)
 {
-	GDateTime *now;
-	char *query_uri;
+	char *query_uri, *prefix, *tmp;
 	GFile *query_location;
-	GFile *hit_location;
-	GTimeSpan m_diff = G_MAXINT64;
-	GTimeSpan a_diff = G_MAXINT64;
-	GTimeSpan t_diff = G_MAXINT64;
-	gdouble recent_bonus = 0.0;
-	gdouble proximity_bonus = 0.0;
-	gdouble match_bonus = 0.0;
 
 	query_uri = nautilus_query_get_location (query);
 	query_location = g_file_new_for_uri (query_uri);
-	hit_location = g_file_new_for_uri (hit->details->uri);
+	prefix = g_file_get_uri (query_location);
+	g_object_unref (query_location);
+	g_free (query_uri);
 
-	if (g_file_has_prefix (hit_location, query_location)) {
-		GFile *parent, *location;
-		guint dir_count = 0;
+	if (!g_str_has_suffix (prefix, "/")) {
+		tmp = prefix;
+		prefix = g_strconcat (tmp, "/", NULL);
+		g_free (tmp);
+	}
+
+	return prefix;
+}
 
-		parent = g_file_get_parent (hit_location);
+static gdouble
+get_proximity_bonus (const char *uri,
+		     const char *prefix,
+		     gsize       prefix_len)
+{
+	const char *p;
+	guint dir_count;
 
-		while (!g_file_equal (parent, query_location)) {
+	if (strncmp (uri, prefix, prefix_len) != 0 || uri[prefix_len] == '\0') {
+		return 0.0;
+	}
+
+	/* Count the folders between the query location and the hit */
+	dir_count = 0;
+	for (p = uri + prefix_len; *p != '\0'; p++) {
+		if (*p == '/' && p[1] != '\0') {
 			dir_count++;
-			location = parent;
-			parent = g_file_get_parent (location);
-			g_object_unref (location);
 		}
-		g_object_unref (parent);
+	}
 
-		if (dir_count < 10) {
-			proximity_bonus = 10000.0 - 1000.0 * dir_count;
-		}
+	if (dir_count < 10) {
+		return 10000.0 - 1000.0 * dir_count;
 	}
-	g_object_unref (hit_location);
 
-	now = g_date_time_new_now_local ();
+	return 0.0;
+}
+
+static void
+compute_scores (NautilusSearchHit *hit,
+		GDateTime         *now,
+		const char        *prefix,
+		gsize              prefix_len)
+{
+	GTimeSpan m_diff = G_MAXINT64;
+	GTimeSpan a_diff = G_MAXINT64;
+	GTimeSpan t_diff = G_MAXINT64;
+	gdouble recent_bonus = 0.0;
+	gdouble proximity_bonus = 0.0;
+	gdouble match_bonus = 0.0;
+
+	proximity_bonus = get_proximity_bonus (hit->details->uri, prefix, prefix_len);
+
 	if (hit->details->modification_time != NULL)
 		m_diff = g_date_time_difference (now, hit->details->modification_time);
 	if (hit->details->access_time != NULL)
@@ -119,12 +145,59 @@ nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
 	}
 
 	hit->details->relevance = recent_bonus + proximity_bonus + match_bonus;
+	hit->details->scored = TRUE;
 	DEBUG ("Hit %s computed relevance %.2f (%.2f + %.2f + %.2f)", hit->details->uri, hit->details->relevance,
 	       proximity_bonus, recent_bonus, match_bonus);
+}
+
+void
+nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
+				    NautilusQuery     *query)
+{
+	GDateTime *now;
+	char *prefix;
+
+	prefix = get_query_prefix (query);
+	now = g_date_time_new_now_local ();
+
+	compute_scores (hit, now, prefix, strlen (prefix));
 
 	g_date_time_unref (now);
-	g_free (query_uri);
-	g_object_unref (query_location);
+	g_free (prefix);
+}
+
+/* Scores many hits against the same query location and time. Hits
+ * that have their scores already are left alone, so a provider can
+ * score its hits on its own thread before handing them over. Can be
+ * called from any thread.
+ */
+void
+nautilus_search_hit_compute_scores_batch (GList         *hits,
+					  NautilusQuery *query)
+{
+	NautilusSearchHit *hit;
+	GDateTime *now;
+	char *prefix;
+	gsize prefix_len;
+	GList *l;
+
+	if (hits == NULL) {
+		return;
+	}
+
+	prefix = get_query_prefix (query);
+	prefix_len = strlen (prefix);
+	now = g_date_time_new_now_local ();
+
+	for (l = hits; l != NULL; l = l->next) {
+		hit = l->data;
+		if (!hit->details->scored) {
+			compute_scores (hit, now, prefix, prefix_len);
+		}
+	}
+
+	g_date_time_unref (now);
+	g_free (prefix);
 }
 
 const char *
@@ -56,6 +56,8 @@ void                nautilus_search_hit_set_access_time       (NautilusSearchHit
 
 void                nautilus_search_hit_compute_scores        (NautilusSearchHit *hit,
 							       NautilusQuery     *query);
+void                nautilus_search_hit_compute_scores_batch  (GList             *hits,
+							       NautilusQuery     *query);
 
 const char *        nautilus_search_hit_get_uri               (NautilusSearchHit *hit);
 gdouble             nautilus_search_hit_get_relevance         (NautilusSearchHit *hit);
@@ -0,0 +1,204 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-thumbnail-cache.c: Cache of decoded thumbnails.
+ 
+   Copyright (C) 2014 Endless Mobile, Inc.
+  
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+  
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+  
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+#include "nautilus-thumbnail-cache.h"
+
+#include <string.h>
+#include <eel/eel-debug.h>
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_THUMBNAILS
+#include "nautilus-debug.h"
+
+/* Upper bound of the pixel data kept in the cache. At the default
+ * thumbnail size this is a few thousand icons.
+ */
+#define THUMBNAIL_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+	char *uri;
+	time_t mtime;
+	int size;
+	gboolean is_original;
+} CacheKey;
+
+typedef struct {
+	CacheKey key;
+	GdkPixbuf *pixbuf;
+	gsize n_bytes;
+	/* Link in the lru list, most recently used first */
+	GList *lru_link;
+} CacheEntry;
+
+static GHashTable *cache_entries = NULL;
+static GQueue cache_lru = G_QUEUE_INIT;
+static NautilusThumbnailCacheStats cache_stats;
+
+static guint
+cache_key_hash (gconstpointer data)
+{
+	const CacheKey *key = data;
+
+	return g_str_hash (key->uri) ^
+		((guint) key->mtime * 31) ^
+		((guint) key->size << 1) ^
+		(guint) key->is_original;
+}
+
+static gboolean
+cache_key_equal (gconstpointer a,
+		 gconstpointer b)
+{
+	const CacheKey *key_a = a;
+	const CacheKey *key_b = b;
+
+	return key_a->mtime == key_b->mtime &&
+		key_a->size == key_b->size &&
+		key_a->is_original == key_b->is_original &&
+		strcmp (key_a->uri, key_b->uri) == 0;
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_free (entry->key.uri);
+	g_object_unref (entry->pixbuf);
+	g_slice_free (CacheEntry, entry);
+}
+
+static void
+remove_entry (CacheEntry *entry)
+{
+	cache_stats.n_entries--;
+	cache_stats.n_bytes -= entry->n_bytes;
+	g_queue_delete_link (&cache_lru, entry->lru_link);
+	g_hash_table_remove (cache_entries, &entry->key);
+}
+
+static void
+free_cache (void)
+{
+	g_queue_clear (&cache_lru);
+	g_hash_table_destroy (cache_entries);
+	cache_entries = NULL;
+	memset (&cache_stats, 0, sizeof (cache_stats));
+}
+
+static GHashTable *
+get_cache_entries (void)
+{
+	if (cache_entries == NULL) {
+		/* The key is embedded in the entry, so only free the value */
+		cache_entries = g_hash_table_new_full (cache_key_hash,
+						       cache_key_equal,
+						       NULL,
+						       (GDestroyNotify) cache_entry_free);
+		eel_debug_call_at_shutdown (free_cache);
+	}
+
+	return cache_entries;
+}
+
+GdkPixbuf *
+nautilus_thumbnail_cache_lookup (const char *uri,
+				 time_t mtime,
+				 int size,
+				 gboolean is_original)
+{
+	CacheKey key;
+	CacheEntry *entry;
+
+	g_return_val_if_fail (uri != NULL, NULL);
+
+	key.uri = (char *) uri;
+	key.mtime = mtime;
+	key.size = size;
+	key.is_original = is_original;
+
+	entry = g_hash_table_lookup (get_cache_entries (), &key);
+	if (entry == NULL) {
+		cache_stats.misses++;
+		return NULL;
+	}
+
+	cache_stats.hits++;
+	g_queue_unlink (&cache_lru, entry->lru_link);
+	g_queue_push_head_link (&cache_lru, entry->lru_link);
+
+	return g_object_ref (entry->pixbuf);
+}
+
+void
+nautilus_thumbnail_cache_insert (const char *uri,
+				 time_t mtime,
+				 int size,
+				 gboolean is_original,
+				 GdkPixbuf *pixbuf)
+{
+	CacheEntry *entry, *old_entry;
+	gsize n_bytes;
+
+	g_return_if_fail (uri != NULL);
+	g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
+
+	n_bytes = (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+	if (n_bytes > THUMBNAIL_CACHE_MAX_BYTES) {
+		return;
+	}
+
+	entry = g_slice_new0 (CacheEntry);
+	entry->key.uri = g_strdup (uri);
+	entry->key.mtime = mtime;
+	entry->key.size = size;
+	entry->key.is_original = is_original;
+	entry->pixbuf = g_object_ref (pixbuf);
+	entry->n_bytes = n_bytes;
+
+	old_entry = g_hash_table_lookup (get_cache_entries (), &entry->key);
+	if (old_entry != NULL) {
+		remove_entry (old_entry);
+	}
+
+	while (cache_stats.n_bytes + n_bytes > THUMBNAIL_CACHE_MAX_BYTES) {
+		remove_entry (g_queue_peek_tail (&cache_lru));
+		cache_stats.evictions++;
+	}
+
+	g_queue_push_head (&cache_lru, entry);
+	entry->lru_link = g_queue_peek_head_link (&cache_lru);
+	g_hash_table_insert (cache_entries, &entry->key, entry);
+	cache_stats.n_entries++;
+	cache_stats.n_bytes += n_bytes;
+
+	DEBUG ("%u thumbnails, %" G_GSIZE_FORMAT " bytes, %" G_GUINT64_FORMAT " hits, %"
+	       G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " evictions",
+	       cache_stats.n_entries, cache_stats.n_bytes,
+	       cache_stats.hits, cache_stats.misses, cache_stats.evictions);
+}
+
+void
+nautilus_thumbnail_cache_get_stats (NautilusThumbnailCacheStats *stats)
+{
+	g_return_if_fail (stats != NULL);
+
+	*stats = cache_stats;
+}
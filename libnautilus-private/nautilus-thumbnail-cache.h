@@ -0,0 +1,57 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-thumbnail-cache.h: Cache of decoded thumbnails.
+ 
+   Copyright (C) 2014 Endless Mobile, Inc.
+  
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+  
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+  
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef NAUTILUS_THUMBNAIL_CACHE_H
+#define NAUTILUS_THUMBNAIL_CACHE_H
+
+#include <time.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* Decoded, already scaled thumbnails are kept here, so that files that
+ * come back (re-entering a folder, or opening it in another window) don't
+ * need to load and decode the PNG again. Entries are keyed by the uri and
+ * mtime of the original file and the size the thumbnail was scaled to,
+ * and the least recently used ones are dropped once the cache grows over
+ * its size limit. Must only be used from the main thread.
+ */
+
+typedef struct {
+	guint64 hits;
+	guint64 misses;
+	guint64 evictions;
+	guint n_entries;
+	gsize n_bytes;
+} NautilusThumbnailCacheStats;
+
+/* Returns a new reference, or NULL if there is no such thumbnail. */
+GdkPixbuf *nautilus_thumbnail_cache_lookup    (const char *uri,
+					       time_t      mtime,
+					       int         size,
+					       gboolean    is_original);
+void       nautilus_thumbnail_cache_insert    (const char *uri,
+					       time_t      mtime,
+					       int         size,
+					       gboolean    is_original,
+					       GdkPixbuf  *pixbuf);
+void       nautilus_thumbnail_cache_get_stats (NautilusThumbnailCacheStats *stats);
+
+#endif /* NAUTILUS_THUMBNAIL_CACHE_H */
@@ -59,32 +59,62 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
-static gpointer thumbnail_thread_start (gpointer data);
+/* Upper bound on the number of thumbnail workers, whatever the number of
+   processors is. Thumbnailers are often I/O bound external processes, so
+   there is little point in going much wider than this. */
+#define MAX_THUMBNAIL_WORKERS 16
+
+static void thumbnail_worker_func (gpointer data, gpointer user_data);
 
 /* structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 
 typedef struct {
 	char *image_uri;
 	char *mime_type;
+	/* The uri of the NautilusDirectory the file was in, so we can
+	   drop all pending requests for a directory at once. */
+	char *directory_uri;
 	time_t original_file_mtime;
+	/* TRUE while a worker is making this thumbnail. Lock
+	   thumbnails_mutex when accessing this. */
+	gboolean in_progress;
 } NautilusThumbnailInfo;
 
+/* Per-worker bookkeeping. Lock thumbnails_mutex when accessing this. */
+typedef struct {
+	gboolean is_running;
+	NautilusThumbnailWorkerStats stats;
+} NautilusThumbnailWorker;
+
 /*
- * Thumbnail thread state.
+ * Thumbnail worker pool state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start thumbnail workers, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
-   thumbnails_to_make list. */
+   thumbnail workers, i.e. the worker slots and the thumbnails_to_make list. */
 static pthread_mutex_t thumbnails_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* The pool running the workers. Each pushed task is a worker slot index
+   (plus one) and loops over thumbnails_to_make until it is drained. */
+static GThreadPool *thumbnail_pool = NULL;
+
+/* One slot per possible worker, n_thumbnail_workers of them. Lock
+   thumbnails_mutex when accessing this. */
+static NautilusThumbnailWorker *thumbnail_workers = NULL;
+static guint n_thumbnail_workers = 0;
+
+/* The number of workers currently running. Lock thumbnails_mutex when
+   accessing this. */
+static guint n_running_workers = 0;
+
+/* The number of thumbnails currently being made. They stay in the
+   thumbnails_to_make list to avoid adding them again. Lock thumbnails_mutex
+   when accessing this. */
+static guint n_thumbnails_in_progress = 0;
 
 /* The list of NautilusThumbnailInfo structs containing information about the
    thumbnails we are making. Lock thumbnails_mutex when accessing this. */
@@ -93,10 +123,6 @@ static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
 /* Quickly check if uri is in thumbnails_to_make list */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static NautilusThumbnailInfo *currently_thumbnailing = NULL;
-
 static GnomeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
 static gboolean
@@ -129,6 +155,7 @@ free_thumbnail_info (NautilusThumbnailInfo *info)
 {
 	g_free (info->image_uri);
 	g_free (info->mime_type);
+	g_free (info->directory_uri);
 	g_free (info);
 }
 
@@ -144,44 +171,70 @@ get_thumbnail_factory (void)
 	return thumbnail_factory;
 }
 
+/* Sets up the worker slots and the pool the first time it is needed.
+   Must be called from the main thread. */
+static void
+ensure_thumbnail_pool (void)
+{
+	if (thumbnail_pool != NULL) {
+		return;
+	}
+
+	n_thumbnail_workers = CLAMP (g_get_num_processors (), 1, MAX_THUMBNAIL_WORKERS);
+	thumbnail_workers = g_new0 (NautilusThumbnailWorker, n_thumbnail_workers);
+	thumbnail_pool = g_thread_pool_new (thumbnail_worker_func, NULL,
+					    n_thumbnail_workers, FALSE, NULL);
+#ifdef DEBUG_THUMBNAILS
+	g_message ("(Main Thread) Created thumbnail pool with %u workers\n",
+		   n_thumbnail_workers);
+#endif
+}
 
 /* This function is added as a very low priority idle function to start the
-   thread to create any needed thumbnails. It is added with a very low priority
+   workers to create any needed thumbnails. It is added with a very low priority
    so that it doesn't delay showing the directory in the icon/list views.
    We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data)
 {
-	pthread_attr_t thread_attributes;
-	pthread_t thumbnail_thread;
+	guint n_waiting, i;
 
 	/* Don't do this in thread, since g_object_ref is not threadsafe */
 	if (thumbnail_factory == NULL) {
 		thumbnail_factory = get_thumbnail_factory ();
 	}
 
-	/* We create the thread in the detached state, as we don't need/want
-	   to join with it at any point. */
-	pthread_attr_init (&thread_attributes);
-	pthread_attr_setdetachstate (&thread_attributes,
-				     PTHREAD_CREATE_DETACHED);
-#ifdef _POSIX_THREAD_ATTR_STACKSIZE
-	pthread_attr_setstacksize (&thread_attributes, 128*1024);
-#endif
+	ensure_thumbnail_pool ();
+
+	pthread_mutex_lock (&thumbnails_mutex);
+
+	/*********************************
+	 * MUTEX LOCKED
+	 *********************************/
+
+	/* Start one worker per waiting thumbnail, up to the pool size. Workers
+	   that are already running will pick up the rest of the queue. */
+	n_waiting = g_queue_get_length ((GQueue *)&thumbnails_to_make) - n_thumbnails_in_progress;
+	for (i = 0; i < n_thumbnail_workers && n_waiting > n_running_workers - n_thumbnails_in_progress; i++) {
+		if (thumbnail_workers[i].is_running) {
+			continue;
+		}
 #ifdef DEBUG_THUMBNAILS
-	g_message ("(Main Thread) Creating thumbnails thread\n");
+		g_message ("(Main Thread) Starting thumbnail worker %u\n", i);
 #endif
-	/* We set a flag to indicate the thread is running, so we don't create
-	   a new one. We don't need to lock a mutex here, as the thumbnail
-	   thread isn't running yet. And we know we won't create the thread
-	   twice, as we also check thumbnail_thread_starter_id before
-	   scheduling this idle function. */
-	thumbnail_thread_is_running = TRUE;
-	pthread_create (&thumbnail_thread, &thread_attributes,
-			thumbnail_thread_start, NULL);
+		thumbnail_workers[i].is_running = TRUE;
+		n_running_workers++;
+		g_thread_pool_push (thumbnail_pool, GUINT_TO_POINTER (i + 1), NULL);
+	}
 
 	thumbnail_thread_starter_id = 0;
 
+	/*********************************
+	 * MUTEX UNLOCKED
+	 *********************************/
+
+	pthread_mutex_unlock (&thumbnails_mutex);
+
 	return FALSE;
 }
 
@@ -189,6 +242,7 @@ void
 nautilus_thumbnail_remove_from_queue (const char *file_uri)
 {
 	GList *node;
+	NautilusThumbnailInfo *info;
 	
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Remove from queue) Locking mutex\n");
@@ -202,9 +256,10 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 	if (thumbnails_to_make_hash) {
 		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 		
-		if (node && node->data != currently_thumbnailing) {
+		if (node && !((NautilusThumbnailInfo *) node->data)->in_progress) {
+			info = node->data;
 			g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-			free_thumbnail_info (node->data);
+			free_thumbnail_info (info);
 			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
 		}
 	}
@@ -219,6 +274,60 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 	pthread_mutex_unlock (&thumbnails_mutex);
 }
 
+void
+nautilus_thumbnail_remove_directory_from_queue (const char *directory_uri)
+{
+	GList *node, *next, *removed;
+	NautilusThumbnailInfo *info;
+	NautilusFile *file;
+
+	removed = NULL;
+
+	pthread_mutex_lock (&thumbnails_mutex);
+
+	/*********************************
+	 * MUTEX LOCKED
+	 *********************************/
+
+	for (node = ((GQueue *)&thumbnails_to_make)->head; node != NULL; node = next) {
+		next = node->next;
+		info = node->data;
+
+		if (info->in_progress ||
+		    g_strcmp0 (info->directory_uri, directory_uri) != 0) {
+			continue;
+		}
+
+		g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+		g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+		removed = g_list_prepend (removed, info);
+	}
+
+	/*********************************
+	 * MUTEX UNLOCKED
+	 *********************************/
+
+	pthread_mutex_unlock (&thumbnails_mutex);
+
+#ifdef DEBUG_THUMBNAILS
+	g_message ("(Main Thread) Cancelled %u thumbnails in %s\n",
+		   g_list_length (removed), directory_uri);
+#endif
+
+	/* The files are no longer queued, so let them be requested again
+	   when they are shown next time. */
+	for (node = removed; node != NULL; node = node->next) {
+		info = node->data;
+		file = nautilus_file_get_existing_by_uri (info->image_uri);
+		if (file != NULL) {
+			nautilus_file_set_is_thumbnailing (file, FALSE);
+			nautilus_file_unref (file);
+		}
+		free_thumbnail_info (info);
+	}
+	g_list_free (removed);
+}
+
 void
 nautilus_thumbnail_prioritize (const char *file_uri)
 {
@@ -236,7 +345,7 @@ nautilus_thumbnail_prioritize (const char *file_uri)
 	if (thumbnails_to_make_hash) {
 		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 		
-		if (node && node->data != currently_thumbnailing) {
+		if (node && !((NautilusThumbnailInfo *) node->data)->in_progress) {
 			g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
 			g_queue_push_head_link ((GQueue *)&thumbnails_to_make, node);
 		}
@@ -252,6 +361,59 @@ nautilus_thumbnail_prioritize (const char *file_uri)
 	pthread_mutex_unlock (&thumbnails_mutex);
 }
 
+void
+nautilus_thumbnail_deprioritize (const char *file_uri)
+{
+	GList *node;
+
+	pthread_mutex_lock (&thumbnails_mutex);
+
+	/*********************************
+	 * MUTEX LOCKED
+	 *********************************/
+
+	if (thumbnails_to_make_hash) {
+		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+
+		if (node && !((NautilusThumbnailInfo *) node->data)->in_progress) {
+			g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
+			g_queue_push_tail_link ((GQueue *)&thumbnails_to_make, node);
+		}
+	}
+
+	/*********************************
+	 * MUTEX UNLOCKED
+	 *********************************/
+
+	pthread_mutex_unlock (&thumbnails_mutex);
+}
+
+guint
+nautilus_thumbnail_get_n_workers (void)
+{
+	return n_thumbnail_workers;
+}
+
+gboolean
+nautilus_thumbnail_get_worker_stats (guint worker,
+				     NautilusThumbnailWorkerStats *stats)
+{
+	g_return_val_if_fail (stats != NULL, FALSE);
+
+	pthread_mutex_lock (&thumbnails_mutex);
+
+	if (worker >= n_thumbnail_workers) {
+		pthread_mutex_unlock (&thumbnails_mutex);
+		return FALSE;
+	}
+
+	*stats = thumbnail_workers[worker].stats;
+
+	pthread_mutex_unlock (&thumbnails_mutex);
+
+	return TRUE;
+}
+
 
 /***************************************************************************
  * Thumbnail Thread Functions.
@@ -384,6 +546,7 @@ nautilus_create_thumbnail (NautilusFile *file)
 	info = g_new0 (NautilusThumbnailInfo, 1);
 	info->image_uri = nautilus_file_get_uri (file);
 	info->mime_type = nautilus_file_get_mime_type (file);
+	info->directory_uri = nautilus_directory_get_uri (file->details->directory);
 	
 	/* Hopefully the NautilusFile will already have the image file mtime,
 	   so we can just use that. Otherwise we have to get it ourselves. */
@@ -425,11 +588,11 @@ nautilus_create_thumbnail (NautilusFile *file)
 		g_hash_table_insert (thumbnails_to_make_hash,
 				     info->image_uri,
 				     node);
-		/* If the thumbnail thread isn't running, and we haven't
-		   scheduled an idle function to start it up, do that now.
-		   We don't want to start it until all the other work is done,
+		/* If not every worker is running, and we haven't scheduled
+		   an idle function to start more, do that now.
+		   We don't want to start them until all the other work is done,
 		   so the GUI will be updated as quickly as possible.*/
-		if (thumbnail_thread_is_running == FALSE &&
+		if ((thumbnail_pool == NULL || n_running_workers < n_thumbnail_workers) &&
 		    thumbnail_thread_starter_id == 0) {
 			thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
 		}
@@ -454,21 +617,47 @@ nautilus_create_thumbnail (NautilusFile *file)
 	pthread_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
-static gpointer
-thumbnail_thread_start (gpointer data)
+/* Returns the first queued thumbnail no other worker is making, or NULL.
+   Lock thumbnails_mutex when calling this. Only the few thumbnails being
+   made by other workers can be in front of it. */
+static NautilusThumbnailInfo *
+peek_next_thumbnail (void)
 {
+	GList *node;
+	NautilusThumbnailInfo *info;
+
+	for (node = ((GQueue *)&thumbnails_to_make)->head; node != NULL; node = node->next) {
+		info = node->data;
+		if (!info->in_progress) {
+			return info;
+		}
+	}
+
+	return NULL;
+}
+
+/* thumbnail_worker_func is run by the pool threads to make thumbnails.
+   data is the index of the worker slot, plus one. */
+static void
+thumbnail_worker_func (gpointer data, gpointer user_data)
+{
+	NautilusThumbnailWorker *worker;
 	NautilusThumbnailInfo *info = NULL;
 	GdkPixbuf *pixbuf;
 	time_t current_orig_mtime = 0;
 	time_t current_time;
+	gint64 start_time = 0;
+	gboolean made = FALSE;
+	gboolean failed = FALSE;
 	GList *node;
 
+	worker = &thumbnail_workers[GPOINTER_TO_UINT (data) - 1];
+
 	/* We loop until there are no more thumbails to make, at which point
-	   we exit the thread. */
+	   we give the thread back to the pool. */
 	for (;;) {
 #ifdef DEBUG_THUMBNAILS
-		g_message ("(Thumbnail Thread) Locking mutex\n");
+		g_message ("(Thumbnail Worker %p) Locking mutex\n", worker);
 #endif
 		pthread_mutex_lock (&thumbnails_mutex);
 
@@ -476,51 +665,70 @@ thumbnail_thread_start (gpointer data)
 		 * MUTEX LOCKED
 		 *********************************/
 
-		/* Pop the last thumbnail we just made off the head of the
-		   list and free it. I did this here so we only have to lock
-		   the mutex once per thumbnail, rather than once before
-		   creating it and once after.
+		/* Pop the last thumbnail we just made off the list and free
+		   it. I did this here so we only have to lock the mutex once
+		   per thumbnail, rather than once before creating it and
+		   once after.
 		   Don't pop the thumbnail off the queue if the original file
 		   mtime of the request changed. Then we need to redo the thumbnail.
 		*/
-		if (currently_thumbnailing &&
-		    currently_thumbnailing->original_file_mtime == current_orig_mtime) {
-			g_assert (info == currently_thumbnailing);
-			node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-			g_assert (node != NULL);
-			g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-			free_thumbnail_info (info);
-			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+		if (info != NULL) {
+			worker->stats.busy_usec += g_get_monotonic_time () - start_time;
+			if (made) {
+				worker->stats.thumbnails_made++;
+			} else if (failed) {
+				worker->stats.thumbnails_failed++;
+			}
+
+			n_thumbnails_in_progress--;
+			if (info->original_file_mtime == current_orig_mtime) {
+				node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
+				g_assert (node != NULL);
+				g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+				free_thumbnail_info (info);
+				g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+			} else {
+				info->in_progress = FALSE;
+			}
 		}
-		currently_thumbnailing = NULL;
 
-		/* If there are no more thumbnails to make, reset the
-		   thumbnail_thread_is_running flag, unlock the mutex, and
-		   exit the thread. */
-		if (g_queue_is_empty ((GQueue *)&thumbnails_to_make)) {
+		/* Get the next one to make. We leave it on the list until it
+		   is created so the main thread doesn't add it again while we
+		   are creating it. */
+		info = peek_next_thumbnail ();
+
+		/* If there are no more thumbnails to make, free the worker
+		   slot, unlock the mutex, and return the thread to the pool. */
+		if (info == NULL) {
 #ifdef DEBUG_THUMBNAILS
-			g_message ("(Thumbnail Thread) Exiting\n");
+			g_message ("(Thumbnail Worker %p) Exiting, made %" G_GUINT64_FORMAT
+				   " failed %" G_GUINT64_FORMAT " busy %" G_GUINT64_FORMAT "us\n",
+				   worker,
+				   worker->stats.thumbnails_made,
+				   worker->stats.thumbnails_failed,
+				   worker->stats.busy_usec);
 #endif
-			thumbnail_thread_is_running = FALSE;
+			worker->is_running = FALSE;
+			n_running_workers--;
 			pthread_mutex_unlock (&thumbnails_mutex);
-			pthread_exit (NULL);
+			return;
 		}
 
-		/* Get the next one to make. We leave it on the list until it
-		   is created so the main thread doesn't add it again while we
-		   are creating it. */
-		info = g_queue_peek_head ((GQueue *)&thumbnails_to_make);
-		currently_thumbnailing = info;
+		info->in_progress = TRUE;
+		n_thumbnails_in_progress++;
 		current_orig_mtime = info->original_file_mtime;
 		/*********************************
 		 * MUTEX UNLOCKED
 		 *********************************/
 
 #ifdef DEBUG_THUMBNAILS
-		g_message ("(Thumbnail Thread) Unlocking mutex\n");
+		g_message ("(Thumbnail Worker %p) Unlocking mutex\n", worker);
 #endif
 		pthread_mutex_unlock (&thumbnails_mutex);
 
+		start_time = g_get_monotonic_time ();
+		made = FALSE;
+		failed = FALSE;
 		time (&current_time);
 
 		/* Don't try to create a thumbnail if the file was modified recently.
@@ -528,8 +736,8 @@ thumbnail_thread_start (gpointer data)
 		if (current_time < current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
 		    current_time >= current_orig_mtime) {
 #ifdef DEBUG_THUMBNAILS
-			g_message ("(Thumbnail Thread) Skipping: %s\n",
-				   info->image_uri);
+			g_message ("(Thumbnail Worker %p) Skipping: %s\n",
+				   worker, info->image_uri);
 #endif
 			/* Reschedule thumbnailing via a change notification */
 			g_timeout_add_seconds (1, thumbnail_thread_notify_file_changed,
@@ -539,8 +747,8 @@ thumbnail_thread_start (gpointer data)
 
 		/* Create the thumbnail. */
 #ifdef DEBUG_THUMBNAILS
-		g_message ("(Thumbnail Thread) Creating thumbnail: %s\n",
-			   info->image_uri);
+		g_message ("(Thumbnail Worker %p) Creating thumbnail: %s\n",
+			   worker, info->image_uri);
 #endif
 
 		pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
@@ -549,22 +757,24 @@ thumbnail_thread_start (gpointer data)
 
 		if (pixbuf) {
 #ifdef DEBUG_THUMBNAILS
-			g_message ("(Thumbnail Thread) Saving thumbnail: %s\n",
-				   info->image_uri);
+			g_message ("(Thumbnail Worker %p) Saving thumbnail: %s\n",
+				   worker, info->image_uri);
 #endif
 			gnome_desktop_thumbnail_factory_save_thumbnail (thumbnail_factory,
 									pixbuf,
 									info->image_uri,
 									current_orig_mtime);
 			g_object_unref (pixbuf);
+			made = TRUE;
 		} else {
 #ifdef DEBUG_THUMBNAILS
-			g_message ("(Thumbnail Thread) Thumbnail failed: %s\n",
-				   info->image_uri);
+			g_message ("(Thumbnail Worker %p) Thumbnail failed: %s\n",
+				   worker, info->image_uri);
 #endif
 			gnome_desktop_thumbnail_factory_create_failed_thumbnail (thumbnail_factory, 
 										 info->image_uri,
 										 current_orig_mtime);
+			failed = TRUE;
 		}
 		/* We need to call nautilus_file_changed(), but I don't think that is
 		   thread safe. So add an idle handler and do it from the main loop. */
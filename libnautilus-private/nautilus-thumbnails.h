@@ -28,6 +28,15 @@
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <libnautilus-private/nautilus-file.h>
 
+/* Throughput counters of one thumbnail worker, see
+ * nautilus_thumbnail_get_worker_stats(). */
+typedef struct {
+	guint64 thumbnails_made;
+	guint64 thumbnails_failed;
+	/* Time spent making thumbnails, in microseconds. */
+	guint64 busy_usec;
+} NautilusThumbnailWorkerStats;
+
 /* Returns NULL if there's no thumbnail yet. */
 void       nautilus_create_thumbnail                (NautilusFile *file);
 gboolean   nautilus_can_thumbnail                   (NautilusFile *file);
@@ -38,6 +47,14 @@ gboolean   nautilus_thumbnail_is_mimetype_limited_by_size
 /* Queue handling: */
 void       nautilus_thumbnail_remove_from_queue     (const char   *file_uri);
 void       nautilus_thumbnail_prioritize            (const char   *file_uri);
+void       nautilus_thumbnail_deprioritize          (const char   *file_uri);
+void       nautilus_thumbnail_remove_directory_from_queue
+						    (const char   *directory_uri);
+
+/* Worker pool statistics: */
+guint      nautilus_thumbnail_get_n_workers         (void);
+gboolean   nautilus_thumbnail_get_worker_stats      (guint                         worker,
+						     NautilusThumbnailWorkerStats *stats);
 
 
 #endif /* NAUTILUS_THUMBNAILS_H */
@@ -246,16 +246,16 @@ vfs_file_get_deep_counts (NautilusFile *file,
 
 	if (file->details->deep_counts_status != NAUTILUS_REQUEST_NOT_STARTED) {
 		if (directory_count != NULL) {
-			*directory_count = file->details->deep_directory_count;
+			*directory_count = NAUTILUS_FILE_FOLDER_DETAILS (file)->deep_directory_count;
 		}
 		if (file_count != NULL) {
-			*file_count = file->details->deep_file_count;
+			*file_count = NAUTILUS_FILE_FOLDER_DETAILS (file)->deep_file_count;
 		}
 		if (unreadable_directory_count != NULL) {
-			*unreadable_directory_count = file->details->deep_unreadable_count;
+			*unreadable_directory_count = NAUTILUS_FILE_FOLDER_DETAILS (file)->deep_unreadable_count;
 		}
 		if (total_size != NULL) {
-			*total_size = file->details->deep_size;
+			*total_size = NAUTILUS_FILE_FOLDER_DETAILS (file)->deep_size;
 		}
 		return file->details->deep_counts_status;
 	}
@@ -297,11 +297,11 @@ vfs_file_get_date (NautilusFile *file,
 		return TRUE;
 	case NAUTILUS_DATE_TYPE_TRASHED:
 		/* Before we have info on a file, the date is unknown. */
-		if (file->details->trash_time == 0) {
+		if (NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_time == 0) {
 			return FALSE;
 		}
 		if (date != NULL) {
-			*date = file->details->trash_time;
+			*date = NAUTILUS_FILE_EXTRA_DETAILS (file)->trash_time;
 		}
 		return TRUE;
 	}
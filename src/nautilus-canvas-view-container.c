@@ -198,6 +198,24 @@ nautilus_canvas_view_container_prioritize_thumbnailing (NautilusCanvasContainer
 	}
 }
 
+static void
+nautilus_canvas_view_container_deprioritize_thumbnailing (NautilusCanvasContainer *container,
+							NautilusCanvasIconData      *data)
+{
+	NautilusFile *file;
+	char *uri;
+
+	file = (NautilusFile *) data;
+
+	g_assert (NAUTILUS_IS_FILE (file));
+
+	if (nautilus_file_is_thumbnailing (file)) {
+		uri = nautilus_file_get_uri (file);
+		nautilus_thumbnail_deprioritize (uri);
+		g_free (uri);
+	}
+}
+
 static void
 update_auto_strv_as_quarks (GSettings   *settings,
 			    const gchar *key,
@@ -499,6 +517,27 @@ nautilus_canvas_view_container_compare_icons (NautilusCanvasContainer *container
 					   (NautilusFile *)icon_b);
 }
 
+static gboolean
+nautilus_canvas_view_container_sort_icon_data (NautilusCanvasContainer *container,
+					       NautilusCanvasIconData **data,
+					       guint n_data)
+{
+	NautilusCanvasView *canvas_view;
+
+	canvas_view = get_canvas_view (container);
+	g_return_val_if_fail (canvas_view != NULL, FALSE);
+
+	/* The desktop sorts by categories of its own */
+	if (NAUTILUS_CANVAS_VIEW_CONTAINER (container)->sort_for_desktop) {
+		return FALSE;
+	}
+
+	/* The icon data are the files */
+	nautilus_canvas_view_sort_files (canvas_view, (NautilusFile **) data, n_data);
+
+	return TRUE;
+}
+
 static int
 nautilus_canvas_view_container_compare_icons_by_name (NautilusCanvasContainer *container,
 						    NautilusCanvasIconData      *icon_a,
@@ -544,9 +583,11 @@ nautilus_canvas_view_container_class_init (NautilusCanvasViewContainerClass *kla
 	ic_class->start_monitor_top_left = nautilus_canvas_view_container_start_monitor_top_left;
 	ic_class->stop_monitor_top_left = nautilus_canvas_view_container_stop_monitor_top_left;
 	ic_class->prioritize_thumbnailing = nautilus_canvas_view_container_prioritize_thumbnailing;
+	ic_class->deprioritize_thumbnailing = nautilus_canvas_view_container_deprioritize_thumbnailing;
 
 	ic_class->compare_icons = nautilus_canvas_view_container_compare_icons;
 	ic_class->compare_icons_by_name = nautilus_canvas_view_container_compare_icons_by_name;
+	ic_class->sort_icon_data = nautilus_canvas_view_container_sort_icon_data;
 	ic_class->freeze_updates = nautilus_canvas_view_container_freeze_updates;
 	ic_class->unfreeze_updates = nautilus_canvas_view_container_unfreeze_updates;
 }
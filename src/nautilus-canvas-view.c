@@ -1506,6 +1506,32 @@ nautilus_canvas_view_compare_files (NautilusCanvasView   *canvas_view,
 		 canvas_view->details->sort_reversed);
 }
 
+/* Sorts files in the nautilus_canvas_view_compare_files() order */
+void
+nautilus_canvas_view_sort_files (NautilusCanvasView   *canvas_view,
+				 NautilusFile        **files,
+				 guint                 n_files)
+{
+	NautilusFileSortKey *keys;
+	guint i;
+
+	keys = g_new (NautilusFileSortKey, n_files);
+	for (i = 0; i < n_files; i++) {
+		keys[i].file = files[i];
+	}
+
+	nautilus_file_sort_keys_sort
+		(keys, n_files, canvas_view->details->sort->sort_type,
+		 nautilus_view_should_sort_directories_first (NAUTILUS_VIEW (canvas_view)),
+		 canvas_view->details->sort_reversed);
+
+	for (i = 0; i < n_files; i++) {
+		files[i] = keys[i].file;
+	}
+
+	g_free (keys);
+}
+
 static int
 compare_files (NautilusView   *canvas_view,
 	       NautilusFile *a,
@@ -62,6 +62,9 @@ GType   nautilus_canvas_view_get_type      (void);
 int     nautilus_canvas_view_compare_files (NautilusCanvasView   *canvas_view,
 					  NautilusFile *a,
 					  NautilusFile *b);
+void    nautilus_canvas_view_sort_files    (NautilusCanvasView   *canvas_view,
+					  NautilusFile        **files,
+					  guint                 n_files);
 void    nautilus_canvas_view_filter_by_screen (NautilusCanvasView *canvas_view,
 					     gboolean filter);
 void    nautilus_canvas_view_clean_up_by_name (NautilusCanvasView *canvas_view);
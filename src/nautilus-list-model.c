@@ -660,6 +660,49 @@ nautilus_list_model_compare_func (NautilusListModel *model,
 	return result;
 }
 
+/* Sorts the entries over an array of sort keys instead of comparing the
+ * files, then moves them into place */
+static gboolean
+sort_file_entries_by_key (NautilusListModel *model, GSequence *files, int length)
+{
+	NautilusFileSortType sort_type;
+	NautilusFileSortKey *keys;
+	GSequenceIter *ptr;
+	FileEntry *file_entry;
+	int i;
+
+	sort_type = nautilus_file_get_sort_type_for_attribute_q (model->details->sort_attribute);
+	if (sort_type == NAUTILUS_FILE_SORT_NONE) {
+		return FALSE;
+	}
+
+	keys = g_new (NautilusFileSortKey, length);
+	ptr = g_sequence_get_begin_iter (files);
+	for (i = 0; i < length; i++, ptr = g_sequence_iter_next (ptr)) {
+		file_entry = g_sequence_get (ptr);
+		if (file_entry->file == NULL) {
+			/* Leave the dummy row to the regular sort */
+			g_free (keys);
+			return FALSE;
+		}
+
+		keys[i].file = file_entry->file;
+		keys[i].data = ptr;
+	}
+
+	nautilus_file_sort_keys_sort (keys, length, sort_type,
+				      model->details->sort_directories_first,
+				      (model->details->order == GTK_SORT_DESCENDING));
+
+	for (i = 0; i < length; i++) {
+		g_sequence_move (keys[i].data, g_sequence_get_end_iter (files));
+	}
+
+	g_free (keys);
+
+	return TRUE;
+}
+
 static void
 nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *files, GtkTreePath *path)
 {
@@ -693,7 +736,9 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *file
 	}
 
 	/* sort */
-	g_sequence_sort (files, nautilus_list_model_file_entry_compare_func, model);
+	if (!sort_file_entries_by_key (model, files, length)) {
+		g_sequence_sort (files, nautilus_list_model_file_entry_compare_func, model);
+	}
 
 	/* generate new order */
 	new_order = g_new (int, length);
@@ -890,6 +935,120 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 	return TRUE;
 }
 
+static gint
+file_entry_ptr_compare_func (gconstpointer a,
+			     gconstpointer b,
+			     gpointer      user_data)
+{
+	return nautilus_list_model_file_entry_compare_func (*(FileEntry **) a,
+							    *(FileEntry **) b,
+							    user_data);
+}
+
+/* Adds files, which are all in directory, sorting them once and then
+ * merging them into the model, instead of looking up the place of each
+ * file on its own. The rows are announced one by one as they are
+ * inserted, reusing a single path. */
+void
+nautilus_list_model_add_files (NautilusListModel *model, GList *files,
+			       NautilusDirectory *directory)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+	FileEntry *file_entry;
+	GSequenceIter *ptr;
+	GPtrArray *entries;
+	GHashTable *batch;
+	NautilusFile *file;
+	GList *l;
+	guint i, n_existing;
+	gint position;
+	gboolean merge;
+
+	if (g_hash_table_lookup (model->details->directory_reverse_map, directory) != NULL) {
+		/* Expanded subfolders have a dummy row to replace and are
+		 * small, add their files one by one */
+		for (l = files; l != NULL; l = l->next) {
+			nautilus_list_model_add_file (model, l->data, directory);
+		}
+		return;
+	}
+
+	entries = g_ptr_array_sized_new (g_list_length (files));
+	/* A file can be added twice before the batch gets here */
+	batch = g_hash_table_new (NULL, NULL);
+	for (l = files; l != NULL; l = l->next) {
+		file = l->data;
+
+		if (g_hash_table_lookup (model->details->top_reverse_map, file) != NULL) {
+			g_warning ("file already in tree (parent_ptr: %p)!!!\n", NULL);
+			continue;
+		}
+		if (g_hash_table_contains (batch, file)) {
+			continue;
+		}
+		g_hash_table_add (batch, file);
+
+		file_entry = g_new0 (FileEntry, 1);
+		file_entry->file = nautilus_file_ref (file);
+		g_ptr_array_add (entries, file_entry);
+	}
+	g_hash_table_destroy (batch);
+
+	g_ptr_array_sort_with_data (entries, file_entry_ptr_compare_func, model);
+
+	/* Walking the whole model only pays off when adding enough files,
+	 * otherwise look up the place of each file */
+	n_existing = g_sequence_get_length (model->details->files);
+	merge = entries->len * g_bit_storage (n_existing) >= n_existing;
+
+	ptr = g_sequence_get_begin_iter (model->details->files);
+	position = 0;
+	path = gtk_tree_path_new_first ();
+
+	for (i = 0; i < entries->len; i++) {
+		file_entry = g_ptr_array_index (entries, i);
+
+		if (merge) {
+			/* The new files are sorted, so each one goes after
+			 * the previous one */
+			while (!g_sequence_iter_is_end (ptr) &&
+			       nautilus_list_model_file_entry_compare_func (g_sequence_get (ptr),
+									    file_entry, model) <= 0) {
+				ptr = g_sequence_iter_next (ptr);
+				position++;
+			}
+			file_entry->ptr = g_sequence_insert_before (ptr, file_entry);
+		} else {
+			file_entry->ptr = g_sequence_insert_sorted (model->details->files, file_entry,
+								    nautilus_list_model_file_entry_compare_func, model);
+			position = g_sequence_iter_get_position (file_entry->ptr);
+		}
+
+		g_hash_table_insert (model->details->top_reverse_map, file_entry->file, file_entry->ptr);
+
+		iter.stamp = model->details->stamp;
+		iter.user_data = file_entry->ptr;
+		gtk_tree_path_get_indices (path)[0] = position;
+		gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+
+		if (nautilus_file_is_directory (file_entry->file)) {
+			file_entry->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+
+			add_dummy_row (model, file_entry);
+
+			gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+							      path, &iter);
+		}
+
+		/* The next file goes after this one */
+		position++;
+	}
+
+	gtk_tree_path_free (path);
+	g_ptr_array_free (entries, TRUE);
+}
+
 void
 nautilus_list_model_file_changed (NautilusListModel *model, NautilusFile *file,
 				  NautilusDirectory *directory)
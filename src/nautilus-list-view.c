@@ -55,6 +55,7 @@
 #include <libnautilus-private/nautilus-module.h>
 #include <libnautilus-private/nautilus-tree-view-drag-dest.h>
 #include <libnautilus-private/nautilus-clipboard.h>
+#include <libnautilus-private/nautilus-thumbnails.h>
 
 #define DEBUG_FLAG NAUTILUS_DEBUG_LIST_VIEW
 #include <libnautilus-private/nautilus-debug.h>
@@ -105,6 +106,15 @@ struct NautilusListViewDetails {
 	gulong clipboard_handler_id;
 
 	GQuark last_sort_attr;
+
+	/* Top level rows whose thumbnails were last put in front of the
+	 * thumbnail queue, or -1 */
+	int thumbnail_range_start;
+	int thumbnail_range_end;
+
+	/* Files added since the last flush, by directory, so they are
+	 * inserted into the model in one go */
+	GHashTable *pending_added_files;
 };
 
 struct SelectionForeachData {
@@ -119,6 +129,11 @@ struct SelectionForeachData {
  */
 #define LIST_VIEW_MINIMUM_ROW_HEIGHT	28
 
+/* Number of pages of rows around the visible ones whose thumbnails are
+ * made ahead of the rest of the view.
+ */
+#define THUMBNAIL_PREFETCH_PAGES 1
+
 /* We wait two seconds after row is collapsed to unload the subdirectory */
 #define COLLAPSE_TO_UNLOAD_DELAY 2
 
@@ -140,6 +155,8 @@ static void   nautilus_list_view_rename_callback                 (NautilusFile
 								  GFile             *result_location,
 								  GError            *error,
 								  gpointer           callback_data);
+static void   flush_pending_added_files                          (NautilusListView        *list_view);
+static void   discard_pending_added_files                        (NautilusListView        *list_view);
 
 
 G_DEFINE_TYPE (NautilusListView, nautilus_list_view, NAUTILUS_TYPE_VIEW);
@@ -1137,6 +1154,8 @@ nautilus_list_view_reveal_selection (NautilusView *view)
 
 	g_return_if_fail (NAUTILUS_IS_LIST_VIEW (view));
 
+	flush_pending_added_files (NAUTILUS_LIST_VIEW (view));
+
         selection = nautilus_view_get_selection (view);
 
 	/* Make sure at least one of the selected items is scrolled into view */
@@ -1575,6 +1594,95 @@ set_up_pixbuf_size (NautilusListView *view)
 	gtk_tree_view_columns_autosize (view->details->tree_view);
 }
 
+static void
+reprioritize_thumbnail (NautilusListView *view,
+			int row,
+			gboolean prioritize)
+{
+	GtkTreePath *path;
+	NautilusFile *file;
+	char *uri;
+
+	path = gtk_tree_path_new_from_indices (row, -1);
+	file = nautilus_list_model_file_for_path (view->details->model, path);
+	gtk_tree_path_free (path);
+
+	if (file == NULL) {
+		return;
+	}
+
+	if (nautilus_file_is_thumbnailing (file)) {
+		uri = nautilus_file_get_uri (file);
+		if (prioritize) {
+			nautilus_thumbnail_prioritize (uri);
+		} else {
+			nautilus_thumbnail_deprioritize (uri);
+		}
+		g_free (uri);
+	}
+
+	nautilus_file_unref (file);
+}
+
+/* Puts the thumbnails of the visible rows in front of the thumbnail
+ * queue, followed by the ones within THUMBNAIL_PREFETCH_PAGES pages, and
+ * sends the ones that scrolled out of that range to the back.
+ */
+static void
+update_thumbnail_priorities (NautilusListView *view)
+{
+	GtkTreePath *start_path, *end_path;
+	int first_visible, last_visible;
+	int range_start, range_end, n_rows, margin;
+	int row;
+
+	if (view->details->model == NULL ||
+	    !gtk_tree_view_get_visible_range (view->details->tree_view,
+					      &start_path, &end_path)) {
+		return;
+	}
+
+	first_visible = gtk_tree_path_get_indices (start_path)[0];
+	last_visible = gtk_tree_path_get_indices (end_path)[0];
+	gtk_tree_path_free (start_path);
+	gtk_tree_path_free (end_path);
+
+	n_rows = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (view->details->model), NULL);
+	margin = (last_visible - first_visible + 1) * THUMBNAIL_PREFETCH_PAGES;
+	range_start = MAX (first_visible - margin, 0);
+	range_end = MIN (last_visible + margin, n_rows - 1);
+
+	if (view->details->thumbnail_range_start >= 0) {
+		for (row = view->details->thumbnail_range_start;
+		     row <= MIN (view->details->thumbnail_range_end, n_rows - 1); row++) {
+			if (row < range_start || row > range_end) {
+				reprioritize_thumbnail (view, row, FALSE);
+			}
+		}
+	}
+
+	/* Iterate in reverse, so the rows closest to the top end up first */
+	for (row = range_end; row > last_visible; row--) {
+		reprioritize_thumbnail (view, row, TRUE);
+	}
+	for (row = first_visible - 1; row >= range_start; row--) {
+		reprioritize_thumbnail (view, row, TRUE);
+	}
+	for (row = last_visible; row >= first_visible; row--) {
+		reprioritize_thumbnail (view, row, TRUE);
+	}
+
+	view->details->thumbnail_range_start = range_start;
+	view->details->thumbnail_range_end = range_end;
+}
+
+static void
+vadjustment_value_changed_callback (GtkAdjustment *adjustment,
+				    NautilusListView *view)
+{
+	update_thumbnail_priorities (view);
+}
+
 static void
 create_and_set_up_tree_view (NautilusListView *view)
 {
@@ -1786,6 +1894,11 @@ create_and_set_up_tree_view (NautilusListView *view)
 	gtk_widget_show (GTK_WIDGET (view->details->tree_view));
 	gtk_container_add (GTK_CONTAINER (view), GTK_WIDGET (view->details->tree_view));
 
+	g_signal_connect_object (gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (view)),
+				 "value-changed",
+				 G_CALLBACK (vadjustment_value_changed_callback),
+				 view, 0);
+
         atk_obj = gtk_widget_get_accessible (GTK_WIDGET (view->details->tree_view));
         atk_object_set_name (atk_obj, _("List View"));
 
@@ -1793,13 +1906,61 @@ create_and_set_up_tree_view (NautilusListView *view)
 	g_strfreev (default_column_order);
 }
 
+static void
+flush_pending_added_files (NautilusListView *list_view)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GList *files;
+
+	if (g_hash_table_size (list_view->details->pending_added_files) == 0) {
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, list_view->details->pending_added_files);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		files = g_list_reverse (value);
+		nautilus_list_model_add_files (list_view->details->model, files, key);
+		nautilus_file_list_free (files);
+		g_hash_table_iter_remove (&iter);
+	}
+}
+
+static void
+discard_pending_added_files (NautilusListView *list_view)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, list_view->details->pending_added_files);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		nautilus_file_list_free (value);
+		g_hash_table_iter_remove (&iter);
+	}
+}
+
 static void
 nautilus_list_view_add_file (NautilusView *view, NautilusFile *file, NautilusDirectory *directory)
 {
-	NautilusListModel *model;
+	NautilusListView *list_view;
+	gpointer key, value;
+	GList *files;
+
+	list_view = NAUTILUS_LIST_VIEW (view);
+
+	/* The files are added to the model when the view is done with this
+	 * batch of changes, or before anything needs them to be there */
+	if (g_hash_table_lookup_extended (list_view->details->pending_added_files,
+					  directory, &key, &value)) {
+		g_hash_table_steal (list_view->details->pending_added_files, key);
+		files = value;
+	} else {
+		key = nautilus_directory_ref (directory);
+		files = NULL;
+	}
 
-	model = NAUTILUS_LIST_VIEW (view)->details->model;
-	nautilus_list_model_add_file (model, file, directory);
+	files = g_list_prepend (files, nautilus_file_ref (file));
+	g_hash_table_insert (list_view->details->pending_added_files, key, files);
 }
 
 static char **
@@ -1953,6 +2114,9 @@ nautilus_list_view_begin_loading (NautilusView *view)
 
 	set_sort_order_from_metadata_and_preferences (list_view);
 	set_columns_settings_from_metadata_and_preferences (list_view);
+
+	list_view->details->thumbnail_range_start = -1;
+	list_view->details->thumbnail_range_end = -1;
 }
 
 static void
@@ -1980,6 +2144,8 @@ nautilus_list_view_clear (NautilusView *view)
 
 	list_view = NAUTILUS_LIST_VIEW (view);
 
+	discard_pending_added_files (list_view);
+
 	if (list_view->details->model != NULL) {
 		stop_cell_editing (list_view);
 		nautilus_list_model_clear (list_view->details->model);
@@ -2021,6 +2187,8 @@ nautilus_list_view_file_changed (NautilusView *view, NautilusFile *file, Nautilu
 	GtkTreePath *file_path;
 
 	listview = NAUTILUS_LIST_VIEW (view);
+
+	flush_pending_added_files (listview);
 	
 	nautilus_list_model_file_changed (listview->details->model, file, directory);
 
@@ -2278,6 +2446,8 @@ nautilus_list_view_get_selection_for_file_transfer (NautilusView *view)
 static gboolean
 nautilus_list_view_is_empty (NautilusView *view)
 {
+	flush_pending_added_files (NAUTILUS_LIST_VIEW (view));
+
 	return nautilus_list_model_is_empty (NAUTILUS_LIST_VIEW (view)->details->model);
 }
 
@@ -2288,6 +2458,8 @@ nautilus_list_view_end_file_changes (NautilusView *view)
 
 	list_view = NAUTILUS_LIST_VIEW (view);
 
+	flush_pending_added_files (list_view);
+
 	if (list_view->details->new_selection_path) {
 		gtk_tree_view_set_cursor (list_view->details->tree_view,
 					  list_view->details->new_selection_path,
@@ -2313,6 +2485,8 @@ nautilus_list_view_remove_file (NautilusView *view, NautilusFile *file, Nautilus
 	row_reference = NULL;
 	list_view = NAUTILUS_LIST_VIEW (view);
 	tree_model = GTK_TREE_MODEL(list_view->details->model);
+
+	flush_pending_added_files (list_view);
 	
 	if (nautilus_list_model_get_tree_iter_from_file (list_view->details->model, file, directory, &iter)) {
 		selection = gtk_tree_view_get_selection (list_view->details->tree_view);
@@ -2368,6 +2542,8 @@ nautilus_list_view_set_selection (NautilusView *view, GList *selection)
 	list_view = NAUTILUS_LIST_VIEW (view);
 	tree_selection = gtk_tree_view_get_selection (list_view->details->tree_view);
 
+	flush_pending_added_files (list_view);
+
 	g_signal_handlers_block_by_func (tree_selection, list_selection_changed_callback, view);
 
 	gtk_tree_selection_unselect_all (tree_selection);
@@ -3019,6 +3195,8 @@ nautilus_list_view_dispose (GObject *object)
 
 	list_view = NAUTILUS_LIST_VIEW (object);
 
+	discard_pending_added_files (list_view);
+
 	if (list_view->details->model) {
 		stop_cell_editing (list_view);
 		g_object_unref (list_view->details->model);
@@ -3066,6 +3244,7 @@ nautilus_list_view_finalize (GObject *object)
 	
 	g_list_free (list_view->details->cells);
 	g_hash_table_destroy (list_view->details->columns);
+	g_hash_table_destroy (list_view->details->pending_added_files);
 
 	if (list_view->details->hover_path != NULL) {
 		gtk_tree_path_free (list_view->details->hover_path);
@@ -3193,6 +3372,8 @@ nautilus_list_view_end_loading (NautilusView *view,
 	info = nautilus_clipboard_monitor_get_clipboard_info (monitor);
 
 	list_view_notify_clipboard_info (monitor, info, NAUTILUS_LIST_VIEW (view));
+
+	update_thumbnail_priorities (NAUTILUS_LIST_VIEW (view));
 }
 
 static const char *
@@ -3251,6 +3432,9 @@ static void
 nautilus_list_view_init (NautilusListView *list_view)
 {
 	list_view->details = g_new0 (NautilusListViewDetails, 1);
+	list_view->details->pending_added_files =
+		g_hash_table_new_full (g_direct_hash, g_direct_equal,
+				       (GDestroyNotify) nautilus_directory_unref, NULL);
 
 	/* ensure that the zoom level is always set before settings up the tree view columns */
 	list_view->details->zoom_level = get_default_zoom_level ();
@@ -3280,6 +3464,8 @@ nautilus_list_view_init (NautilusListView *list_view)
 	nautilus_list_view_set_zoom_level (list_view, get_default_zoom_level (), TRUE);
 
 	list_view->details->hover_path = NULL;
+	list_view->details->thumbnail_range_start = -1;
+	list_view->details->thumbnail_range_end = -1;
 	list_view->details->clipboard_handler_id =
 		g_signal_connect (nautilus_clipboard_monitor_get (),
 		                  "clipboard-info",
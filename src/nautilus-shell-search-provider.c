@@ -40,16 +40,30 @@
 #include "nautilus-shell-search-provider-generated.h"
 #include "nautilus-shell-search-provider.h"
 
+/* Only the best hits are kept, and the shell is answered with them once
+ * the latency budget is spent, without waiting for the whole crawl */
+#define SEARCH_MAX_RESULTS 100
+#define SEARCH_LATENCY_BUDGET_MS 300
+
+/* How many result metas are kept, and how many of the best results
+ * have theirs prepared before the shell asks for them */
+#define METAS_CACHE_SIZE 500
+#define METAS_PREFETCH_RESULTS 10
+
 typedef struct {
   NautilusShellSearchProvider *self;
 
   NautilusSearchEngine *engine;
   NautilusQuery *query;
 
-  GHashTable *hits;
+  /* Min-heap on relevance of the best hits so far, and their URIs */
+  GPtrArray *hits;
+  GHashTable *hit_uris;
   GDBusMethodInvocation *invocation;
 
   gint64 start_time;
+  guint budget_timeout_id;
+  gboolean budget_spent;
 } PendingSearch;
 
 struct _NautilusShellSearchProvider {
@@ -61,14 +75,25 @@ struct _NautilusShellSearchProvider {
 
   PendingSearch *current_search;
 
+  /* URI -> MetasCacheEntry, most recently used first in metas_lru */
   GHashTable *metas_cache;
+  GQueue metas_lru;
 
   NautilusBookmarkList *bookmarks;
   GVolumeMonitor *volumes;
 };
 
+typedef struct {
+  gchar *uri;
+  GVariant *meta;
+  GList link;
+} MetasCacheEntry;
+
 G_DEFINE_TYPE (NautilusShellSearchProvider, nautilus_shell_search_provider, G_TYPE_OBJECT)
 
+static void prefetch_result_metas (NautilusShellSearchProvider *self,
+                                   GList                       *hits);
+
 static GVariant *
 variant_from_pixbuf (GdkPixbuf *pixbuf)
 {
@@ -128,7 +153,13 @@ get_gicon (NautilusShellSearchProvider *self,
 static void
 pending_search_free (PendingSearch *search)
 {
-  g_hash_table_destroy (search->hits);
+  if (search->budget_timeout_id != 0)
+    g_source_remove (search->budget_timeout_id);
+
+  g_signal_handlers_disconnect_by_data (search->engine, search);
+
+  g_hash_table_destroy (search->hit_uris);
+  g_ptr_array_unref (search->hits);
   g_clear_object (&search->query);
   g_clear_object (&search->engine);
   g_clear_object (&search->invocation);
@@ -159,6 +190,119 @@ cancel_current_search (NautilusShellSearchProvider *self)
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (self->current_search->engine));
 }
 
+static gdouble
+hit_relevance_at (GPtrArray *hits,
+                  guint      idx)
+{
+  return nautilus_search_hit_get_relevance (g_ptr_array_index (hits, idx));
+}
+
+static void
+hits_swap (GPtrArray *hits,
+           guint      a,
+           guint      b)
+{
+  gpointer tmp;
+
+  tmp = hits->pdata[a];
+  hits->pdata[a] = hits->pdata[b];
+  hits->pdata[b] = tmp;
+}
+
+static void
+hits_sift_up (GPtrArray *hits,
+              guint      idx)
+{
+  guint parent;
+
+  while (idx > 0) {
+    parent = (idx - 1) / 2;
+    if (hit_relevance_at (hits, parent) <= hit_relevance_at (hits, idx))
+      break;
+
+    hits_swap (hits, parent, idx);
+    idx = parent;
+  }
+}
+
+static void
+hits_sift_down (GPtrArray *hits,
+                guint      idx)
+{
+  guint child, smallest;
+
+  while (TRUE) {
+    smallest = idx;
+
+    child = 2 * idx + 1;
+    if (child < hits->len &&
+        hit_relevance_at (hits, child) < hit_relevance_at (hits, smallest))
+      smallest = child;
+
+    child++;
+    if (child < hits->len &&
+        hit_relevance_at (hits, child) < hit_relevance_at (hits, smallest))
+      smallest = child;
+
+    if (smallest == idx)
+      break;
+
+    hits_swap (hits, smallest, idx);
+    idx = smallest;
+  }
+}
+
+/* Keeps hit if it is among the SEARCH_MAX_RESULTS best ones so far */
+static void
+pending_search_add_hit (PendingSearch     *search,
+                        NautilusSearchHit *hit)
+{
+  NautilusSearchHit *old_hit;
+  const gchar *hit_uri;
+  guint idx;
+
+  hit_uri = nautilus_search_hit_get_uri (hit);
+  old_hit = g_hash_table_lookup (search->hit_uris, hit_uri);
+
+  if (old_hit != NULL) {
+    /* The same location found twice, keep the better one */
+    if (nautilus_search_hit_get_relevance (old_hit) >= nautilus_search_hit_get_relevance (hit))
+      return;
+
+    for (idx = 0; g_ptr_array_index (search->hits, idx) != old_hit; idx++)
+      ;
+
+    g_hash_table_remove (search->hit_uris, hit_uri);
+    search->hits->pdata[idx] = g_object_ref (hit);
+    g_hash_table_insert (search->hit_uris, (gchar *) hit_uri, hit);
+    g_object_unref (old_hit);
+
+    hits_sift_down (search->hits, idx);
+    return;
+  }
+
+  if (search->hits->len < SEARCH_MAX_RESULTS) {
+    g_ptr_array_add (search->hits, g_object_ref (hit));
+    g_hash_table_insert (search->hit_uris, (gchar *) hit_uri, hit);
+    hits_sift_up (search->hits, search->hits->len - 1);
+    return;
+  }
+
+  /* Replace the worst of the best hits, if this one is better */
+  old_hit = g_ptr_array_index (search->hits, 0);
+  if (nautilus_search_hit_get_relevance (old_hit) >= nautilus_search_hit_get_relevance (hit))
+    return;
+
+  g_hash_table_remove (search->hit_uris, nautilus_search_hit_get_uri (old_hit));
+  search->hits->pdata[0] = g_object_ref (hit);
+  g_hash_table_insert (search->hit_uris, (gchar *) hit_uri, hit);
+  g_object_unref (old_hit);
+
+  hits_sift_down (search->hits, 0);
+}
+
+static void pending_search_return_hits (PendingSearch *search);
+
 static void
 search_hits_added_cb (NautilusSearchEngine *engine,
                       GList                *hits,
@@ -168,17 +312,24 @@ search_hits_added_cb (NautilusSearchEngine *engine,
   PendingSearch *search = user_data;
   GList *l;
   NautilusSearchHit *hit;
-  const gchar *hit_uri;
 
   g_debug ("*** Search engine hits added");
 
+  nautilus_search_hit_compute_scores_batch (hits, search->query);
+
   for (l = hits; l != NULL; l = l->next) {
     hit = l->data;
-    nautilus_search_hit_compute_scores (hit, search->query);
-    hit_uri = nautilus_search_hit_get_uri (hit);
-    g_debug ("    %s", hit_uri);
+    g_debug ("    %s", nautilus_search_hit_get_uri (hit));
 
-    g_hash_table_replace (search->hits, g_strdup (hit_uri), g_object_ref (hit));
+    pending_search_add_hit (search, hit);
+  }
+
+  /* The budget ran out before anything was found, answer with the
+   * first hits */
+  if (search->budget_spent && search->hits->len > 0) {
+    g_debug ("*** Search engine latency budget spent, returning early");
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (search->engine));
+    pending_search_return_hits (search);
   }
 }
 
@@ -204,20 +355,16 @@ search_hit_compare_relevance (gconstpointer a,
 }
 
 static void
-search_finished_cb (NautilusSearchEngine *engine,
-                    gpointer              user_data)
+pending_search_return_hits (PendingSearch *search)
 {
-  PendingSearch *search = user_data;
   GList *hits, *l;
   NautilusSearchHit *hit;
   GVariantBuilder builder;
-  gint64 current_time;
-
-  current_time = g_get_monotonic_time ();
-  g_debug ("*** Search engine search finished - time elapsed %dms",
-           (gint) ((current_time - search->start_time) / 1000));
+  guint idx;
 
-  hits = g_hash_table_get_values (search->hits);
+  hits = NULL;
+  for (idx = 0; idx < search->hits->len; idx++)
+    hits = g_list_prepend (hits, g_ptr_array_index (search->hits, idx));
   hits = g_list_sort (hits, search_hit_compare_relevance);
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
@@ -227,11 +374,44 @@ search_finished_cb (NautilusSearchEngine *engine,
     g_variant_builder_add (&builder, "s", nautilus_search_hit_get_uri (hit));
   }
 
+  prefetch_result_metas (search->self, hits);
+
   g_list_free (hits);
   pending_search_finish (search, search->invocation,
                          g_variant_new ("(as)", &builder));
 }
 
+static void
+search_finished_cb (NautilusSearchEngine *engine,
+                    gpointer              user_data)
+{
+  PendingSearch *search = user_data;
+  gint64 current_time;
+
+  current_time = g_get_monotonic_time ();
+  g_debug ("*** Search engine search finished - time elapsed %dms",
+           (gint) ((current_time - search->start_time) / 1000));
+
+  pending_search_return_hits (search);
+}
+
+static gboolean
+search_budget_timeout_cb (gpointer user_data)
+{
+  PendingSearch *search = user_data;
+
+  search->budget_timeout_id = 0;
+  search->budget_spent = TRUE;
+
+  if (search->hits->len > 0) {
+    g_debug ("*** Search engine latency budget spent, returning early");
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (search->engine));
+    pending_search_return_hits (search);
+  }
+
+  return FALSE;
+}
+
 static void
 search_error_cb (NautilusSearchEngine *engine,
                  const gchar          *error_message,
@@ -398,7 +578,8 @@ search_add_volumes_and_bookmarks (PendingSearch *search)
       hit = nautilus_search_hit_new (candidate->uri);
       nautilus_search_hit_set_fts_rank (hit, match);
       nautilus_search_hit_compute_scores (hit, search->query);
-      g_hash_table_replace (search->hits, g_strdup (candidate->uri), hit);
+      pending_search_add_hit (search, hit);
+      g_object_unref (hit);
     }
   }
   g_list_free_full (candidates, (GDestroyNotify) search_hit_candidate_free);
@@ -432,7 +613,8 @@ execute_search (NautilusShellSearchProvider *self,
 
   pending_search = g_slice_new0 (PendingSearch);
   pending_search->invocation = g_object_ref (invocation);
-  pending_search->hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  pending_search->hits = g_ptr_array_new_with_free_func (g_object_unref);
+  pending_search->hit_uris = g_hash_table_new (g_str_hash, g_str_equal);
   pending_search->query = query;
   pending_search->engine = nautilus_search_engine_new ();
   pending_search->start_time = g_get_monotonic_time ();
@@ -450,6 +632,9 @@ execute_search (NautilusShellSearchProvider *self,
 
   search_add_volumes_and_bookmarks (pending_search);
 
+  pending_search->budget_timeout_id =
+    g_timeout_add (SEARCH_LATENCY_BUDGET_MS, search_budget_timeout_cb, pending_search);
+
   /* start searching */
   g_debug ("*** Search engine search started");
   nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (pending_search->engine),
@@ -494,6 +679,9 @@ typedef struct {
   GDBusMethodInvocation *invocation;
 
   gchar **uris;
+
+  /* The metas built for this call, which may not all fit in the cache */
+  GHashTable *metas;
 } ResultMetasData;
 
 static void
@@ -502,10 +690,82 @@ result_metas_data_free (ResultMetasData *data)
   g_clear_object (&data->self);
   g_clear_object (&data->invocation);
   g_strfreev (data->uris);
+  if (data->metas != NULL)
+    g_hash_table_destroy (data->metas);
 
   g_slice_free (ResultMetasData, data);
 }
 
+static void
+metas_cache_entry_free (MetasCacheEntry *entry)
+{
+  g_free (entry->uri);
+  g_variant_unref (entry->meta);
+
+  g_slice_free (MetasCacheEntry, entry);
+}
+
+static GVariant *
+metas_cache_lookup (NautilusShellSearchProvider *self,
+                    const gchar                 *uri)
+{
+  MetasCacheEntry *entry;
+
+  entry = g_hash_table_lookup (self->metas_cache, uri);
+  if (entry == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->metas_lru, &entry->link);
+  g_queue_push_head_link (&self->metas_lru, &entry->link);
+
+  return entry->meta;
+}
+
+static void
+metas_cache_insert (NautilusShellSearchProvider *self,
+                    const gchar                 *uri,
+                    GVariant                    *meta)
+{
+  MetasCacheEntry *entry;
+  GList *link;
+
+  entry = g_hash_table_lookup (self->metas_cache, uri);
+  if (entry != NULL) {
+    g_variant_unref (entry->meta);
+    entry->meta = g_variant_ref (meta);
+    g_queue_unlink (&self->metas_lru, &entry->link);
+    g_queue_push_head_link (&self->metas_lru, &entry->link);
+    return;
+  }
+
+  entry = g_slice_new0 (MetasCacheEntry);
+  entry->uri = g_strdup (uri);
+  entry->meta = g_variant_ref (meta);
+  entry->link.data = entry;
+
+  g_hash_table_insert (self->metas_cache, entry->uri, entry);
+  g_queue_push_head_link (&self->metas_lru, &entry->link);
+
+  /* Drop the least recently used metas */
+  while (self->metas_lru.length > METAS_CACHE_SIZE) {
+    link = g_queue_pop_tail_link (&self->metas_lru);
+    entry = link->data;
+    g_hash_table_remove (self->metas_cache, entry->uri);
+    metas_cache_entry_free (entry);
+  }
+}
+
+static void
+metas_cache_clear (NautilusShellSearchProvider *self)
+{
+  GList *link;
+
+  while ((link = g_queue_pop_head_link (&self->metas_lru)) != NULL)
+    metas_cache_entry_free (link->data);
+
+  g_hash_table_remove_all (self->metas_cache);
+}
+
 static void
 result_metas_return_from_cache (ResultMetasData *data)
 {
@@ -517,9 +777,15 @@ result_metas_return_from_cache (ResultMetasData *data)
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
 
   for (idx = 0; data->uris[idx] != NULL; idx++) {
-    meta = g_hash_table_lookup (data->self->metas_cache,
-                                data->uris[idx]);
-    g_variant_builder_add_value (&builder, meta);
+    meta = NULL;
+    if (data->metas != NULL)
+      meta = g_hash_table_lookup (data->metas, data->uris[idx]);
+    if (meta == NULL)
+      meta = metas_cache_lookup (data->self, data->uris[idx]);
+
+    /* Only if it was dropped from the cache meanwhile */
+    if (meta != NULL)
+      g_variant_builder_add_value (&builder, meta);
   }
 
   current_time = g_get_monotonic_time ();
@@ -530,74 +796,139 @@ result_metas_return_from_cache (ResultMetasData *data)
                                          g_variant_new ("(aa{sv})", &builder));
 }
 
-static void
-result_list_attributes_ready_cb (GList    *file_list,
-                                 gpointer  user_data)
+/* Returns the meta the shell wants for file, with the icon serialized */
+static GVariant *
+build_result_meta (NautilusShellSearchProvider *self,
+                   NautilusFile                *file)
 {
-  ResultMetasData *data = user_data;
   GVariantBuilder meta;
-  NautilusFile *file;
-  GList *l;
   gchar *uri, *display_name;
   GdkPixbuf *pix;
   gchar *thumbnail_path, *gicon_str;
   GIcon *gicon;
   GFile *location;
-  GVariant *meta_variant;
 
-  for (l = file_list; l != NULL; l = l->next) {
-    file = l->data;
-    g_variant_builder_init (&meta, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_init (&meta, G_VARIANT_TYPE ("a{sv}"));
 
-    uri = nautilus_file_get_uri (file);
-    display_name = get_display_name (data->self, file);
+  uri = nautilus_file_get_uri (file);
+  display_name = get_display_name (self, file);
 
+  g_variant_builder_add (&meta, "{sv}",
+                         "id", g_variant_new_string (uri));
+  g_variant_builder_add (&meta, "{sv}",
+                         "name", g_variant_new_string (display_name));
+
+  gicon = NULL;
+  thumbnail_path = nautilus_file_get_thumbnail_path (file);
+
+  if (thumbnail_path != NULL) {
+    location = g_file_new_for_path (thumbnail_path);
+    gicon = g_file_icon_new (location);
+
+    g_free (thumbnail_path);
+    g_object_unref (location);
+  } else {
+    gicon = get_gicon (self, file);
+  }
+
+  if (gicon != NULL) {
+    gicon_str = g_icon_to_string (gicon);
     g_variant_builder_add (&meta, "{sv}",
-                           "id", g_variant_new_string (uri));
-    g_variant_builder_add (&meta, "{sv}",
-                           "name", g_variant_new_string (display_name));
+                           "gicon", g_variant_new_string (gicon_str));
 
-    gicon = NULL;
-    thumbnail_path = nautilus_file_get_thumbnail_path (file);
+    g_free (gicon_str);
+    g_object_unref (gicon);
+  } else {
+    pix = nautilus_file_get_icon_pixbuf (file, 128, TRUE,
+                                         NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS);
 
-    if (thumbnail_path != NULL) {
-      location = g_file_new_for_path (thumbnail_path);
-      gicon = g_file_icon_new (location);
+    g_variant_builder_add (&meta, "{sv}",
+                           "icon-data", variant_from_pixbuf (pix));
+    g_object_unref (pix);
+  }
 
-      g_free (thumbnail_path);
-      g_object_unref (location);
-    } else {
-      gicon = get_gicon (data->self, file);
-    }
+  g_free (display_name);
+  g_free (uri);
 
-    if (gicon != NULL) {
-      gicon_str = g_icon_to_string (gicon);
-      g_variant_builder_add (&meta, "{sv}",
-                             "gicon", g_variant_new_string (gicon_str));
+  return g_variant_ref_sink (g_variant_builder_end (&meta));
+}
 
-      g_free (gicon_str);
-      g_object_unref (gicon);
-    } else {
-      pix = nautilus_file_get_icon_pixbuf (file, 128, TRUE,
-                                           NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS);
+static void
+result_list_attributes_ready_cb (GList    *file_list,
+                                 gpointer  user_data)
+{
+  ResultMetasData *data = user_data;
+  NautilusFile *file;
+  GList *l;
+  gchar *uri;
+  GVariant *meta_variant;
 
-      g_variant_builder_add (&meta, "{sv}",
-                             "icon-data", variant_from_pixbuf (pix));
-      g_object_unref (pix);
-    }
+  data->metas = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       g_free, (GDestroyNotify) g_variant_unref);
 
-    meta_variant = g_variant_builder_end (&meta);
-    g_hash_table_insert (data->self->metas_cache,
-                         g_strdup (uri), g_variant_ref_sink (meta_variant));
+  for (l = file_list; l != NULL; l = l->next) {
+    file = l->data;
 
-    g_free (display_name);
-    g_free (uri);
+    uri = nautilus_file_get_uri (file);
+    meta_variant = build_result_meta (data->self, file);
+    metas_cache_insert (data->self, uri, meta_variant);
+    g_hash_table_insert (data->metas, uri, meta_variant);
   }
 
   result_metas_return_from_cache (data);
   result_metas_data_free (data);
 }
 
+static void
+result_list_prefetch_ready_cb (GList    *file_list,
+                               gpointer  user_data)
+{
+  NautilusShellSearchProvider *self = user_data;
+  GVariant *meta_variant;
+  gchar *uri;
+  GList *l;
+
+  for (l = file_list; l != NULL; l = l->next) {
+    uri = nautilus_file_get_uri (l->data);
+    meta_variant = build_result_meta (self, l->data);
+    metas_cache_insert (self, uri, meta_variant);
+
+    g_variant_unref (meta_variant);
+    g_free (uri);
+  }
+
+  g_object_unref (self);
+}
+
+/* Gets the metas of the best hits ready while the shell is still busy
+ * with the result set, the file attributes are read asynchronously */
+static void
+prefetch_result_metas (NautilusShellSearchProvider *self,
+                       GList                       *hits)
+{
+  GList *l, *missing_files;
+  const gchar *uri;
+  gint n_hits;
+
+  missing_files = NULL;
+  for (l = hits, n_hits = 0; l != NULL && n_hits < METAS_PREFETCH_RESULTS; l = l->next, n_hits++) {
+    uri = nautilus_search_hit_get_uri (l->data);
+
+    if (g_hash_table_lookup (self->metas_cache, uri) == NULL)
+      missing_files = g_list_prepend (missing_files, nautilus_file_get_by_uri (uri));
+  }
+
+  if (missing_files == NULL)
+    return;
+
+  nautilus_file_list_call_when_ready (missing_files,
+                                      NAUTILUS_FILE_ATTRIBUTES_FOR_ICON,
+                                      NULL,
+                                      result_list_prefetch_ready_cb,
+                                      g_object_ref (self));
+  nautilus_file_list_free (missing_files);
+}
+
 static gboolean
 handle_get_result_metas (NautilusShellSearchProvider2  *skeleton,
                          GDBusMethodInvocation         *invocation,
@@ -615,7 +946,7 @@ handle_get_result_metas (NautilusShellSearchProvider2  *skeleton,
   for (idx = 0; results[idx] != NULL; idx++) {
     uri = results[idx];
 
-    if (!g_hash_table_lookup (self->metas_cache, uri)) {
+    if (metas_cache_lookup (self, uri) == NULL) {
       missing_files = g_list_prepend (missing_files, nautilus_file_get_by_uri (uri));
     }
   }
@@ -746,7 +1077,10 @@ search_provider_dispose (GObject *obj)
   }
 
   g_clear_object (&self->object_manager);
-  g_hash_table_destroy (self->metas_cache);
+  if (self->metas_cache != NULL) {
+    metas_cache_clear (self);
+    g_clear_pointer (&self->metas_cache, g_hash_table_destroy);
+  }
   cancel_current_search (self);
 
   g_clear_object (&self->volumes);
@@ -757,8 +1091,8 @@ search_provider_dispose (GObject *obj)
 static void
 nautilus_shell_search_provider_init (NautilusShellSearchProvider *self)
 {
-  self->metas_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                             g_free, (GDestroyNotify) g_variant_unref);
+  self->metas_cache = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&self->metas_lru);
   self->bookmarks = nautilus_application_get_bookmarks (NAUTILUS_APPLICATION (g_application_get_default ()));
   self->volumes = g_volume_monitor_get ();
 
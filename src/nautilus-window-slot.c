@@ -231,7 +231,8 @@ sync_search_directory (NautilusWindowSlot *slot)
 		location = nautilus_query_editor_get_location (slot->details->query_editor);
 		nautilus_window_slot_open_location (slot, location, 0);
 		g_object_unref (location);
-	} else {
+	} else if (!nautilus_search_directory_refine_query (NAUTILUS_SEARCH_DIRECTORY (directory),
+							   query)) {
 		nautilus_search_directory_set_query (NAUTILUS_SEARCH_DIRECTORY (directory),
 						     query);
 		nautilus_window_slot_force_reload (slot);
@@ -1,15 +1,67 @@
 #include "test.h"
 
 #include <libnautilus-private/nautilus-file-operations.h>
+#include <libnautilus-private/nautilus-global-preferences.h>
 #include <libnautilus-private/nautilus-progress-info.h>
 #include <libnautilus-private/nautilus-progress-info-manager.h>
 
-static void
-copy_done (GHashTable *debuting_uris, 
-           gboolean success,
-           gpointer data)
+/* Copies the sources twice, first one file after the other into
+ * <dest dir>/serial, then with concurrent small file copies into
+ * <dest dir>/concurrent, and prints how many files per second
+ * each run managed. The settings are kept in memory, so the runs
+ * don't change the user's.
+ */
+
+typedef struct {
+	const char *name;
+	int concurrent_copies;
+} CopyRun;
+
+static CopyRun runs[] = {
+	{ "serial", 1 },
+	{ "concurrent", 8 }	/* or the default value, if not serial */
+};
+
+static GList *sources;
+static GFile *dest;
+static GtkWidget *window;
+static GSettings *prefs;
+static NautilusProgressInfoManager *manager;
+static int n_files;
+static guint current_run;
+static gint64 start_time;
+
+static int
+count_files (GFile *file)
 {
-	g_print ("Copy done\n");
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *child;
+	int count;
+
+	count = 1;
+	enumerator = g_file_enumerate_children (file,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						NULL, NULL);
+	if (enumerator == NULL) {
+		return count;
+	}
+
+	while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			child = g_file_get_child (file, g_file_info_get_name (info));
+			count += count_files (child);
+			g_object_unref (child);
+		} else {
+			count++;
+		}
+		g_object_unref (info);
+	}
+	g_object_unref (enumerator);
+
+	return count;
 }
 
 static void
@@ -34,21 +86,78 @@ finished_cb (NautilusProgressInfo *info,
 	     gpointer data)
 {
 	g_print ("Finished\n");
-	gtk_main_quit ();
 }
 
-int 
-main (int argc, char* argv[])
+static void start_run (void);
+
+static void
+copy_done (GHashTable *debuting_uris,
+           gboolean success,
+           gpointer data)
 {
-	GtkWidget *window;
-	GList *sources;
-	GFile *dest;
-	GFile *source;
-	int i;
+	double elapsed;
+
+	elapsed = (g_get_monotonic_time () - start_time) / (double) G_USEC_PER_SEC;
+
+	g_print ("Copy done (%s): %d files in %.2f s, %.0f files/s%s\n",
+		 runs[current_run].name, n_files, elapsed,
+		 elapsed > 0 ? n_files / elapsed : 0.0,
+		 success ? "" : " (failed)");
+
+	current_run++;
+	if (current_run < G_N_ELEMENTS (runs)) {
+		start_run ();
+	} else {
+		gtk_main_quit ();
+	}
+}
+
+static void
+start_run (void)
+{
+	GFile *run_dest;
 	GList *infos;
-        NautilusProgressInfoManager *manager;
 	NautilusProgressInfo *progress_info;
-	
+
+	g_settings_set_int (prefs, NAUTILUS_PREFERENCES_CONCURRENT_COPIES,
+			    runs[current_run].concurrent_copies);
+
+	run_dest = g_file_get_child (dest, runs[current_run].name);
+	g_file_make_directory (run_dest, NULL, NULL);
+
+	g_print ("Copying to %s with %d concurrent copies\n",
+		 runs[current_run].name, runs[current_run].concurrent_copies);
+
+	start_time = g_get_monotonic_time ();
+	nautilus_file_operations_copy (sources,
+				       NULL /* GArray *relative_item_points */,
+				       run_dest,
+				       GTK_WINDOW (window),
+				       copy_done, NULL);
+	g_object_unref (run_dest);
+
+	infos = nautilus_progress_info_manager_get_all_infos (manager);
+	if (infos == NULL) {
+		return;
+	}
+
+	/* Newest first */
+	progress_info = NAUTILUS_PROGRESS_INFO (infos->data);
+
+	g_signal_connect (progress_info, "changed", (GCallback)changed_cb, NULL);
+	g_signal_connect (progress_info, "progress-changed", (GCallback)progress_changed_cb, NULL);
+	g_signal_connect (progress_info, "finished", (GCallback)finished_cb, NULL);
+}
+
+int
+main (int argc, char* argv[])
+{
+	GFile *source;
+	GList *l;
+	int i, concurrent_copies;
+
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
 	test_init (&argc, &argv);
 
 	if (argc < 3) {
@@ -62,39 +171,35 @@ main (int argc, char* argv[])
 		sources = g_list_prepend (sources, source);
 	}
 	sources = g_list_reverse (sources);
-	
+
 	dest = g_file_new_for_commandline_arg (argv[i]);
-	
+
+	n_files = 0;
+	for (l = sources; l != NULL; l = l->next) {
+		n_files += count_files (l->data);
+	}
+
+	prefs = g_settings_new ("org.gnome.nautilus.preferences");
+	concurrent_copies = g_settings_get_int (prefs, NAUTILUS_PREFERENCES_CONCURRENT_COPIES);
+	if (concurrent_copies > 1) {
+		runs[1].concurrent_copies = concurrent_copies;
+	}
+
 	window = test_window_new ("copy test", 5);
-	
+
 	gtk_widget_show (window);
 
         manager = nautilus_progress_info_manager_new ();
 
-	nautilus_file_operations_copy (sources,
-				       NULL /* GArray *relative_item_points */,
-				       dest,
-				       GTK_WINDOW (window),
-				       copy_done, NULL);
-        
-	infos = nautilus_progress_info_manager_get_all_infos (manager);
-
-	if (infos == NULL) {
-		g_object_unref (manager);
-		return 0;
-	}
+	current_run = 0;
+	start_run ();
 
-	progress_info = NAUTILUS_PROGRESS_INFO (infos->data);
-
-	g_signal_connect (progress_info, "changed", (GCallback)changed_cb, NULL);
-	g_signal_connect (progress_info, "progress-changed", (GCallback)progress_changed_cb, NULL);
-	g_signal_connect (progress_info, "finished", (GCallback)finished_cb, NULL);
-	
 	gtk_main ();
 
         g_object_unref (manager);
-	
+	g_object_unref (prefs);
+	g_list_free_full (sources, g_object_unref);
+	g_object_unref (dest);
+
 	return 0;
 }
-
-
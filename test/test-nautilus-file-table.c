@@ -0,0 +1,127 @@
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-table.h>
+#include <glib.h>
+#include <stdlib.h>
+
+#define N_DIRECTORIES 100
+
+typedef struct {
+	char **uris;
+	guint n_uris;
+	guint n_lookups;
+	guint n_found;
+} LookupData;
+
+static char **
+generate_uris (guint n_files)
+{
+	char **uris;
+	guint i;
+
+	uris = g_new0 (char *, n_files + 1);
+	for (i = 0; i < n_files; i++) {
+		uris[i] = g_strdup_printf ("file:///nautilus-file-table-test/dir-%u/file-%u",
+					   i % N_DIRECTORIES, i);
+	}
+
+	return uris;
+}
+
+static gpointer
+lookup_thread_func (gpointer user_data)
+{
+	LookupData *data = user_data;
+	NautilusFile *file;
+	GRand *rand;
+	guint i;
+
+	rand = g_rand_new ();
+	data->n_found = 0;
+
+	for (i = 0; i < data->n_lookups; i++) {
+		file = nautilus_file_table_lookup (data->uris[g_rand_int_range (rand, 0, data->n_uris)]);
+		if (file != NULL) {
+			data->n_found++;
+			nautilus_file_table_release (file);
+		}
+	}
+
+	g_rand_free (rand);
+
+	return NULL;
+}
+
+static void
+run_threads (char **uris,
+	     guint n_uris,
+	     guint n_threads,
+	     guint n_lookups)
+{
+	GThread **threads;
+	LookupData *data;
+	GTimer *timer;
+	gdouble time;
+	guint i, n_found;
+
+	threads = g_new (GThread *, n_threads);
+	data = g_new (LookupData, n_threads);
+	timer = g_timer_new ();
+
+	for (i = 0; i < n_threads; i++) {
+		data[i].uris = uris;
+		data[i].n_uris = n_uris;
+		data[i].n_lookups = n_lookups;
+		threads[i] = g_thread_new ("lookup", lookup_thread_func, &data[i]);
+	}
+
+	n_found = 0;
+	for (i = 0; i < n_threads; i++) {
+		g_thread_join (threads[i]);
+		n_found += data[i].n_found;
+	}
+	time = g_timer_elapsed (timer, NULL);
+
+	g_print ("%u threads: %.0f lookups/s", n_threads, n_threads * n_lookups / time);
+	if (n_found != n_threads * n_lookups) {
+		g_print (", %u files not found!", n_threads * n_lookups - n_found);
+	}
+	g_print ("\n");
+
+	g_timer_destroy (timer);
+	g_free (data);
+	g_free (threads);
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusFile **files;
+	char **uris;
+	guint i, n_files, n_lookups, n_threads;
+
+	n_files = argc > 1 ? atoi (argv[1]) : 100000;
+	n_lookups = argc > 2 ? atoi (argv[2]) : 200000;
+
+	g_print ("Creating %u files\n", n_files);
+	uris = generate_uris (n_files);
+	files = g_new (NautilusFile *, n_files);
+	for (i = 0; i < n_files; i++) {
+		files[i] = nautilus_file_get_by_uri (uris[i]);
+	}
+
+	for (n_threads = 1; n_threads <= 2 * g_get_num_processors (); n_threads *= 2) {
+		run_threads (uris, n_files, n_threads, n_lookups);
+	}
+
+	/* Drop the references the threads released */
+	while (g_main_context_iteration (NULL, FALSE)) {
+	}
+
+	for (i = 0; i < n_files; i++) {
+		nautilus_file_unref (files[i]);
+	}
+	g_free (files);
+	g_strfreev (uris);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include <libnautilus-private/nautilus-query.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *syllables[] = {
+	"re", "port", "Doc", "ument", "IMG", "_", "2014", "-", "ab", "cd",
+	"Final", "draft", " ", "v2", ".", "txt", "jpg", "Notes", "x", "Q"
+};
+
+static const char *unicode_syllables[] = {
+	"Résumé", "Ünïcode", "Ça", "Ørsted", "naïve"
+};
+
+/* The matcher from before the ASCII fast path, to check the results
+ * and to compare the timings with. */
+static gdouble
+reference_matches_string (char **words,
+			  const char *string)
+{
+	gchar *normalized, *prepared_string, *ptr;
+	gint idx, nonexact_malus;
+	gdouble retval;
+
+	normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
+	prepared_string = g_utf8_strdown (normalized, -1);
+	g_free (normalized);
+
+	ptr = NULL;
+	nonexact_malus = 0;
+
+	for (idx = 0; words[idx] != NULL; idx++) {
+		if ((ptr = strstr (prepared_string, words[idx])) == NULL) {
+			g_free (prepared_string);
+			return -1;
+		}
+
+		nonexact_malus += strlen (ptr) - strlen (words[idx]);
+	}
+
+	retval = MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
+	g_free (prepared_string);
+
+	return retval;
+}
+
+static char **
+generate_names (guint n_names)
+{
+	GString *name;
+	char **names;
+	guint i, j, n_syllables;
+
+	names = g_new0 (char *, n_names + 1);
+	name = g_string_new (NULL);
+
+	for (i = 0; i < n_names; i++) {
+		g_string_truncate (name, 0);
+		n_syllables = g_random_int_range (2, 10);
+		for (j = 0; j < n_syllables; j++) {
+			g_string_append (name, syllables[g_random_int_range (0, G_N_ELEMENTS (syllables))]);
+		}
+
+		/* Some names are not plain ASCII */
+		if (g_random_int_range (0, 10) == 0) {
+			g_string_append (name, unicode_syllables[g_random_int_range (0, G_N_ELEMENTS (unicode_syllables))]);
+		}
+
+		names[i] = g_strdup (name->str);
+	}
+
+	g_string_free (name, TRUE);
+
+	return names;
+}
+
+static void
+run_query (const char *text,
+	   char **names,
+	   guint n_names)
+{
+	NautilusQuery *query;
+	GTimer *timer;
+	gchar *normalized, *prepared;
+	char **words;
+	gdouble *expected, reference_time, time;
+	guint i, n_matches, n_mismatches;
+
+	query = nautilus_query_new ();
+	nautilus_query_set_text (query, text);
+
+	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+	prepared = g_utf8_strdown (normalized, -1);
+	words = g_strsplit (prepared, " ", -1);
+	g_free (normalized);
+	g_free (prepared);
+
+	expected = g_new (gdouble, n_names);
+	timer = g_timer_new ();
+
+	for (i = 0; i < n_names; i++) {
+		expected[i] = reference_matches_string (words, names[i]);
+	}
+	reference_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	n_matches = 0;
+	n_mismatches = 0;
+	for (i = 0; i < n_names; i++) {
+		gdouble match;
+
+		match = nautilus_query_matches_string (query, names[i]);
+		if (match > -1) {
+			n_matches++;
+		}
+		if (match != expected[i]) {
+			n_mismatches++;
+		}
+	}
+	time = g_timer_elapsed (timer, NULL);
+
+	g_print ("\"%s\": %u matches, reference %.0f names/s, matcher %.0f names/s (%.1fx)\n",
+		 text, n_matches,
+		 n_names / reference_time, n_names / time, reference_time / time);
+	if (n_mismatches > 0) {
+		g_print ("  %u results differ from the reference!\n", n_mismatches);
+	}
+
+	g_timer_destroy (timer);
+	g_free (expected);
+	g_strfreev (words);
+	g_object_unref (query);
+}
+
+int
+main (int argc, char* argv[])
+{
+	char **names;
+	guint n_names;
+
+	n_names = argc > 1 ? atoi (argv[1]) : 2000000;
+
+	g_print ("Generating %u names\n", n_names);
+	names = generate_names (n_names);
+
+	run_query ("report", names, n_names);
+	run_query ("Doc final", names, n_names);
+	run_query ("img_2014", names, n_names);
+	run_query ("résumé", names, n_names);
+	run_query ("q", names, n_names);
+
+	g_strfreev (names);
+
+	return 0;
+}
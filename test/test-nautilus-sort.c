@@ -0,0 +1,165 @@
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-private.h>
+#include <glib.h>
+#include <stdlib.h>
+
+static const char *syllables[] = {
+	"re", "port", "Doc", "ument", "IMG", "_", "2014", "-", "ab", "cd",
+	"Final", "draft", " ", "v2", ".", "txt", "jpg", "Notes", "x", "Q"
+};
+
+/* NULL leaves the file without info, like one that is not loaded yet */
+static const char *content_types[] = {
+	"text/plain", "image/png", "image/jpeg", "application/pdf",
+	"text/x-csrc", "application/octet-stream", NULL
+};
+
+static void
+set_content_type (NautilusFile *file,
+		  const char *name,
+		  const char *content_type)
+{
+	GFileInfo *info;
+
+	info = g_file_info_new ();
+	g_file_info_set_name (info, name);
+	g_file_info_set_display_name (info, name);
+	g_file_info_set_file_type (info, G_FILE_TYPE_REGULAR);
+	g_file_info_set_content_type (info, content_type);
+	nautilus_file_update_info (file, info);
+	g_object_unref (info);
+}
+
+static NautilusFile **
+generate_files (guint n_files)
+{
+	NautilusFile **files;
+	GString *name;
+	const char *content_type;
+	char *escaped, *uri;
+	guint i, j, n_syllables;
+
+	files = g_new (NautilusFile *, n_files);
+	name = g_string_new (NULL);
+
+	for (i = 0; i < n_files; i++) {
+		g_string_truncate (name, 0);
+		n_syllables = g_random_int_range (2, 10);
+		for (j = 0; j < n_syllables; j++) {
+			g_string_append (name, syllables[g_random_int_range (0, G_N_ELEMENTS (syllables))]);
+		}
+		/* Keep the names unique */
+		g_string_append_printf (name, "-%u", i);
+
+		escaped = g_uri_escape_string (name->str, NULL, FALSE);
+		uri = g_strconcat ("file:///nautilus-sort-test/", escaped, NULL);
+		files[i] = nautilus_file_get_by_uri (uri);
+		g_free (uri);
+
+		content_type = content_types[g_random_int_range (0, G_N_ELEMENTS (content_types))];
+		if (content_type != NULL) {
+			set_content_type (files[i], name->str, content_type);
+		}
+		g_free (escaped);
+	}
+
+	g_string_free (name, TRUE);
+
+	return files;
+}
+
+static gint
+compare_files (gconstpointer a,
+	       gconstpointer b,
+	       gpointer user_data)
+{
+	return nautilus_file_compare_for_sort (*(NautilusFile **) a, *(NautilusFile **) b,
+					       GPOINTER_TO_INT (user_data), TRUE, FALSE);
+}
+
+/* Returns the number of files out of the reference order */
+static guint
+run_sort (NautilusFile **files,
+	  guint n_files,
+	  NautilusFileSortType sort_type,
+	  const char *sort_name)
+{
+	NautilusFile **reference;
+	NautilusFileSortKey *keys;
+	GTimer *timer;
+	gdouble reference_time, time;
+	guint i, n_mismatches;
+
+	reference = g_memdup (files, n_files * sizeof (NautilusFile *));
+	timer = g_timer_new ();
+	g_qsort_with_data (reference, n_files, sizeof (NautilusFile *),
+			   compare_files, GINT_TO_POINTER (sort_type));
+	reference_time = g_timer_elapsed (timer, NULL);
+
+	keys = g_new (NautilusFileSortKey, n_files);
+	for (i = 0; i < n_files; i++) {
+		keys[i].file = files[i];
+	}
+
+	g_timer_start (timer);
+	nautilus_file_sort_keys_sort (keys, n_files, sort_type, TRUE, FALSE);
+	time = g_timer_elapsed (timer, NULL);
+
+	n_mismatches = 0;
+	for (i = 0; i < n_files; i++) {
+		if (keys[i].file != reference[i]) {
+			n_mismatches++;
+		}
+	}
+
+	g_print ("%u files by %s: compare_for_sort %.3fs, sort keys %.3fs (%.1fx)\n",
+		 n_files, sort_name, reference_time, time, reference_time / time);
+	if (n_mismatches > 0) {
+		g_print ("  %u files are not in the reference order!\n", n_mismatches);
+	}
+
+	g_timer_destroy (timer);
+	g_free (keys);
+	g_free (reference);
+
+	return n_mismatches;
+}
+
+static guint
+run_size (guint n_files)
+{
+	NautilusFile **files;
+	guint i, n_mismatches;
+
+	files = generate_files (n_files);
+
+	n_mismatches = run_sort (files, n_files, NAUTILUS_FILE_SORT_BY_DISPLAY_NAME, "name");
+	n_mismatches += run_sort (files, n_files, NAUTILUS_FILE_SORT_BY_TYPE, "type");
+
+	for (i = 0; i < n_files; i++) {
+		nautilus_file_unref (files[i]);
+	}
+	g_free (files);
+
+	return n_mismatches;
+}
+
+int
+main (int argc, char* argv[])
+{
+	guint n_mismatches;
+	int i;
+
+	n_mismatches = 0;
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			n_mismatches += run_size (atoi (argv[i]));
+		}
+	} else {
+		n_mismatches += run_size (10000);
+		n_mismatches += run_size (100000);
+		n_mismatches += run_size (1000000);
+	}
+
+	return n_mismatches > 0 ? 1 : 0;
+}